@@ -0,0 +1,249 @@
+/* bench.hpp
+ * Helpers for the benchmark programs
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Small timing helpers shared by the bench_*.cpp programs.  Each scenario is
+ * run a few times and the fastest run is reported, since anything slower
+ * than that was slowed down by something other than the code being timed.
+ * Results can be printed as a table or as JSON for other tools to compare.
+ *
+ * On Linux, hardware counters (cycles, instructions, last level cache misses,
+ * dTLB misses, and branch misses) can also be read around each run using
+ * perf_event_open, and reported per operation.  Where the counters aren't
+ * permitted (see /proc/sys/kernel/perf_event_paranoid) or don't exist, as in
+ * many virtual machines, the scenarios are simply timed without them.
+ */
+#ifndef HVH_TOOLS_BENCH_H
+#define HVH_TOOLS_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+namespace hvh {
+namespace bench {
+
+	// keep(value)
+	// Stops the compiler from optimizing away the work which produced 'value'.
+	template <typename T>
+	inline void keep(const T& value) {
+	#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "g"(&value) : "memory");
+	#else
+		static volatile const void* sink;
+		sink = &value;
+	#endif
+	}
+
+	// now()
+	// Returns the time in seconds since an arbitrary point.
+	inline double now() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// The outcome of one scenario.
+	struct result {
+		std::string name;
+		size_t ops = 0;
+		double seconds = 0.0;
+		// How many bytes the scenario read or wrote, if it's limited by bandwidth (0 otherwise).
+		size_t bytes = 0;
+		// Extra fields describing the scenario, as (name, JSON value) pairs.
+		std::vector<std::pair<std::string, std::string>> tags;
+		// Hardware counters for the fastest run, per operation, as (name, value) pairs.  Empty unless enabled with use_counters.
+		std::vector<std::pair<std::string, double>> counters;
+
+		inline double ns_per_op() const { return ops ? (seconds * 1e9) / (double)ops : 0.0; }
+		inline double gb_per_s() const { return (seconds > 0.0) ? ((double)bytes / 1e9) / seconds : 0.0; }
+
+		// with_bytes(num_bytes)
+		// Records how many bytes the scenario moved, so that its bandwidth is reported too.
+		inline result& with_bytes(size_t num_bytes) { bytes = num_bytes; return *this; }
+
+		// tag(name, value)
+		// Records something about the scenario, such as the container or the number of rows, for the JSON output.
+		inline result& tag(const std::string& field, const std::string& value) { tags.emplace_back(field, quote(value)); return *this; }
+		inline result& tag(const std::string& field, const char* value) { return tag(field, std::string(value)); }
+		inline result& tag(const std::string& field, size_t value) { tags.emplace_back(field, std::to_string(value)); return *this; }
+
+		static std::string quote(const std::string& text) {
+			std::string quoted = "\"";
+			for (char c : text) {
+				if (c == '"' || c == '\\') quoted += '\\';
+				quoted += c;
+			}
+			return quoted + "\"";
+		}
+	};
+
+	// Hardware counters for the calling thread, in user space only.
+	// Each counter that can't be opened is skipped, so any subset of them may be available.
+	class counter_set {
+	public:
+		static const size_t NUM_COUNTERS = 5;
+
+		static const char* name(size_t i) {
+			static const char* names[NUM_COUNTERS] = { "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses" };
+			return names[i];
+		}
+
+		counter_set() {
+			for (size_t i = 0; i < NUM_COUNTERS; ++i) fds[i] = -1;
+		#if defined(__linux__)
+			const uint64_t read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			const uint32_t types[NUM_COUNTERS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+			const uint64_t configs[NUM_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+				PERF_COUNT_HW_CACHE_LL | read_miss, PERF_COUNT_HW_CACHE_DTLB | read_miss, PERF_COUNT_HW_BRANCH_MISSES };
+			for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+				perf_event_attr attr;
+				memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = types[i];
+				attr.config = configs[i];
+				attr.disabled = 1;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				// The counters aren't grouped, so the kernel may take turns running them; these let us scale the counts back up.
+				attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+			}
+		#endif
+		}
+		~counter_set() {
+		#if defined(__linux__)
+			for (int fd : fds) if (fd >= 0) close(fd);
+		#endif
+		}
+		counter_set(const counter_set&) = delete;
+		counter_set& operator=(const counter_set&) = delete;
+
+		// available()
+		// Returns true if at least one counter could be opened.
+		bool available() const {
+			for (int fd : fds) if (fd >= 0) return true;
+			return false;
+		}
+
+		// start()
+		// Resets and starts every counter.
+		void start() {
+		#if defined(__linux__)
+			for (int fd : fds) {
+				if (fd < 0) continue;
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		#endif
+		}
+
+		// stop(ops, counts)
+		// Stops every counter, and appends the count of each one that's open to 'counts', divided by 'ops'.
+		void stop(size_t ops, std::vector<std::pair<std::string, double>>& counts) {
+		#if defined(__linux__)
+			for (int fd : fds) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+				uint64_t values[3] = { 0, 0, 0 };
+				if (fds[i] < 0 || read(fds[i], values, sizeof(values)) != (ssize_t)sizeof(values)) continue;
+				double count = (values[2] == 0) ? 0.0 : (double)values[0] * ((double)values[1] / (double)values[2]);
+				counts.emplace_back(name(i), ops ? count / (double)ops : count);
+			}
+		#else
+			(void)ops; (void)counts;
+		#endif
+		}
+
+	private:
+		int fds[NUM_COUNTERS];
+	};
+
+	inline counter_set*& active_counters() {
+		static counter_set* counters = nullptr;
+		return counters;
+	}
+
+	// use_counters(enabled)
+	// Turns reading the hardware counters around every run on or off.
+	// Returns false, after explaining why on stderr, if none of the counters are available.
+	inline bool use_counters(bool enabled) {
+		static counter_set counters;
+		if (enabled && !counters.available()) {
+			fprintf(stderr, "Hardware counters are unavailable (not Linux, no PMU, or perf_event_paranoid is too high); timing only.\n");
+			enabled = false;
+		}
+		active_counters() = enabled ? &counters : nullptr;
+		return enabled;
+	}
+
+	// run(name, ops, setup, fn, repeats)
+	// Times fn(), which should perform 'ops' operations, 'repeats' times, and keeps the fastest.
+	// setup() is called before each run, untimed, to put things back the way fn expects them.
+	template <typename Setup, typename Fn>
+	result run(const std::string& name, size_t ops, Setup&& setup, Fn&& fn, int repeats = 5) {
+		result best;
+		best.name = name;
+		best.ops = ops;
+		counter_set* counters = active_counters();
+		for (int r = 0; r < repeats; ++r) {
+			setup();
+			if (counters) counters->start();
+			double start = now();
+			fn();
+			double elapsed = now() - start;
+			std::vector<std::pair<std::string, double>> counts;
+			if (counters) counters->stop(ops, counts);
+			if (r == 0 || elapsed < best.seconds) {
+				best.seconds = elapsed;
+				best.counters = std::move(counts);
+			}
+		}
+		return best;
+	}
+
+	// run(name, ops, fn, repeats)
+	// As above, for scenarios which don't need setting up between runs.
+	template <typename Fn>
+	result run(const std::string& name, size_t ops, Fn&& fn, int repeats = 5) {
+		return run(name, ops, []() {}, fn, repeats);
+	}
+
+	// print(result)
+	// Prints one line for a scenario, with its hardware counters per operation if they were read.
+	inline void print(const result& r) {
+		printf("%-64s %12.2f ns/op", r.name.c_str(), r.ns_per_op());
+		if (r.bytes) printf(" %9.2f GB/s", r.gb_per_s());
+		for (const auto& count : r.counters) printf(" %10.2f %s", count.second, count.first.c_str());
+		printf("\n");
+	}
+
+	// print_json(results)
+	// Prints every result as one JSON array, with the tags of each as extra fields.
+	inline void print_json(const std::vector<result>& results) {
+		printf("[\n");
+		for (size_t i = 0; i < results.size(); ++i) {
+			const result& r = results[i];
+			printf("  {\"name\": %s, \"ops\": %zu, \"seconds\": %.9f, \"ns_per_op\": %.3f",
+				result::quote(r.name).c_str(), r.ops, r.seconds, r.ns_per_op());
+			if (r.bytes) printf(", \"bytes\": %zu, \"gb_per_s\": %.3f", r.bytes, r.gb_per_s());
+			for (const auto& count : r.counters) printf(", %s: %.3f", result::quote(count.first + "_per_op").c_str(), count.second);
+			for (const auto& field : r.tags) printf(", %s: %s", result::quote(field.first).c_str(), field.second.c_str());
+			printf("}%s\n", (i + 1 < results.size()) ? "," : "");
+		}
+		printf("]\n");
+	}
+
+} // namespace bench
+} // namespace hvh
+
+#endif // HVH_TOOLS_BENCH_H
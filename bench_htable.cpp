@@ -0,0 +1,206 @@
+/* bench_htable.cpp
+ * Measures htable against std::unordered_multimap, and against bloom_htable,
+ * which answers most misses from its filter.
+ *
+ * Every scenario is run for three kinds of key (int64, short strings which
+ * fit in std::string's small buffer, and long strings which don't), for
+ * tables which fit in L1, L2, and the last level cache, and one well beyond
+ * it, and with each key appearing once or several times.
+ *
+ * Usage: bench_htable [--json] [--large] [--counters]
+ *   --json      print the results as a JSON array instead of a table
+ *   --large     add a table of 16M entries
+ *   --counters  also report hardware counters per operation, where permitted
+ */
+#include "htable.hpp"
+#include "bloom_htable.hpp"
+#include "bench.hpp"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+	// Keys are spread out, so that neighbouring keys don't land next to each other in either table.
+	inline uint64_t scramble(uint64_t i) { return (i + 1) * 0x9E3779B97F4A7C15ull; }
+
+	struct int_keys {
+		using type = int64_t;
+		static const char* name() { return "int64"; }
+		static type make(uint64_t i) { return (int64_t)scramble(i); }
+	};
+	struct short_string_keys {
+		using type = string;
+		static const char* name() { return "short_string"; }
+		static type make(uint64_t i) { return to_string(scramble(i) % 1000000000000ull); }
+	};
+	struct long_string_keys {
+		using type = string;
+		static const char* name() { return "long_string"; }
+		static type make(uint64_t i) { return "customer/orders/2026/" + to_string(scramble(i)) + "/line-items/summary"; }
+	};
+
+	// The containers, behind the same few calls.
+	template <typename Key>
+	struct htable_adapter {
+		static const char* name() { return "htable"; }
+		hvh::htable<Key, uint64_t> table;
+		void clear() { table = hvh::htable<Key, uint64_t>(); }
+		void reserve(size_t n) { table.reserve(n); }
+		void insert(const Key& key, uint64_t value) { table.insert(key, value); }
+		bool contains(const Key& key) const { return table.find(key) != SIZE_MAX; }
+		size_t count(const Key& key) const { return table.count(key); }
+		void erase(const Key& key) { table.erase(key); }
+		size_t size() const { return table.size(); }
+	};
+	template <typename Key>
+	struct bloom_htable_adapter {
+		static const char* name() { return "bloom_htable"; }
+		hvh::bloom_htable<Key, uint64_t> table;
+		void clear() { table = hvh::bloom_htable<Key, uint64_t>(); }
+		void reserve(size_t n) { table.reserve(n); }
+		void insert(const Key& key, uint64_t value) { table.insert(key, value); }
+		bool contains(const Key& key) const { return table.contains(key); }
+		size_t count(const Key& key) const { return table.count(key); }
+		void erase(const Key& key) { table.erase(key); }
+		size_t size() const { return table.size(); }
+	};
+	template <typename Key>
+	struct multimap_adapter {
+		static const char* name() { return "unordered_multimap"; }
+		unordered_multimap<Key, uint64_t> table;
+		void clear() { table = unordered_multimap<Key, uint64_t>(); }
+		void reserve(size_t n) { table.reserve(n); }
+		void insert(const Key& key, uint64_t value) { table.emplace(key, value); }
+		bool contains(const Key& key) const { return table.find(key) != table.end(); }
+		size_t count(const Key& key) const { return table.count(key); }
+		void erase(const Key& key) { auto it = table.find(key); if (it != table.end()) table.erase(it); }
+		size_t size() const { return table.size(); }
+	};
+
+	// Enough lookups that even the smallest tables take a measurable amount of time.
+	const size_t NUM_LOOKUPS = 1 << 20;
+
+	// Tags a result with its scenario, prints it unless we're writing JSON, and keeps it.
+	void report(vector<hvh::bench::result>& results, hvh::bench::result r, const char* container, const char* key,
+		size_t num_entries, size_t duplicates, bool json)
+	{
+		r.tag("container", container).tag("key", key).tag("entries", num_entries).tag("duplicates", duplicates);
+		if (!json) {
+			char label[160];
+			snprintf(label, sizeof(label), "%-18s %-12s %9zu x%zu  %s", container, key, num_entries, duplicates, r.name.c_str());
+			hvh::bench::result shown = r;
+			shown.name = label;
+			hvh::bench::print(shown);
+		}
+		results.push_back(r);
+	}
+
+	template <typename Keys, typename Container>
+	void run_container(vector<hvh::bench::result>& results, size_t num_entries, size_t duplicates, bool json) {
+		using Key = typename Keys::type;
+		const size_t num_keys = num_entries / duplicates;
+
+		// Every distinct key is inserted 'duplicates' times, in a shuffled order.
+		vector<Key> present(num_keys), absent(num_keys);
+		for (size_t i = 0; i < num_keys; ++i) {
+			present[i] = Keys::make(i);
+			absent[i] = Keys::make(i + num_keys);
+		}
+		vector<uint32_t> order(num_entries);
+		for (size_t i = 0; i < num_entries; ++i) order[i] = (uint32_t)(i % num_keys);
+		mt19937_64 random(num_entries + duplicates);
+		shuffle(order.begin(), order.end(), random);
+		vector<uint32_t> lookups(NUM_LOOKUPS);
+		for (uint32_t& index : lookups) index = (uint32_t)(random() % num_keys);
+
+		Container container;
+		auto fill = [&]() {
+			container.clear();
+			for (size_t i = 0; i < num_entries; ++i) container.insert(present[order[i]], i);
+		};
+		auto record = [&](const hvh::bench::result& r) { report(results, r, Container::name(), Keys::name(), num_entries, duplicates, json); };
+		const int repeats = (num_entries >= (1 << 22)) ? 1 : 3;
+
+		record(hvh::bench::run("insert", num_entries, [&]() { container.clear(); }, [&]() {
+			for (size_t i = 0; i < num_entries; ++i) container.insert(present[order[i]], i);
+		}, repeats));
+
+		record(hvh::bench::run("insert_reserved", num_entries, [&]() { container.clear(); container.reserve(num_entries); }, [&]() {
+			for (size_t i = 0; i < num_entries; ++i) container.insert(present[order[i]], i);
+		}, repeats));
+
+		// Growing a full table means moving (or relinking) every entry; cost is per entry.
+		record(hvh::bench::run("reserve_growth", num_entries, fill, [&]() { container.reserve(num_entries * 2); }, repeats));
+
+		fill();
+		const Container& lookup = container;
+		record(hvh::bench::run("find_hit", NUM_LOOKUPS, [&]() {
+			size_t found = 0;
+			for (uint32_t index : lookups) found += lookup.contains(present[index]);
+			hvh::bench::keep(found);
+		}, repeats));
+		record(hvh::bench::run("find_miss", NUM_LOOKUPS, [&]() {
+			size_t found = 0;
+			for (uint32_t index : lookups) found += lookup.contains(absent[index]);
+			hvh::bench::keep(found);
+		}, repeats));
+		record(hvh::bench::run("count", NUM_LOOKUPS, [&]() {
+			size_t total = 0;
+			for (uint32_t index : lookups) total += lookup.count(present[index]);
+			hvh::bench::keep(total);
+		}, repeats));
+
+		// Erase a key and put it straight back, so the table stays the same size while it churns.
+		const size_t churn = std::min(NUM_LOOKUPS, num_entries * 4);
+		record(hvh::bench::run("erase_churn", churn, fill, [&]() {
+			for (size_t i = 0; i < churn; ++i) {
+				const Key& key = present[lookups[i]];
+				container.erase(key);
+				container.insert(key, i);
+			}
+		}, repeats));
+	}
+
+	template <typename Keys>
+	void run_keys(vector<hvh::bench::result>& results, const vector<size_t>& sizes, bool json) {
+		for (size_t num_entries : sizes) {
+			for (size_t duplicates : { (size_t)1, (size_t)4 }) {
+				run_container<Keys, htable_adapter<typename Keys::type>>(results, num_entries, duplicates, json);
+				run_container<Keys, bloom_htable_adapter<typename Keys::type>>(results, num_entries, duplicates, json);
+				run_container<Keys, multimap_adapter<typename Keys::type>>(results, num_entries, duplicates, json);
+			}
+
+			// Rebuilding the hashmap in place has no unordered_multimap equivalent.
+			hvh::htable<typename Keys::type, uint64_t> table;
+			for (size_t i = 0; i < num_entries; ++i) table.insert(Keys::make(i), i);
+			report(results, hvh::bench::run("rehash", num_entries, [&]() { table.rehash(); }, 3), "htable", Keys::name(), num_entries, 1, json);
+		}
+	}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	bool json = false, large = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--json") == 0) json = true;
+		else if (strcmp(argv[i], "--large") == 0) large = true;
+		else if (strcmp(argv[i], "--counters") == 0) hvh::bench::use_counters(true);
+	}
+
+	// Roughly: fits in L1, fits in L2, fits in a typical last level cache, and far beyond it.
+	vector<size_t> sizes = { (size_t)1 << 9, (size_t)1 << 13, (size_t)1 << 17, (size_t)1 << 22 };
+	if (large) sizes.push_back((size_t)1 << 24);
+
+	vector<hvh::bench::result> results;
+	run_keys<int_keys>(results, sizes, json);
+	run_keys<short_string_keys>(results, sizes, json);
+	run_keys<long_string_keys>(results, sizes, json);
+	if (json) hvh::bench::print_json(results);
+	return 0;
+}
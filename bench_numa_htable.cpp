@@ -0,0 +1,96 @@
+/* bench_numa_htable.cpp
+ * Compares numa_htable against a single htable on a multi-socket machine.
+ *
+ * Every CPU gets a pinned thread which looks up random keys.  The htable is
+ * allocated by the main thread, so it all lives on one node; the numa_htable
+ * keeps each partition on its own node, and each thread only looks up keys
+ * whose partitions live on the thread's node.  Both tables are given the same
+ * keys in the same order, so the only difference is where the memory is.
+ *
+ * Usage: bench_numa_htable [num_keys] [lookups_per_thread]
+ */
+#include "numa_htable.hpp"
+#include "bench.hpp"
+
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+  #include <sched.h>
+#endif
+
+using namespace std;
+
+// Pins the calling thread to a CPU, so that it stays on one node.
+static void pin_to_cpu(size_t cpu) {
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+#else
+	(void)cpu;
+#endif
+}
+
+int main(int argc, char** argv) {
+	size_t num_keys = (argc > 1) ? strtoull(argv[1], nullptr, 10) : (size_t)1 << 24;
+	size_t lookups = (argc > 2) ? strtoull(argv[2], nullptr, 10) : (size_t)1 << 22;
+	size_t num_threads = max<size_t>(1, thread::hardware_concurrency());
+	size_t num_nodes = hvh::numa_node_count();
+	printf("%zu keys, %zu threads, %zu NUMA nodes\n", num_keys, num_threads, num_nodes);
+
+	hvh::htable<uint64_t, uint64_t> single;
+	hvh::numa_htable<uint64_t, uint64_t> partitioned;
+	single.reserve(num_keys);
+	partitioned.reserve(num_keys);
+	for (uint64_t i = 0; i < num_keys; ++i) {
+		single.insert(i, i * 3);
+		partitioned.insert(i, i * 3);
+	}
+
+	// Each thread finds out which node it's on, then draws its keys from that node's partitions.
+	vector<vector<uint64_t>> local_keys(num_threads);
+	vector<thread> threads;
+	for (size_t t = 0; t < num_threads; ++t) {
+		threads.emplace_back([&, t]() {
+			pin_to_cpu(t);
+			int node = hvh::numa_current_node();
+			mt19937_64 random(t);
+			vector<uint64_t>& keys = local_keys[t];
+			keys.reserve(lookups);
+			while (keys.size() < lookups) {
+				uint64_t key = random() % num_keys;
+				if (partitioned.node_of(partitioned.partition_of(key)) == node || num_nodes == 1) keys.push_back(key);
+			}
+		});
+	}
+	for (auto& thread : threads) thread.join();
+
+	auto lookup_all = [&](auto&& find) {
+		vector<thread> workers;
+		for (size_t t = 0; t < num_threads; ++t) {
+			workers.emplace_back([&, t]() {
+				pin_to_cpu(t);
+				uint64_t sum = 0;
+				for (uint64_t key : local_keys[t]) sum += find(key);
+				hvh::bench::keep(sum);
+			});
+		}
+		for (auto& worker : workers) worker.join();
+	};
+
+	size_t total = lookups * num_threads;
+	hvh::bench::print(hvh::bench::run("htable find (one node)", total, [&]() {
+		lookup_all([&](uint64_t key) { return single.at<1>(((const hvh::htable<uint64_t, uint64_t>&)single).find(key)); });
+	}));
+	hvh::bench::print(hvh::bench::run("numa_htable find (local partitions)", total, [&]() {
+		lookup_all([&](uint64_t key) {
+			const hvh::htable<uint64_t, uint64_t>& part = partitioned.partition_for(key);
+			return part.at<1>(part.find(key));
+		});
+	}));
+	return 0;
+}
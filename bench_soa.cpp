@@ -0,0 +1,188 @@
+/* bench_soa.cpp
+ * Measures the basic operations of soa.
+ *
+ * Column scans are compared against the same rows stored as an array of
+ * structs, at sizes which fit in L1, L2, and the last level cache, and one
+ * well beyond it.  The rest of the scenarios time growth, inserting and
+ * erasing in the middle, sorting, and binary search.  Scenarios which are
+ * limited by memory bandwidth report GB/s as well as ns/op.
+ *
+ * Usage: bench_soa [--json] [--counters]
+ *   --json      print the results as a JSON array instead of a table
+ *   --counters  also report hardware counters per operation, where permitted
+ */
+#include "soa.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+	// A row with a few columns that get scanned and a few that come along for the ride.
+	struct particle {
+		float x, y, z;
+		float vx, vy, vz;
+		uint64_t id;
+		uint32_t flags;
+		float mass;
+	};
+	using particle_soa = hvh::soa<float, float, float, float, float, float, uint64_t, uint32_t, float>;
+	const size_t ROW_BYTES = sizeof(float) * 7 + sizeof(uint64_t) + sizeof(uint32_t);
+
+	// Tags a result with its scenario, prints it unless we're writing JSON, and keeps it.
+	void report(vector<hvh::bench::result>& results, hvh::bench::result r, const char* layout, size_t num_rows, bool json) {
+		r.tag("layout", layout).tag("rows", num_rows);
+		if (!json) {
+			char label[160];
+			snprintf(label, sizeof(label), "%-4s %9zu  %s", layout, num_rows, r.name.c_str());
+			hvh::bench::result shown = r;
+			shown.name = label;
+			hvh::bench::print(shown);
+		}
+		results.push_back(r);
+	}
+
+	void fill(particle_soa& rows, vector<particle>& structs, size_t num_rows) {
+		rows.clear();
+		structs.clear();
+		rows.reserve(num_rows);
+		structs.reserve(num_rows);
+		for (size_t i = 0; i < num_rows; ++i) {
+			float f = (float)i;
+			rows.push_back(f, f * 2, f * 3, 1.0f, 0.5f, 0.25f, (uint64_t)i, (uint32_t)i, 1.0f);
+			structs.push_back(particle{ f, f * 2, f * 3, 1.0f, 0.5f, 0.25f, (uint64_t)i, (uint32_t)i, 1.0f });
+		}
+	}
+
+	// Scans read one or three columns.  Bandwidth counts only the bytes that the scan needs,
+	// so the array of structs (which drags whole rows through the cache) reports what it achieves usefully.
+	void bench_scans(vector<hvh::bench::result>& results, size_t num_rows, bool json) {
+		particle_soa rows;
+		vector<particle> structs;
+		fill(rows, structs, num_rows);
+		// Small tables are scanned many times over, so that every scenario takes a similar amount of time.
+		const size_t passes = std::max<size_t>(1, ((size_t)1 << 24) / num_rows);
+		const size_t ops = passes * num_rows;
+
+		report(results, hvh::bench::run("sum_one_column", ops, [&]() {
+			float total = 0.0f;
+			for (size_t pass = 0; pass < passes; ++pass) {
+				const float* x = rows.data<0>();
+				for (size_t i = 0; i < num_rows; ++i) total += x[i];
+			}
+			hvh::bench::keep(total);
+		}).with_bytes(ops * sizeof(float)), "soa", num_rows, json);
+		report(results, hvh::bench::run("sum_one_column", ops, [&]() {
+			float total = 0.0f;
+			for (size_t pass = 0; pass < passes; ++pass) {
+				for (size_t i = 0; i < num_rows; ++i) total += structs[i].x;
+			}
+			hvh::bench::keep(total);
+		}).with_bytes(ops * sizeof(float)), "aos", num_rows, json);
+
+		report(results, hvh::bench::run("integrate_three_columns", ops, [&]() {
+			for (size_t pass = 0; pass < passes; ++pass) {
+				float* x = rows.data<0>();
+				const float* vx = rows.data<3>();
+				const float* mass = rows.data<8>();
+				for (size_t i = 0; i < num_rows; ++i) x[i] += vx[i] * mass[i] * 0.01f;
+			}
+			hvh::bench::keep(rows.data<0>()[0]);
+		}).with_bytes(ops * sizeof(float) * 4), "soa", num_rows, json);
+		report(results, hvh::bench::run("integrate_three_columns", ops, [&]() {
+			for (size_t pass = 0; pass < passes; ++pass) {
+				for (size_t i = 0; i < num_rows; ++i) structs[i].x += structs[i].vx * structs[i].mass * 0.01f;
+			}
+			hvh::bench::keep(structs[0].x);
+		}).with_bytes(ops * sizeof(float) * 4), "aos", num_rows, json);
+	}
+
+	void bench_growth(vector<hvh::bench::result>& results, size_t num_rows, bool json) {
+		particle_soa rows;
+		// Starting from nothing, so that every doubling of the buffer is included.
+		report(results, hvh::bench::run("push_back", num_rows, [&]() { rows = particle_soa(); }, [&]() {
+			for (size_t i = 0; i < num_rows; ++i) rows.push_back(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, (uint64_t)i, (uint32_t)i, 1.0f);
+		}).with_bytes(num_rows * ROW_BYTES), "soa", num_rows, json);
+		report(results, hvh::bench::run("push_back_reserved", num_rows, [&]() { rows = particle_soa(); rows.reserve(num_rows); }, [&]() {
+			for (size_t i = 0; i < num_rows; ++i) rows.push_back(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, (uint64_t)i, (uint32_t)i, 1.0f);
+		}).with_bytes(num_rows * ROW_BYTES), "soa", num_rows, json);
+	}
+
+	void bench_middle(vector<hvh::bench::result>& results, size_t num_rows, bool json) {
+		particle_soa rows;
+		vector<particle> structs;
+		// Each insert and erase_shift moves half of the rows along by one.
+		const size_t ops = std::max<size_t>(16, std::min<size_t>(4096, ((size_t)1 << 26) / (num_rows * ROW_BYTES)));
+		const size_t moved = ops * (num_rows / 2) * ROW_BYTES;
+		report(results, hvh::bench::run("insert_middle", ops, [&]() { fill(rows, structs, num_rows); rows.reserve(num_rows + ops); }, [&]() {
+			for (size_t i = 0; i < ops; ++i) rows.insert(num_rows / 2, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, (uint64_t)i, (uint32_t)i, 1.0f);
+		}).with_bytes(moved), "soa", num_rows, json);
+		report(results, hvh::bench::run("erase_shift_middle", ops, [&]() { fill(rows, structs, num_rows + ops); }, [&]() {
+			for (size_t i = 0; i < ops; ++i) rows.erase_shift(num_rows / 2);
+		}).with_bytes(moved), "soa", num_rows, json);
+
+		mt19937_64 random(num_rows);
+		vector<size_t> victims(num_rows / 2);
+		for (size_t i = 0; i < victims.size(); ++i) victims[i] = random() % (num_rows - i);
+		report(results, hvh::bench::run("erase_swap_random", victims.size(), [&]() { fill(rows, structs, num_rows); }, [&]() {
+			for (size_t victim : victims) rows.erase_swap(victim);
+		}), "soa", num_rows, json);
+	}
+
+	void bench_sort(vector<hvh::bench::result>& results, size_t num_rows, bool json) {
+		hvh::soa<uint64_t, float, uint32_t> rows;
+		vector<uint64_t> keys(num_rows);
+		mt19937_64 random(num_rows);
+		for (auto& key : keys) key = random();
+		auto load = [&](const vector<uint64_t>& order) {
+			rows.clear();
+			for (size_t i = 0; i < num_rows; ++i) rows.push_back(order[i], (float)i, (uint32_t)i);
+		};
+		// Sorts are reported per n*log2(n), so that sizes can be compared.
+		const double ops = (double)num_rows * std::max(1.0, std::log2((double)num_rows));
+
+		report(results, hvh::bench::run("sort_random", (size_t)ops, [&]() { load(keys); }, [&]() { rows.sort<0>(); }), "soa", num_rows, json);
+		vector<uint64_t> sorted = keys;
+		std::sort(sorted.begin(), sorted.end());
+		report(results, hvh::bench::run("sort_sorted", (size_t)ops, [&]() { load(sorted); }, [&]() { rows.sort<0>(); }), "soa", num_rows, json);
+		vector<uint64_t> reversed(sorted.rbegin(), sorted.rend());
+		report(results, hvh::bench::run("sort_reversed", (size_t)ops, [&]() { load(reversed); }, [&]() { rows.sort<0>(); }), "soa", num_rows, json);
+
+		load(sorted);
+		const size_t num_searches = 1 << 20;
+		vector<uint64_t> goals(num_searches);
+		for (auto& goal : goals) goal = random();
+		report(results, hvh::bench::run("lower_bound", num_searches, [&]() {
+			size_t total = 0;
+			for (uint64_t goal : goals) total += rows.lower_bound<0>(goal);
+			hvh::bench::keep(total);
+		}), "soa", num_rows, json);
+	}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	bool json = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--json") == 0) json = true;
+		else if (strcmp(argv[i], "--counters") == 0) hvh::bench::use_counters(true);
+	}
+
+	// Roughly: one scanned column fits in L1, in L2, in a typical last level cache, and far beyond it.
+	const vector<size_t> sizes = { (size_t)1 << 12, (size_t)1 << 16, (size_t)1 << 20, (size_t)1 << 24 };
+
+	vector<hvh::bench::result> results;
+	for (size_t num_rows : sizes) bench_scans(results, num_rows, json);
+	for (size_t num_rows : sizes) bench_growth(results, num_rows, json);
+	for (size_t num_rows : { (size_t)1 << 12, (size_t)1 << 16, (size_t)1 << 20 }) bench_middle(results, num_rows, json);
+	// sort<K> pivots on the last row, so sorted and reversed input take quadratic time; keep these small.
+	for (size_t num_rows : { (size_t)1 << 10, (size_t)1 << 14 }) bench_sort(results, num_rows, json);
+	if (json) hvh::bench::print_json(results);
+	return 0;
+}
@@ -0,0 +1,245 @@
+/* bloom_htable.hpp
+ * An htable with a blocked bloom filter in front of it
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * When most lookups are for keys which aren't in the table, each miss still
+ * walks a probe chain through the hashmap, comparing keys on every
+ * collision.  A bloom filter can answer most of those misses on its own.
+ * The filter here is blocked: each key sets 8 bits, all within one 64 byte
+ * block, so checking a key touches a single cache line.  Bloom filters can't
+ * forget keys, so the filter is rebuilt whenever the table is rehashed, and
+ * after enough erasures that stale bits would start to let misses through.
+ */
+#ifndef HVH_TOOLS_BLOOMHTABLE_H
+#define HVH_TOOLS_BLOOMHTABLE_H
+
+#include "htable.hpp"
+
+#include <utility>
+#include <vector>
+
+namespace hvh {
+
+	// blocked_bloom_filter
+	// A bloom filter made of 512-bit blocks.  A key picks one block, then sets one bit in each of its 8 words.
+	class blocked_bloom_filter {
+	public:
+
+		// The default density: about 1% of absent keys get through when the filter is full.
+		static const size_t DEFAULT_BITS_PER_KEY = 12;
+
+		// blocked_bloom_filter(num_keys, bits_per_key)
+		// Creates an empty filter sized for 'num_keys' keys.
+		blocked_bloom_filter(size_t num_keys = 0, size_t bits_per_key = DEFAULT_BITS_PER_KEY) { resize(num_keys, bits_per_key); }
+
+		// resize(num_keys, bits_per_key)
+		// Empties the filter and resizes it for 'num_keys' keys.
+		// Complexity: O(n) in the size of the filter.
+		void resize(size_t num_keys, size_t bits_per_key = DEFAULT_BITS_PER_KEY) {
+			size_t num_blocks = ((num_keys * bits_per_key) + 511) / 512;
+			if (num_blocks == 0) num_blocks = 1;
+			myblocks.assign(num_blocks, block());
+		}
+
+		// clear()
+		// Forgets every key, without changing the size of the filter.
+		inline void clear() { myblocks.assign(myblocks.size(), block()); }
+
+		// add(hash)
+		// Adds a key, given its hash.
+		inline void add(size_t hash) {
+			uint64_t mixed = mix(hash);
+			block& b = myblocks[block_of(mixed)];
+			for (size_t i = 0; i < 8; ++i) b.words[i] |= bit_of(mixed, i);
+		}
+
+		// may_contain(hash)
+		// Returns false if the key with this hash was definitely never added, or true if it might have been.
+		inline bool may_contain(size_t hash) const {
+			uint64_t mixed = mix(hash);
+			const block& b = myblocks[block_of(mixed)];
+			// Checking all 8 words and branching once is faster than stopping at the first clear bit,
+			// since each of those branches would be a coin toss for the predictor.
+			uint64_t missing = 0;
+			for (size_t i = 0; i < 8; ++i) missing |= bit_of(mixed, i) & ~b.words[i];
+			return missing == 0;
+		}
+
+		// prefetch(hash)
+		// Starts loading the block that 'may_contain' would check, so that checking a batch of keys
+		// can overlap the cache misses.
+		inline void prefetch(size_t hash) const {
+		#if defined(__GNUC__) || defined(__clang__)
+			__builtin_prefetch(&myblocks[block_of(mix(hash))]);
+		#else
+			(void)hash;
+		#endif
+		}
+
+		// num_bytes()
+		// Returns the size of the filter in bytes.
+		inline size_t num_bytes() const { return myblocks.size() * sizeof(block); }
+
+		// fill_ratio()
+		// Returns the fraction of bits which are set.  About half means the filter is as full as it should get.
+		double fill_ratio() const {
+			size_t set = 0;
+			for (const block& b : myblocks) {
+				for (uint64_t word : b.words) {
+					for (; word; word &= word - 1) ++set;
+				}
+			}
+			return (double)set / (double)(myblocks.size() * 512);
+		}
+
+	private:
+		struct alignas(64) block { uint64_t words[8] = {}; };
+
+		// std::hash is often the identity, so scramble it before using any of its bits.
+		static inline uint64_t mix(size_t hash) {
+			uint64_t h = (uint64_t)hash;
+			h ^= h >> 33;
+			h *= 0xFF51AFD7ED558CCDull;
+			h ^= h >> 33;
+			return h;
+		}
+		// The high half picks the block; the low half, multiplied by a different odd salt per word, picks the bits.
+		inline size_t block_of(uint64_t mixed) const {
+			return (size_t)(((mixed >> 32) * (uint64_t)myblocks.size()) >> 32);
+		}
+		static inline uint64_t bit_of(uint64_t mixed, size_t word) {
+			static constexpr uint32_t salts[8] = { 0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du, 0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u };
+			return 1ull << (((uint32_t)mixed * salts[word]) >> 26);
+		}
+
+		std::vector<block> myblocks;
+	};
+
+	template <typename KeyT, typename... ItemTs>
+	class bloom_htable {
+	public:
+
+		// bloom_htable(bits_per_key)
+		// Creates an empty table whose filter uses about 'bits_per_key' bits for every entry the table has room for.
+		bloom_htable(size_t bits_per_key = blocked_bloom_filter::DEFAULT_BITS_PER_KEY) : mybitsperkey(bits_per_key) {}
+
+		// size(), capacity()
+		// Return the number of entries, and how many the table can hold before it grows.
+		inline size_t size() const { return mytable.size(); }
+		inline size_t capacity() const { return mytable.capacity(); }
+
+		// reserve(n)
+		// Ensures that the table can hold n entries without growing.  The filter is resized to match.
+		// Returns false if a memory allocation error occurs, true otherwise.
+		// Complexity: O(n).
+		bool reserve(size_t n) {
+			size_t old_capacity = mytable.capacity();
+			if (!mytable.reserve(n)) return false;
+			if (mytable.capacity() != old_capacity) rebuild_filter();
+			return true;
+		}
+
+		// insert(key, items...)
+		// Inserts a new entry, and adds its key to the filter.  Like htable, several entries may share a key.
+		// Returns false if a memory allocation error occurs, true otherwise.
+		// Complexity: O(1) amortized.
+		template <typename... Ts>
+		bool insert(const KeyT& key, Ts&&... items) {
+			size_t old_capacity = mytable.capacity();
+			if (!mytable.insert(key, std::forward<Ts>(items)...)) return false;
+			// Growing the table rehashed it, so the filter is rebuilt at its new size too.
+			if (mytable.capacity() != old_capacity) rebuild_filter();
+			else myfilter.add(std::hash<KeyT>{}(key));
+			return true;
+		}
+
+		// find(key)
+		// Returns the index of the first entry with the indicated key, or SIZE_MAX if there isn't one.
+		// Most keys which aren't in the table are turned away by the filter without touching the hashmap.
+		// Complexity: O(1) amortized.
+		inline size_t find(const KeyT& key) const {
+			size_t hash = std::hash<KeyT>{}(key);
+			if (!myfilter.may_contain(hash)) return SIZE_MAX;
+			return mytable.find_hashed(key, hash);
+		}
+
+		// contains(key), count(key)
+		// Return whether any entry has the indicated key, and how many do.
+		inline bool contains(const KeyT& key) const { return find(key) != SIZE_MAX; }
+		inline size_t count(const KeyT& key) const {
+			size_t hash = std::hash<KeyT>{}(key);
+			if (!myfilter.may_contain(hash)) return 0;
+			return mytable.count_hashed(key, hash);
+		}
+
+		// prefetch(key)
+		// Starts loading the filter block for 'key', for pipelining a batch of lookups.
+		inline void prefetch(const KeyT& key) const { myfilter.prefetch(std::hash<KeyT>{}(key)); }
+
+		// at<K>(index)
+		// Returns the Kth column (0 is the key) of the entry at 'index'.
+		// Keys can't be changed through here, since the filter wouldn't know.
+		template <size_t K>
+		inline auto& at(size_t index) {
+			static_assert(K > 0, "Keys can't be modified in place.");
+			return mytable.template at<K>(index);
+		}
+		template <size_t K>
+		inline const auto& at(size_t index) const { return mytable.template at<K>(index); }
+
+		// erase(key), erase_all(key), erase_at(index)
+		// Erase entries as htable does.  The key stays in the filter until it's next rebuilt.
+		// Complexity: O(1) amortized.
+		inline size_t erase(const KeyT& key) { return erased(mytable.erase(key)); }
+		inline size_t erase_all(const KeyT& key) { return erased(mytable.erase_all(key)); }
+		inline size_t erase_at(size_t index) { return erased(mytable.erase_at(index)); }
+
+		// clear()
+		// Erases every entry and empties the filter.  The capacity is unchanged.
+		inline void clear() {
+			mytable.clear();
+			myfilter.clear();
+			myerasures = 0;
+		}
+
+		// rehash()
+		// Rehashes the table and rebuilds the filter from its keys.
+		// Complexity: O(n).
+		inline void rehash() {
+			mytable.rehash();
+			rebuild_filter();
+		}
+
+		// filter(), table()
+		// Return the filter and the underlying htable.
+		inline const blocked_bloom_filter& filter() const { return myfilter; }
+		inline const htable<KeyT, ItemTs...>& table() const { return mytable; }
+
+	private:
+
+		void rebuild_filter() {
+			myfilter.resize(mytable.capacity(), mybitsperkey);
+			const KeyT* keys = mytable.template data<0>();
+			for (size_t i = 0; i < mytable.size(); ++i) myfilter.add(std::hash<KeyT>{}(keys[i]));
+			myerasures = 0;
+		}
+
+		// Erased keys leave their bits behind, and so does each deleted slot in the hashmap.
+		// The filter is sized for the table's capacity, so after half that many erasures it's
+		// rebuilt along with the hashmap, which keeps the cost O(1) amortized per erasure.
+		inline size_t erased(size_t num_erased) {
+			myerasures += num_erased;
+			if (num_erased && myerasures > mytable.capacity() / 2) rehash();
+			return num_erased;
+		}
+
+		htable<KeyT, ItemTs...> mytable;
+		blocked_bloom_filter myfilter;
+		size_t mybitsperkey;
+		size_t myerasures = 0;
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_BLOOMHTABLE_H
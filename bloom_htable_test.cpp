@@ -0,0 +1,128 @@
+#include "bloom_htable.hpp"
+#include <string>
+#include <cstdio>
+using namespace std;
+
+// A key which counts how many times it's been hashed.
+struct counted_key {
+	int value;
+	bool operator == (const counted_key& other) const { return value == other.value; }
+};
+static size_t num_hashes = 0;
+namespace std {
+	template <> struct hash<counted_key> {
+		size_t operator()(const counted_key& key) const {
+			++num_hashes;
+			return std::hash<int>{}(key.value);
+		}
+	};
+}
+
+// Counts how many of the keys in [first, last) the filter lets through, none of which are in the table.
+static size_t count_false_positives(const hvh::bloom_htable<int, string>& table, int first, int last) {
+	size_t result = 0;
+	for (int key = first; key < last; ++key) {
+		if (table.filter().may_contain(std::hash<int>{}(key))) ++result;
+	}
+	return result;
+}
+
+bool bloom_htable_test() {
+	printf("Testing bloom_htable...\n");
+	bool success = true;
+
+	// Growing from empty rebuilds the filter several times along the way.
+	hvh::bloom_htable<int, string> table;
+	for (int i = 0; i < 20000; ++i) table.insert(i * 2, to_string(i * 2));
+	for (int i = 0; i < 20000; ++i) {
+		size_t index = table.find(i * 2);
+		if (index == SIZE_MAX || table.at<1>(index) != to_string(i * 2)) {
+			printf("Key %i was inserted, but can't be found.\n", i * 2);
+			success = false;
+			break;
+		}
+	}
+
+	// Odd keys were never inserted.  A few get past the filter, but find still misses them.
+	size_t false_positives = count_false_positives(table, -100000, 0);
+	if (false_positives > 3000) {
+		printf("The filter let %zi out of 100000 absent keys through.\n", false_positives);
+		success = false;
+	}
+	for (int i = 0; i < 20000; ++i) {
+		if (table.contains(i * 2 + 1) || table.count(i * 2 + 1) != 0) {
+			printf("Key %i was never inserted, but was found.\n", i * 2 + 1);
+			success = false;
+			break;
+		}
+	}
+
+	// Duplicate keys are counted like htable counts them.
+	table.insert(4, string("four"));
+	if (table.count(4) != 2 || table.erase_all(4) != 2 || table.contains(4)) {
+		printf("Duplicate keys should be counted and erased together.\n");
+		success = false;
+	}
+
+	// Erase most of the table.  Somewhere along the way the filter is rebuilt,
+	// so the erased keys stop getting through it.
+	for (int i = 0; i < 18000; ++i) {
+		if (i != 2 && table.erase(i * 2) != 1) {
+			printf("Key %i should have been erased.\n", i * 2);
+			success = false;
+			break;
+		}
+	}
+	if (table.size() != 2000) {
+		printf("The table should hold 2000 entries, but holds %zi.\n", table.size());
+		success = false;
+	}
+	for (size_t i = 0; i < table.size(); ++i) {
+		int key = table.table().at<0>(i);
+		if (table.find(key) != i || table.at<1>(i) != to_string(key)) {
+			printf("Entry %zi (key %i) is broken after erasing.\n", i, key);
+			success = false;
+			break;
+		}
+	}
+	size_t stale = 0;
+	for (int i = 0; i < 18000; ++i) stale += table.filter().may_contain(std::hash<int>{}(i * 2));
+	if (stale > 18000 / 2) {
+		printf("%zi of 18000 erased keys still get through the filter.\n", stale);
+		success = false;
+	}
+
+	table.rehash();
+	if (table.filter().fill_ratio() > 0.1 || count_false_positives(table, -100000, 0) > 1000) {
+		printf("After a rehash, the filter should only hold the keys that are left.\n");
+		success = false;
+	}
+	for (int i = 18000; i < 20000; ++i) {
+		if (!table.contains(i * 2)) {
+			printf("Key %i was lost in the rehash.\n", i * 2);
+			success = false;
+			break;
+		}
+	}
+
+	// A lookup hashes its key once, for both the filter and the hashmap.
+	hvh::bloom_htable<counted_key, int> counted;
+	for (int i = 0; i < 100; ++i) counted.insert(counted_key{ i }, i);
+	num_hashes = 0;
+	size_t found = counted.find(counted_key{ 42 });
+	size_t hashes_per_find = num_hashes;
+	num_hashes = 0;
+	size_t num_counted = counted.count(counted_key{ 42 });
+	if (found == SIZE_MAX || counted.at<1>(found) != 42 || num_counted != 1 || hashes_per_find != 1 || num_hashes != 1) {
+		printf("find and count should each hash the key once, not %zi and %zi times.\n", hashes_per_find, num_hashes);
+		success = false;
+	}
+
+	table.clear();
+	if (table.size() != 0 || table.contains(39998) || table.filter().fill_ratio() != 0.0) {
+		printf("A cleared table should be empty, with an empty filter.\n");
+		success = false;
+	}
+
+	return success;
+}
@@ -0,0 +1,186 @@
+/* clock_cache.hpp
+ * A bounded cache built on htable
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Keeps at most a fixed number of entries, evicting the least recently used
+ * ones (approximately) using the CLOCK algorithm.  Every entry has a
+ * reference bit, stored as an extra column of the table, which is set when
+ * the entry is looked up.  To make room, a "hand" sweeps over the rows,
+ * clearing reference bits until it reaches an entry whose bit is already
+ * clear, and evicts that one.  Evicting moves the last row into the evicted
+ * row's place (as htable::erase_at does), so the rows stay dense and the
+ * table never grows past its capacity.
+ */
+#ifndef HVH_TOOLS_CLOCKCACHE_H
+#define HVH_TOOLS_CLOCKCACHE_H
+
+#include "htable.hpp"
+
+#include <utility>
+
+namespace hvh {
+
+	template <typename KeyT, typename... ItemTs>
+	class clock_cache {
+	public:
+
+		// clock_cache(capacity)
+		// Creates an empty cache which holds at most 'capacity' entries (at least 1).
+		// All of the memory the cache will ever need is allocated now.
+		clock_cache(size_t capacity) : mycapacity(capacity ? capacity : 1) {
+			mytable.reserve(mycapacity);
+		}
+
+		// capacity()
+		// Returns the greatest number of entries the cache will hold before it starts evicting.
+		inline size_t capacity() const { return mycapacity; }
+
+		// size()
+		// Returns the number of entries in the cache.
+		inline size_t size() const { return mytable.size(); }
+
+		// find(key)
+		// Looks up 'key', counting it as a hit or a miss, and marks the entry as recently used.
+		// Returns the entry's index, for use with 'item', or SIZE_MAX if the key isn't cached.
+		// Indices are only good until the next 'insert' or 'erase'.
+		// Complexity: O(1) amortized.
+		size_t find(const KeyT& key) {
+			size_t index = mytable.find(key);
+			if (index == SIZE_MAX) {
+				++mymisses;
+				return SIZE_MAX;
+			}
+			++myhits;
+			mytable.template at<1>(index) = 1;
+			return index;
+		}
+
+		// peek(key)
+		// As 'find', but doesn't count as a hit or miss, and doesn't mark the entry as used.
+		// Complexity: O(1) amortized.
+		inline size_t peek(const KeyT& key) const { return mytable.find(key); }
+
+		// contains(key)
+		// Returns true if 'key' is cached.  Like 'peek', this doesn't affect eviction or the counters.
+		inline bool contains(const KeyT& key) const { return peek(key) != SIZE_MAX; }
+
+		// key(index)
+		// Returns the key of the entry at 'index'.
+		inline const KeyT& key(size_t index) const { return mytable.template at<0>(index); }
+
+		// item<K>(index)
+		// Returns the Kth item of the entry at 'index'.
+		template <size_t K>
+		inline auto& item(size_t index) { return mytable.template at<K + 2>(index); }
+		template <size_t K>
+		inline const auto& item(size_t index) const { return mytable.template at<K + 2>(index); }
+
+		// insert(key, items...)
+		// Caches 'items' under 'key', replacing the items already cached under it if there are any.
+		// If the cache is full, the entry chosen by the clock hand is evicted first.
+		// New entries start out marked as used, so they survive at least one sweep of the hand.
+		// Returns the index of the entry.
+		// Complexity: O(1) amortized.
+		template <typename... Ts>
+		size_t insert(const KeyT& key, Ts&&... items) {
+			size_t index = mytable.find(key);
+			if (index != SIZE_MAX) {
+				mytable.template at<1>(index) = 1;
+				assign(index, std::index_sequence_for<ItemTs...>(), std::forward<Ts>(items)...);
+				return index;
+			}
+			if (mytable.size() >= mycapacity) evict();
+			if (!mytable.insert(key, (uint8_t)1, std::forward<Ts>(items)...)) return SIZE_MAX;
+			return mytable.size() - 1;
+		}
+
+		// erase(key)
+		// Removes 'key' from the cache.  Returns the number of entries removed (0 or 1).
+		// Complexity: O(1) amortized.
+		size_t erase(const KeyT& key) {
+			size_t result = mytable.erase(key);
+			if (result) erased();
+			return result;
+		}
+
+		// evict()
+		// Evicts one entry, as 'insert' does when the cache is full.  Returns false if the cache is empty.
+		// Each call clears at most one reference bit per entry, so the sweep is O(1) amortized.
+		// Complexity: O(1) amortized.
+		bool evict() {
+			const size_t num_rows = mytable.size();
+			if (num_rows == 0) return false;
+			uint8_t* used = mytable.template data<1>();
+			if (myhand >= num_rows) myhand = 0;
+			while (used[myhand]) {
+				used[myhand] = 0;
+				if (++myhand == num_rows) myhand = 0;
+			}
+			mytable.erase_at(myhand);
+			// The last row was moved into the hand's position.  It's one of the newest entries,
+			// so step past it, rather than making it the next one to be considered for eviction.
+			++myhand;
+			++myevictions;
+			erased();
+			return true;
+		}
+
+		// clear()
+		// Removes every entry.  The counters are unchanged.
+		inline void clear() {
+			mytable.clear();
+			myhand = 0;
+			myerasures = 0;
+		}
+
+		// hits(), misses(), evictions()
+		// How many times 'find' found its key, didn't find its key, and how many entries have been evicted.
+		inline size_t hits() const { return myhits; }
+		inline size_t misses() const { return mymisses; }
+		inline size_t evictions() const { return myevictions; }
+
+		// hit_ratio()
+		// Returns the fraction of calls to 'find' that found their key, or 0 if there haven't been any.
+		inline double hit_ratio() const {
+			size_t lookups = myhits + mymisses;
+			return lookups ? (double)myhits / (double)lookups : 0.0;
+		}
+
+		// reset_counters()
+		// Sets the hit, miss, and eviction counters back to 0.
+		inline void reset_counters() { myhits = 0; mymisses = 0; myevictions = 0; }
+
+		// table()
+		// Returns the underlying htable.  Column 0 is the key, column 1 is each entry's reference bit,
+		// and the items follow.
+		inline const htable<KeyT, uint8_t, ItemTs...>& table() const { return mytable; }
+
+	private:
+
+		template <size_t... Is, typename... Ts>
+		inline void assign(size_t index, std::index_sequence<Is...>, Ts&&... items) {
+			((mytable.template at<Is + 2>(index) = std::forward<Ts>(items)), ...);
+		}
+
+		// Every erase leaves a deleted slot in the hashmap, which lookups have to probe past.
+		// Under a never-ending stream of new keys those would pile up, so the hashmap is rebuilt
+		// after every 'capacity' erasures, which keeps the cost per erasure O(1) amortized.
+		inline void erased() {
+			if (++myerasures < mycapacity) return;
+			mytable.rehash();
+			myerasures = 0;
+		}
+
+		htable<KeyT, uint8_t, ItemTs...> mytable;
+		size_t mycapacity;
+		size_t myhand = 0;
+		size_t myerasures = 0;
+		size_t myhits = 0;
+		size_t mymisses = 0;
+		size_t myevictions = 0;
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_CLOCKCACHE_H
@@ -0,0 +1,118 @@
+#include "clock_cache.hpp"
+#include <string>
+#include <cstdio>
+using namespace std;
+
+bool clock_cache_test() {
+	printf("Testing clock_cache...\n");
+	bool success = true;
+
+	hvh::clock_cache<int, string, double> cache(100);
+	for (int i = 0; i < 100; ++i) cache.insert(i, to_string(i), i * 0.5);
+	if (cache.size() != 100 || cache.evictions() != 0) {
+		printf("A cache of 100 should hold 100 entries without evicting, instead it holds %zi after %zi evictions.\n", cache.size(), cache.evictions());
+		success = false;
+	}
+	const size_t buffer_capacity = cache.table().capacity();
+
+	// Replacing an entry's items doesn't add an entry.
+	cache.insert(42, string("forty-two"), -1.0);
+	const size_t index = cache.find(42);
+	if (cache.size() != 100 || index == SIZE_MAX || cache.item<0>(index) != "forty-two" || cache.item<1>(index) != -1.0) {
+		printf("Inserting an existing key should replace its items.\n");
+		success = false;
+	}
+
+	// Keys which keep being used survive a stream of new keys; everything else is evicted in turn.
+	// Every entry starts out marked as used, so the first eviction sweeps the whole clock and may take a hot key,
+	// which is then missed once and cached again, as a caller would.
+	for (int i = 100; i < 1100; ++i) {
+		for (int hot = 0; hot < 10; ++hot) {
+			if (cache.find(hot) == SIZE_MAX) cache.insert(hot, to_string(hot), hot * 0.5);
+		}
+		cache.insert(i, to_string(i), i * 0.5);
+	}
+	if (cache.size() != 100 || cache.evictions() != 1000 + cache.misses() || cache.table().capacity() != buffer_capacity) {
+		printf("After 1000 new keys the cache should still hold 100 entries in the same buffer; "
+			"instead it holds %zi after %zi evictions.\n", cache.size(), cache.evictions());
+		success = false;
+	}
+	if (cache.misses() > 10) {
+		printf("Constantly used keys were missed %zi times; each should be missed at most once.\n", cache.misses());
+		success = false;
+	}
+	for (int hot = 0; hot < 10; ++hot) {
+		if (!cache.contains(hot)) {
+			printf("Key %i was used constantly, but was evicted.\n", hot);
+			success = false;
+		}
+	}
+	if (!cache.contains(1099) || cache.contains(50)) {
+		printf("The newest key should be cached, and an old unused key should have been evicted.\n");
+		success = false;
+	}
+
+	// Every entry must still be findable, and hold the items it was inserted with.
+	for (size_t i = 0; i < cache.size(); ++i) {
+		int key = cache.key(i);
+		if (cache.peek(key) != i || cache.item<0>(i) != to_string(key)) {
+			printf("Entry %zi (key %i) can't be found, or has the wrong items.\n", i, key);
+			success = false;
+			break;
+		}
+	}
+
+	// 1 lookup for key 42, then 10 per new key.
+	if (cache.hits() + cache.misses() != 10001) {
+		printf("Expected 10001 lookups, got %zi hits and %zi misses.\n", cache.hits(), cache.misses());
+		success = false;
+	}
+	const size_t misses = cache.misses();
+	cache.find(-1);
+	if (cache.misses() != misses + 1 || cache.hit_ratio() <= 0.99 || cache.hit_ratio() >= 1.0) {
+		printf("A missing key should count as a miss; the hit ratio is %f.\n", cache.hit_ratio());
+		success = false;
+	}
+	cache.reset_counters();
+	if (cache.hits() != 0 || cache.hit_ratio() != 0.0) {
+		printf("reset_counters should zero the counters.\n");
+		success = false;
+	}
+
+	if (cache.erase(5) != 1 || cache.contains(5) || cache.size() != 99 || cache.erase(5) != 0) {
+		printf("Erasing a key should remove exactly that entry.\n");
+		success = false;
+	}
+
+	// A long stream of unique keys through a small cache: memory stays flat, and lookups keep working
+	// even though every eviction leaves a deleted slot behind in the hashmap.
+	hvh::clock_cache<uint64_t, uint64_t> small(64);
+	const size_t small_capacity = small.table().capacity();
+	for (uint64_t i = 0; i < 100000; ++i) {
+		small.insert(i, i * 3);
+		if (small.find(i) == SIZE_MAX) {
+			printf("Key %zi can't be found right after inserting it.\n", (size_t)i);
+			success = false;
+			break;
+		}
+	}
+	if (small.size() != 64 || small.table().capacity() != small_capacity) {
+		printf("A cache of 64 grew to %zi entries and %zi capacity.\n", small.size(), small.table().capacity());
+		success = false;
+	}
+	for (size_t i = 0; i < small.size(); ++i) {
+		if (small.peek(small.key(i)) != i || small.item<0>(i) != small.key(i) * 3) {
+			printf("Entry %zi of the small cache is broken.\n", i);
+			success = false;
+			break;
+		}
+	}
+
+	small.clear();
+	if (small.size() != 0 || small.evict()) {
+		printf("A cleared cache should be empty, with nothing to evict.\n");
+		success = false;
+	}
+
+	return success;
+}
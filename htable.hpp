@@ -13,6 +13,15 @@
 
 #include "soa.hpp"
 
+#include <vector>
+#include <algorithm> // For std::sort
+
+// A rehash only uses as many threads as can each be given at least this many rows, since handing a thread
+// less work than this costs more than it saves.  Define it as SIZE_MAX to always rehash on the calling thread.
+#ifndef HVH_HTABLE_PARALLEL_MIN_ROWS_PER_THREAD
+  #define HVH_HTABLE_PARALLEL_MIN_ROWS_PER_THREAD 32768
+#endif
+
 namespace hvh {
 
 	template <typename KeyT, typename... ItemTs>
@@ -43,12 +52,14 @@ namespace hvh {
 		// Copy constructor for a hash table.
 		// Initializes the hash table as a copy of rhs.
 		// Complexity: O(n).
-		htable(const htable<KeyT, ItemTs...>& other) {
+		htable(const htable<KeyT, ItemTs...>& other) : soa<KeyT, ItemTs...>() {
 			reserve(other.capacity());
-			memcpy(hashmap, other.hashmap, sizeof(uint32_t) * hashcapacity);
 			_soa_base<KeyT, ItemTs...>& base = *this;
 			const _soa_base<KeyT, ItemTs...>& otherbase = other;
 			base.copy(otherbase);
+			// An empty table has no hashmap to copy, and ours was sized by reserve.
+			if (hashcapacity == other.hashcapacity) memcpy(hashmap, other.hashmap, sizeof(uint32_t) * hashcapacity);
+			else rehash();
 		}
 		// operator = (&& rhs)
 		// Move-assignment operator for a hash table.
@@ -59,7 +70,7 @@ namespace hvh {
 		// Copy-assignment operator for a hash table.
 		// Copies the entries from the rhs hash table into ourselves, replacing old contents.
 		// Complexity: O(n).
-		htable<KeyT, ItemTs...>& operator = (htable other) { swap(*this, other); return *this; }
+		htable<KeyT, ItemTs...>& operator = (const htable& other) { htable<KeyT, ItemTs...> copy(other); swap(*this, copy); return *this; }
 		// ~htable()
 		// Destructor for a hash table.
 		// Calls the destructor for all contained keys and items, then frees held memory.
@@ -67,10 +78,11 @@ namespace hvh {
 		~htable() {
 			_soa_base<KeyT, ItemTs...>& base = *this;
 			base.destruct_range(0, this->mysize);
+			size_t num_bytes = buffer_bytes();
 			base.nullify();
 			this->mysize = 0;
 			this->mycapacity = 0;
-			if (hashmap) _soa_aligned_free(hashmap);
+			this->free_buffer(hashmap, num_bytes);
 		}
 
 		// swap(lhs, rhs)
@@ -90,7 +102,7 @@ namespace hvh {
 		// The capacity of the hash table is unchanged.
 		// Complexity: O(n).
 		inline void clear() {
-			memset(hashmap, INDEXNUL, sizeof(uint32_t) * hashcapacity);
+			if (hashmap) memset(hashmap, INDEXNUL, sizeof(uint32_t) * hashcapacity);
 			soa<KeyT, ItemTs...>& base = *this;
 			base.clear();
 			hashcursor = SIZE_MAX;
@@ -99,8 +111,17 @@ namespace hvh {
 		// rehash()
 		// Recalculates the hash for all keys in the table.
 		// Called automatically if the table is resized, and can be used to clear up deleted indices in the map.
+		// Big tables are rehashed on every core (see 'rehash_parallel').
 		// Complexity: O(n).
-		void rehash() {
+		void rehash() { rehash_parallel(); }
+
+		// rehash_serial()
+		// As 'rehash', but always runs on the calling thread.
+		// Complexity: O(n).
+		void rehash_serial() {
+			hashcursor = SIZE_MAX;
+			if (!hashmap) return;
+			auto trace = _soa_trace(soa_trace_kind::rehash, this, this->mycapacity, [this]() { return buffer_bytes(); });
 			memset(hashmap, INDEXNUL, sizeof(uint32_t) * hashcapacity);
 			for (size_t i = 0; i < this->mysize; ++i) {
 				// Get the hash for this key.
@@ -120,6 +141,34 @@ namespace hvh {
 			hashcursor = SIZE_MAX;
 		}
 
+		// rehash_parallel(num_threads)
+		// As 'rehash', but splits the work between up to 'num_threads' threads of default_thread_pool() (0 uses all of them).
+		// The hashmap is divided into one range of slots per thread, and each thread places the keys which hash into its own range.
+		// Keys whose probe would run off the end of their range are placed afterwards on the calling thread,
+		// in row order, so that entries sharing a key are still found in the order they were inserted.
+		// Each thread gets at least HVH_HTABLE_PARALLEL_MIN_ROWS_PER_THREAD rows, so small tables are rehashed on the calling thread,
+		// as they are if the pool's threads can't be started or there isn't memory for the temporary buffers.
+		// Complexity: O(n).
+		void rehash_parallel(size_t num_threads = 0) {
+			const size_t max_parts = this->mysize / HVH_HTABLE_PARALLEL_MIN_ROWS_PER_THREAD;
+			if (!hashmap || num_threads == 1 || max_parts < 2) {
+				rehash_serial();
+				return;
+			}
+			try {
+				thread_pool& pool = default_thread_pool();
+				if (num_threads == 0) num_threads = pool.size();
+				const size_t num_parts = std::min(num_threads, max_parts);
+				if (num_parts < 2) rehash_serial();
+				else rehash_parts(pool, num_parts);
+			}
+			catch (const std::exception&) {
+				// The pool couldn't start its threads, or a buffer couldn't be allocated.
+				// Nothing in the table has changed besides the hashmap, which this rebuilds from scratch.
+				rehash_serial();
+			}
+		}
+
 		// reserve(n)
 		// Ensures that the hash table is large enough to hold at least n entries.
 		// Called auomatically when trying to insert an entry into a full table.
@@ -136,28 +185,44 @@ namespace hvh {
 			// We can't shrink the actual memory.
 			if (newsize <= this->mycapacity) return true;
 
+			// Remember the old memory so we can free it.
+			void* oldmem = hashmap;
+			size_t oldbytes = buffer_bytes();
+			auto trace = _soa_trace(soa_trace_kind::reserve, this, this->mycapacity, [this]() { return buffer_bytes(); });
+
 			// Hash capacity needs to be odd and just greater than double the list capacity,
 			// but it also needs to conform to 16-byte alignment.
-			hashcapacity = newsize + newsize + 4;
-			size_t htable_size = hashcapacity * sizeof(uint32_t);
-			--hashcapacity;
+			size_t newhashcapacity = newsize + newsize + 4;
+			size_t htable_size = newhashcapacity * sizeof(uint32_t);
 
-			// Remember the old memory so we can free it.
-			void* oldmem = hashmap;
+			// If the allocator can grow the buffer in place, spread the columns out inside it.
+			_soa_base<KeyT, ItemTs...>& base = *this;
+			if (oldmem && this->can_reallocate()) {
+				void* realloc_result = this->reallocate_buffer(oldmem, oldbytes, (base.size_per_entry() * newsize) + htable_size);
+				if (!realloc_result) return false;
+				size_t oldcapacity = this->mycapacity;
+				size_t oldhtable_size = (hashcapacity + 1) * sizeof(uint32_t);
+				hashmap = (uint32_t*)realloc_result;
+				hashcapacity = newhashcapacity - 1;
+				this->mycapacity = newsize;
+				base.relayout((char*)realloc_result, oldhtable_size, htable_size, oldcapacity);
+				rehash();
+				return true;
+			}
 
 			// Allocate new memory.
-			_soa_base<KeyT, ItemTs...>& base = *this;
-			void* alloc_result = _soa_aligned_malloc(16, (base.size_per_entry() * newsize) + htable_size);
+			void* alloc_result = this->allocate_buffer((base.size_per_entry() * newsize) + htable_size);
 			if (!alloc_result) return false;
 
 			hashmap = (uint32_t*)alloc_result;
+			hashcapacity = newhashcapacity - 1;
 
 			// Copy the old data into the new memory.
 			this->mycapacity = newsize;
 			base.divy_buffer(((char*)alloc_result) + htable_size);
 
 			// Free the old memory.
-			if (oldmem) _soa_aligned_free(oldmem);
+			this->free_buffer(oldmem, oldbytes);
 			rehash();
 			return true;
 		}
@@ -178,19 +243,40 @@ namespace hvh {
 			// Remember the old memory so we can free it.
 			_soa_base<KeyT, ItemTs...>& base = *this;
 			void* oldmem = hashmap;
+			size_t oldbytes = buffer_bytes();
+			auto trace = _soa_trace(soa_trace_kind::shrink_to_fit, this, this->mycapacity, [this]() { return buffer_bytes(); });
 
 			if (newsize > 0) {
 				// Hash capacity needs to be odd and just greater than double the list capacity,
 				// but it also needs to conform to 16-byte memory alignment.
-				hashcapacity = newsize + newsize + 4;
-				size_t htable_size = hashcapacity * sizeof(uint32_t);
-				--hashcapacity;
+				size_t newhashcapacity = newsize + newsize + 4;
+				size_t htable_size = newhashcapacity * sizeof(uint32_t);
+
+				if (this->can_reallocate()) {
+					// Pack the columns together, then shrink the buffer around them.
+					size_t oldcapacity = this->mycapacity;
+					size_t oldhtable_size = (hashcapacity + 1) * sizeof(uint32_t);
+					this->mycapacity = newsize;
+					base.relayout((char*)oldmem, oldhtable_size, htable_size, oldcapacity);
+					void* realloc_result = this->reallocate_buffer(oldmem, oldbytes, (base.size_per_entry() * newsize) + htable_size);
+					if (!realloc_result) {
+						this->mycapacity = oldcapacity;
+						base.relayout((char*)oldmem, htable_size, oldhtable_size, newsize);
+						return false;
+					}
+					hashmap = (uint32_t*)realloc_result;
+					hashcapacity = newhashcapacity - 1;
+					base.relayout((char*)realloc_result, htable_size, htable_size, newsize);
+					rehash();
+					return true;
+				}
 
 				// Allocate new memory.
-				void* alloc_result = _soa_aligned_malloc(16, (base.size_per_entry() * newsize) + htable_size);
+				void* alloc_result = this->allocate_buffer((base.size_per_entry() * newsize) + htable_size);
 				if (!alloc_result) return false;
 
 				hashmap = (uint32_t*)alloc_result;
+				hashcapacity = newhashcapacity - 1;
 
 				// Copy the old data into the new memory.
 				this->mycapacity = newsize;
@@ -204,7 +290,7 @@ namespace hvh {
 			}
 
 			// Free the old memory.
-			if (oldmem) _soa_aligned_free(oldmem);
+			this->free_buffer(oldmem, oldbytes);
 			rehash();
 			return true;
 		}
@@ -279,7 +365,9 @@ namespace hvh {
 			soa<KeyT, ItemTs...>& base = *this;
 			size_t where = base.template lower_bound_row<K>(key, items...);
 			base.insert(where, key, items...);
-			rehash();
+			// One row moved, so a rehash this often isn't worth handing to other threads.
+			rehash_serial();
+			return true;
 		}
 
 		// find(key, restart)
@@ -312,14 +400,29 @@ namespace hvh {
 		// Returns the index of the found entry, or SIZE_MAX if the key could not be found.
 		// The returned index can be used with 'at' or 'data' to access the items inside the table.
 		// Complexity: O(1) amortized.
-		size_t find(const KeyT& key) const {
+		inline size_t find(const KeyT& key) const { return find_hashed(key, std::hash<KeyT>{}(key)); }
+
+		// find_hashed(key, hash) const
+		// As 'find', but takes the key's hash ('std::hash<KeyT>{}(key)'), for callers which have already computed it.
+		// Complexity: O(1) amortized.
+		inline size_t find_hashed(const KeyT& key, size_t hash) const {
+			size_t hashc;
+			return find_hashed(key, hash, hashc);
+		}
+
+		// find_hashed(key, hash, hashc) const
+		// As 'find_hashed', but leaves the external hash cursor 'hashc' at the entry it finds,
+		// so that 'find(key, false, hashc)' can carry on to the next entry with the same key.
+		// Complexity: O(1) amortized.
+		size_t find_hashed(const KeyT& key, size_t hash, size_t& hashc) const {
+			hashc = SIZE_MAX;
 			if (this->mysize == 0) return SIZE_MAX;
-			size_t hash = std::hash<KeyT>{}(key) % hashcapacity;
+			hashc = hash % hashcapacity;
 			while (1) {
-				uint32_t index = hashmap[hash];
+				uint32_t index = hashmap[hashc];
 				if (index == INDEXNUL) return SIZE_MAX;
 				if (index != INDEXDEL && this->template at<0>(index) == key) return (size_t)index;
-				hash_inc(hash);
+				hash_inc(hashc);
 			}
 		}
 
@@ -345,15 +448,58 @@ namespace hvh {
 			}
 		}
 
+		// prefetch(key)
+		// Starts loading the hashmap slot where a search for 'key' would begin, without waiting for it.
+		// Calling this for a batch of keys before finding each of them lets their cache misses overlap.
+		// Complexity: O(1).
+		inline void prefetch(const KeyT& key) const { prefetch_hashed(std::hash<KeyT>{}(key)); }
+
+		// prefetch_hashed(hash)
+		// As 'prefetch', but takes the key's hash ('std::hash<KeyT>{}(key)'), for callers which have already computed it.
+		// Complexity: O(1).
+		inline void prefetch_hashed(size_t hash) const {
+		#if defined(__GNUC__) || defined(__clang__)
+			if (this->mysize == 0) return;
+			__builtin_prefetch(&hashmap[hash % hashcapacity]);
+		#else
+			(void)hash;
+		#endif
+		}
+
+		// prefetch_entry(key)
+		// Reads the hashmap slot where a search for 'key' would begin, and starts loading the key of the entry it refers to.
+		// Best used after 'prefetch' has had time to bring the slot in, so that this doesn't have to wait for it.
+		// Complexity: O(1).
+		inline void prefetch_entry(const KeyT& key) const { prefetch_entry_hashed(std::hash<KeyT>{}(key)); }
+
+		// prefetch_entry_hashed(hash)
+		// As 'prefetch_entry', but takes the key's hash, for callers which have already computed it.
+		// Complexity: O(1).
+		inline void prefetch_entry_hashed(size_t hash) const {
+		#if defined(__GNUC__) || defined(__clang__)
+			if (this->mysize == 0) return;
+			uint32_t index = hashmap[hash % hashcapacity];
+			if (index < this->mysize) __builtin_prefetch(&this->template data<0>()[index]);
+		#else
+			(void)hash;
+		#endif
+		}
+
 		// count(key)
 		// Returns the number of entries in the table which have the indicated key.
 		// If no entries in the table have the indicated key, 0 is returned.
 		// Complexity: O(1) amortized.
-		inline size_t count(const KeyT& key) const {
+		inline size_t count(const KeyT& key) const { return count_hashed(key, std::hash<KeyT>{}(key)); }
+
+		// count_hashed(key, hash)
+		// As 'count', but takes the key's hash ('std::hash<KeyT>{}(key)'), for callers which have already computed it.
+		// Complexity: O(1) amortized.
+		size_t count_hashed(const KeyT& key, size_t hash) const {
+			if (this->mysize == 0) return 0;
 			size_t result = 0;
-			size_t hashc = SIZE_MAX;
-			for (size_t index = find(key, true, hashc); index != SIZE_MAX; index = find(key, false, hashc)) {
-				++result;
+			for (hash %= hashcapacity; hashmap[hash] != INDEXNUL; hash_inc(hash)) {
+				uint32_t index = hashmap[hash];
+				if (index != INDEXDEL && this->template at<0>(index) == key) ++result;
 			}
 			return result;
 		}
@@ -367,7 +513,7 @@ namespace hvh {
 			base.swap_entries(first, second);
 
 			// Find the hash position for the first entry.
-			size_t hash = std::hash<KeyT>{}(this->at<0>(first)) % hashcapacity;
+			size_t hash = std::hash<KeyT>{}(this->template at<0>(first)) % hashcapacity;
 			size_t first_hashpos = SIZE_MAX;
 			while (1) {
 				uint32_t index = hashmap[hash];
@@ -383,7 +529,7 @@ namespace hvh {
 			}
 
 			// Find the hash position for the second entry.
-			hash = std::hash<KeyT>{}(this->at<0>(second)) % hashcapacity;
+			hash = std::hash<KeyT>{}(this->template at<0>(second)) % hashcapacity;
 			size_t second_hashpos = SIZE_MAX;
 			while (1) {
 				uint32_t index = hashmap[hash];
@@ -416,6 +562,9 @@ namespace hvh {
 			base.erase_swap(index);
 			hashmap[hashcursor] = INDEXDEL;
 
+			// If we erased the last entry, nothing was moved, so there's nothing to repair.
+			if (index == this->mysize) return 1;
+
 			// Get the hash of the key that we just moved into the deleted item's place.
 			size_t hash = std::hash<KeyT>{}(this->template at<0>(index)) % hashcapacity;
 			// Scan through looking for the reference so we can repair it.
@@ -435,6 +584,28 @@ namespace hvh {
 			return 1;
 		}
 
+		// erase_at(index)
+		// Erases the entry at the given index, as returned by 'find'.
+		// Like 'erase_found', the last entry in the table is moved into the erased entry's place.
+		// Returns the number of items erased (0 or 1).
+		// Complexity: O(1) amortized.
+		size_t erase_at(size_t index) {
+			if (index >= this->mysize) return 0;
+			// Find the hashmap slot which refers to this index.
+			hashcursor = std::hash<KeyT>{}(this->template at<0>(index)) % hashcapacity;
+			while (1) {
+				uint32_t slot = hashmap[hashcursor];
+				if (slot == (uint32_t)index) break;
+				if (slot == INDEXNUL) {
+					// ERROR! The hashmap doesn't know about this entry!
+					hashcursor = SIZE_MAX;
+					return 0;
+				}
+				hash_inc(hashcursor);
+			}
+			return erase_found();
+		}
+
 		// erase(key)
 		// Finds the entry with the indicated key and erases it.
 		// If no entries have the indicated key, the table is unchanged.
@@ -469,7 +640,7 @@ namespace hvh {
 			soa<KeyT, ItemTs...>& base = *this;
 			base.erase_shift(index);
 			hashmap[hashcursor] = INDEXDEL;
-			rehash();
+			rehash_serial();
 			return 1;
 		}
 		// erase_sorted(key)
@@ -493,12 +664,14 @@ namespace hvh {
 		// see_map()
 		// Used for debugging to see if there are any big clumps in the hash map.
 		const uint32_t* see_map(size_t& cap) { cap = hashcapacity; return hashmap; }
+		const uint32_t* see_map(size_t& cap) const { cap = hashcapacity; return hashmap; }
 
 		// serialize()
 		// Shrinks the container to the smallest capacity that can contain its entries,
 		// then returns a pointer to the raw data buffer that stores the container's data.
 		// num_bytes is filled with the number of bytes in that buffer.
 		// This function should be used in tandem with 'deserialize' to save and load a container to disk.
+		// To save without shrinking the container, use 'write_stream' from soa_stream.hpp instead.
 		void* serialize(size_t& num_bytes) {
 			shrink_to_fit();
 			num_bytes = (this->size_per_entry() * this->mycapacity) + (sizeof(uint32_t) * hashcapacity);
@@ -530,10 +703,161 @@ namespace hvh {
 			return result;
 		}
 
+		// copy_from(other, executor)
+		// Replaces the contents of the table with a copy of 'other', like copy-assignment,
+		// but splits the rows and the hashmap into chunks which are copied by 'executor' (such as a thread_pool from soa_parallel.hpp).
+		// Returns false if a memory allocation error occurs, in which case the table is left empty.
+		// Complexity: O(n / threads).
+		template <typename Executor>
+		bool copy_from(const htable<KeyT, ItemTs...>& other, Executor& executor) {
+			if (&other == this) return true;
+			clear();
+			if (!reserve(other.capacity())) return false;
+			_soa_base<KeyT, ItemTs...>& base = *this;
+			const _soa_base<KeyT, ItemTs...>& otherbase = other;
+			const size_t num_rows = other.size();
+			const size_t rows_per_chunk = std::max<size_t>(1, SOA_COPY_CHUNK_BYTES / base.size_per_entry());
+			const size_t row_chunks = (num_rows + rows_per_chunk - 1) / rows_per_chunk;
+			// If we already had more room than 'other', our hashmap is a different size and gets rebuilt instead.
+			const bool same_map = (hashcapacity == other.hashcapacity);
+			const size_t slots_per_chunk = SOA_COPY_CHUNK_BYTES / sizeof(uint32_t);
+			const size_t map_chunks = same_map ? (hashcapacity + slots_per_chunk - 1) / slots_per_chunk : 0;
+			executor.run(row_chunks + map_chunks, [&](size_t chunk) {
+				if (chunk < row_chunks) {
+					size_t begin = chunk * rows_per_chunk;
+					base.copy_range(otherbase, begin, std::min(num_rows, begin + rows_per_chunk));
+				}
+				else {
+					size_t begin = (chunk - row_chunks) * slots_per_chunk;
+					memcpy(hashmap + begin, other.hashmap + begin, sizeof(uint32_t) * std::min(slots_per_chunk, hashcapacity - begin));
+				}
+			});
+			this->mysize = num_rows;
+			if (!same_map) rehash();
+			return true;
+		}
+
+		// clone()
+		// Returns a copy of the hash table which uses the same allocator.
+		// If the allocator supports it, the copy shares memory with the original copy-on-write,
+		// so cloning costs next to nothing no matter how big the table is;
+		// otherwise, the entries and hashmap are copied as usual.
+		// Only tables of trivially copyable types can be cloned.
+		// With cow_allocator, cloning while an older clone is still alive copies the whole buffer once.
+		// Complexity: O(1) if the allocator can share memory, O(n) otherwise.
+		htable<KeyT, ItemTs...> clone() const {
+			static_assert(std::is_trivially_copyable<KeyT>::value && (std::is_trivially_copyable<ItemTs>::value && ...),
+				"Only tables of trivially copyable types can be cloned.");
+			htable<KeyT, ItemTs...> result;
+			result.myallocator = this->myallocator;
+			if (this->mycapacity == 0) return result;
+			const _soa_base<KeyT, ItemTs...>& base = *this;
+			_soa_base<KeyT, ItemTs...>& resultbase = result;
+			void* mem = this->clone_buffer(hashmap, buffer_bytes());
+			if (mem) {
+				result.hashmap = (uint32_t*)mem;
+				result.hashcapacity = hashcapacity;
+				result.mycapacity = this->mycapacity;
+				result.mysize = this->mysize;
+				resultbase.divy_buffer(((char*)mem) + (sizeof(uint32_t) * (hashcapacity + 1)));
+			}
+			else if (result.reserve(this->mycapacity)) {
+				memcpy(result.hashmap, hashmap, sizeof(uint32_t) * hashcapacity);
+				resultbase.copy(base);
+			}
+			return result;
+		}
+
 	protected:
 
 		inline void hash_inc(size_t& h) const { h = ((h + 2) % hashcapacity); }
 
+		// The body of 'rehash_parallel', which splits the rows and the hashmap into 'num_parts' parts.
+		// Throws if a buffer can't be allocated, but the tasks themselves never allocate.
+		void rehash_parts(thread_pool& pool, size_t num_parts) {
+			hashcursor = SIZE_MAX;
+			auto trace = _soa_trace(soa_trace_kind::rehash, this, this->mycapacity, [this]() { return buffer_bytes(); });
+			const KeyT* keys = this->template data<0>();
+			const size_t num_rows = this->mysize;
+			const size_t num_slots = hashcapacity;
+			auto slot_begin = [&](size_t part) { return (num_slots * part) / num_parts; };
+			auto part_of = [&](size_t slot) { return (((slot + 1) * num_parts) - 1) / num_slots; };
+			auto row_begin = [&](size_t chunk) { return (num_rows * chunk) / num_parts; };
+
+			// Everything is allocated up front, before the hashmap is touched.
+			// Homes are slots, which can be past UINT32_MAX even though rows can't.
+			std::vector<size_t> homes(num_rows);
+			std::vector<size_t> starts(num_parts * num_parts, 0);
+			std::vector<size_t> part_starts(num_parts + 1);
+			std::vector<size_t> part_overflow(num_parts, 0);
+			std::vector<uint32_t> order(num_rows);
+
+			// Hash every key, clear the hashmap, and count how many rows in each chunk belong to each range of slots.
+			pool.run(num_parts, [&](size_t chunk) {
+				memset(hashmap + slot_begin(chunk), INDEXNUL, sizeof(uint32_t) * (slot_begin(chunk + 1) - slot_begin(chunk)));
+				size_t* counts = &starts[chunk * num_parts];
+				for (size_t i = row_begin(chunk); i < row_begin(chunk + 1); ++i) {
+					homes[i] = std::hash<KeyT>{}(keys[i]) % num_slots;
+					++counts[part_of(homes[i])];
+				}
+			});
+
+			// Turn the counts into where each chunk's rows go, grouped by range and kept in row order.
+			size_t total = 0;
+			for (size_t part = 0; part < num_parts; ++part) {
+				part_starts[part] = total;
+				for (size_t chunk = 0; chunk < num_parts; ++chunk) {
+					size_t count = starts[(chunk * num_parts) + part];
+					starts[(chunk * num_parts) + part] = total;
+					total += count;
+				}
+			}
+			part_starts[num_parts] = total;
+			pool.run(num_parts, [&](size_t chunk) {
+				size_t* cursors = &starts[chunk * num_parts];
+				for (size_t i = row_begin(chunk); i < row_begin(chunk + 1); ++i)
+					order[cursors[part_of(homes[i])]++] = (uint32_t)i;
+			});
+
+			// Each thread places the rows in its own range.  Rows which don't fit are moved to the front
+			// of the part's own stretch of 'order', which it's already finished with.
+			pool.run(num_parts, [&](size_t part) {
+				const size_t end = slot_begin(part + 1);
+				size_t overflow = part_starts[part];
+				for (size_t k = part_starts[part]; k < part_starts[part + 1]; ++k) {
+					uint32_t i = order[k];
+					size_t hash = homes[i];
+					while (hashmap[hash] != INDEXNUL) {
+						hash += 2;
+						if (hash >= end) break;
+					}
+					if (hash < end) hashmap[hash] = i;
+					else order[overflow++] = i;
+				}
+				part_overflow[part] = overflow - part_starts[part];
+			});
+
+			// Whatever didn't fit is placed normally.
+			size_t num_leftovers = 0;
+			for (size_t part = 0; part < num_parts; ++part) num_leftovers += part_overflow[part];
+			std::vector<uint32_t> leftovers;
+			leftovers.reserve(num_leftovers);
+			for (size_t part = 0; part < num_parts; ++part)
+				leftovers.insert(leftovers.end(), order.begin() + part_starts[part], order.begin() + part_starts[part] + part_overflow[part]);
+			std::sort(leftovers.begin(), leftovers.end());
+			for (uint32_t i : leftovers) {
+				size_t hash = homes[i];
+				while (hashmap[hash] != INDEXNUL) hash_inc(hash);
+				hashmap[hash] = i;
+			}
+		}
+
+		// The total size of the buffer holding the hashmap and entries.
+		inline size_t buffer_bytes() const {
+			if (!hashmap) return 0;
+			return (this->size_per_entry() * this->mycapacity) + (sizeof(uint32_t) * (hashcapacity + 1));
+		}
+
 		static const uint32_t INDEXNUL = UINT_MAX;
 		static const uint32_t INDEXDEL = UINT_MAX - 1;
 
@@ -0,0 +1,542 @@
+/* htable_journal.hpp
+ * Write-ahead log of htable mutations
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Wraps an htable so that every insert, emplace, and erase is appended to a
+ * log file in a compact binary form.  After a crash, the table is recovered
+ * by loading the last snapshot and replaying the log on top of it.
+ * Records are batched in memory and written with a single write per commit
+ * (group commit), and the log is fsync'd according to a configurable policy.
+ * A checkpoint writes a fresh snapshot and empties the log.
+ */
+#ifndef HVH_TOOLS_HTABLEJOURNAL_H
+#define HVH_TOOLS_HTABLEJOURNAL_H
+
+#include "soa_stream.hpp"
+
+#include <string>
+#include <cstdio> // For std::rename
+
+#ifdef _MSC_VER
+  #include <io.h>
+  #include <fcntl.h>
+  #include <sys/stat.h>
+  #define _journal_open(path,flags) _open(path,(flags)|_O_BINARY,_S_IREAD|_S_IWRITE)
+  #define _journal_close(fd) _close(fd)
+  #define _journal_fsync(fd) _commit(fd)
+  #define _journal_truncate(fd,size) _chsize_s(fd,size)
+  #define _journal_seek_end(fd) _lseeki64(fd,0,SEEK_END)
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/stat.h>
+  #define _journal_open(path,flags) ::open(path,flags,0644)
+  #define _journal_close(fd) ::close(fd)
+  #define _journal_fsync(fd) ::fsync(fd)
+  #define _journal_truncate(fd,size) ::ftruncate(fd,size)
+  #define _journal_seek_end(fd) ::lseek(fd,0,SEEK_END)
+#endif
+
+namespace hvh {
+
+	// journal_options
+	// Controls how often an htable_journal touches the disk.
+	struct journal_options {
+		// Pending records are written to the log once they add up to this many bytes,
+		// even if 'commit' hasn't been called yet.  They are only durable after 'commit', though.
+		size_t group_commit_bytes = 1 << 20;
+		// The log is fsync'd on every 'sync_every'th commit.
+		// 1 makes every commit durable; 0 never calls fsync, leaving it up to the OS.
+		size_t sync_every = 1;
+	};
+
+	namespace _journal_detail {
+
+		static constexpr char SNAPSHOT_MAGIC[8] = { 'H', 'V', 'H', 'S', 'N', 'A', 'P', '\0' };
+		static constexpr char LOG_MAGIC[8] = { 'H', 'V', 'H', 'L', 'O', 'G', '\0', '\0' };
+
+		// Both the snapshot and the log start with this.
+		// A log only applies to the snapshot with the same generation.
+		struct file_header {
+			char magic[8];
+			uint64_t generation;
+		};
+
+		// Every record in the log is a record_header followed by 'num_bytes' bytes of payload.
+		// The first byte of the payload is the record type.
+		struct record_header {
+			uint32_t num_bytes;
+			uint32_t checksum;
+		};
+
+		enum record_type : uint8_t {
+			RECORD_INSERT = 1,	// A whole row, appended to the back of the table.
+			RECORD_ERASE = 2,	// The index of an erased row.
+			RECORD_CLEAR = 3,
+		};
+
+		// 32-bit FNV-1a, which is plenty for spotting a torn write at the end of the log.
+		inline uint32_t checksum(const char* data, size_t num_bytes) {
+			uint32_t hash = 2166136261u;
+			for (size_t i = 0; i < num_bytes; ++i) {
+				hash ^= (uint8_t)data[i];
+				hash *= 16777619u;
+			}
+			return hash;
+		}
+
+		inline void append(std::vector<char>& out, const void* data, size_t num_bytes) {
+			out.insert(out.end(), (const char*)data, (const char*)data + num_bytes);
+		}
+
+		// Values are encoded the same way as in soa_stream:
+		// fixed columns as raw bytes, variable columns as a uint64_t byte count followed by the bytes.
+		template <typename T>
+		void encode_value(std::vector<char>& out, const T& value) {
+			using traits = stream_column<T>;
+			if constexpr (!traits::variable) append(out, &value, sizeof(T));
+			else {
+				uint64_t num_bytes = traits::length(value) * traits::unit_size;
+				append(out, &num_bytes, sizeof(num_bytes));
+				append(out, traits::bytes(value), (size_t)num_bytes);
+			}
+		}
+
+		template <typename T>
+		bool decode_value(const char*& in, const char* end, T& value) {
+			using traits = stream_column<T>;
+			if constexpr (!traits::variable) {
+				if ((size_t)(end - in) < sizeof(T)) return false;
+				memcpy(&value, in, sizeof(T));
+				in += sizeof(T);
+			}
+			else {
+				uint64_t num_bytes;
+				if ((size_t)(end - in) < sizeof(num_bytes)) return false;
+				memcpy(&num_bytes, in, sizeof(num_bytes));
+				in += sizeof(num_bytes);
+				if ((uint64_t)(end - in) < num_bytes || num_bytes % traits::unit_size != 0) return false;
+				traits::resize(value, (size_t)(num_bytes / traits::unit_size));
+				if (num_bytes > 0) memcpy(traits::bytes(value), in, (size_t)num_bytes);
+				in += num_bytes;
+			}
+			return true;
+		}
+
+		inline bool write_all(int fd, const void* data, size_t num_bytes) {
+			fd_sink sink(fd);
+			return sink.write(data, num_bytes);
+		}
+
+		// Makes a rename durable by syncing the directory which holds 'path'.
+		// This is best-effort; some platforms and filesystems don't support it.
+		inline void sync_parent_directory(const std::string& path) {
+#ifndef _MSC_VER
+			size_t slash = path.find_last_of('/');
+			std::string dir = (slash == std::string::npos) ? std::string(".") : path.substr(0, slash + 1);
+			int fd = ::open(dir.c_str(), O_RDONLY);
+			if (fd < 0) return;
+			::fsync(fd);
+			::close(fd);
+#else
+			(void)path;
+#endif
+		}
+
+		// Atomically replaces 'path' with 'temp_path'.
+		inline bool replace_file(const std::string& temp_path, const std::string& path) {
+#ifdef _MSC_VER
+			std::remove(path.c_str());
+#endif
+			if (std::rename(temp_path.c_str(), path.c_str()) != 0) return false;
+			sync_parent_directory(path);
+			return true;
+		}
+
+		// Writes a file consisting of a file_header followed by whatever 'body(fd)' writes,
+		// syncs it, and then moves it into place over 'path'.
+		template <typename Body>
+		bool write_file_atomically(const std::string& path, const char* magic, uint64_t generation, Body body) {
+			std::string temp_path = path + ".tmp";
+			int fd = _journal_open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+			if (fd < 0) return false;
+			file_header header = {};
+			memcpy(header.magic, magic, sizeof(header.magic));
+			header.generation = generation;
+			bool result = write_all(fd, &header, sizeof(header)) && body(fd) && (_journal_fsync(fd) == 0);
+			_journal_close(fd);
+			if (!result) {
+				std::remove(temp_path.c_str());
+				return false;
+			}
+			return replace_file(temp_path, path);
+		}
+
+	} // namespace _journal_detail
+
+	template <typename KeyT, typename... ItemTs>
+	class htable_journal {
+	public:
+		using table_type = htable<KeyT, ItemTs...>;
+
+		// htable_journal(table, options)
+		// Creates a journal for 'table'.
+		// Nothing is logged until 'open' is called.
+		htable_journal(table_type& table, const journal_options& options = journal_options())
+			: mytable(table), myoptions(options) {}
+		// ~htable_journal()
+		// Commits any pending records and closes the log.
+		~htable_journal() { close(); }
+
+		htable_journal(const htable_journal&) = delete;
+		htable_journal& operator = (const htable_journal&) = delete;
+
+		// open(snapshot_path, log_path)
+		// Recovers the table from disk, then starts logging to 'log_path'.
+		// The table's contents are replaced with the snapshot at 'snapshot_path' (or emptied if there isn't one),
+		// and then every complete record in the log is replayed on top of it.
+		// A partially-written record at the end of the log (from a crash mid-write) is discarded.
+		// Returns false if the snapshot or log can't be read, a complete record in the log can't be applied
+		// (in which case the log is left as it was), or the log can't be opened for writing.
+		// Complexity: O(n) in the size of the snapshot and the log.
+		bool open(const std::string& snapshot_path, const std::string& log_path) {
+			using namespace _journal_detail;
+			close();
+			// Anything done to the table before now is replaced by what's on disk, so it mustn't be logged.
+			mypending.clear();
+			mysnapshotpath = snapshot_path;
+			mylogpath = log_path;
+			myreplayed = 0;
+			mygood = false;
+
+			// Load the snapshot, if there is one.
+			uint64_t generation = 0;
+			int fd = _journal_open(snapshot_path.c_str(), O_RDONLY);
+			if (fd >= 0) {
+				file_header header;
+				fd_source source(fd);
+				bool loaded = source.read(&header, sizeof(header)) &&
+					memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+					read_stream(source, mytable);
+				_journal_close(fd);
+				if (!loaded) return false;
+				generation = header.generation;
+			}
+			else mytable.clear();
+			mygeneration = generation;
+
+			// Replay the log if it belongs to this snapshot.
+			fd = _journal_open(log_path.c_str(), O_RDWR);
+			if (fd >= 0) {
+				file_header header;
+				fd_source source(fd);
+				if (!source.read(&header, sizeof(header)) || memcmp(header.magic, LOG_MAGIC, sizeof(header.magic)) != 0) {
+					_journal_close(fd);
+					return false;
+				}
+				if (header.generation > generation) {
+					// The log is newer than the snapshot, so some of the history is missing.
+					_journal_close(fd);
+					return false;
+				}
+				if (header.generation == generation) {
+					int64_t end = (int64_t)_journal_seek_end(fd);
+					int64_t valid_end = replay(fd, end);
+					if (valid_end < 0 || _journal_truncate(fd, valid_end) != 0) {
+						_journal_close(fd);
+						return false;
+					}
+					_journal_close(fd);
+				}
+				else {
+					// The log predates the snapshot; a checkpoint was interrupted before it could empty the log.
+					_journal_close(fd);
+					if (!reset_log()) return false;
+				}
+			}
+			else if (!reset_log()) return false;
+
+			mylogfd = _journal_open(log_path.c_str(), O_WRONLY | O_APPEND);
+			if (mylogfd < 0) return false;
+			mygood = true;
+			return true;
+		}
+
+		// close()
+		// Commits any pending records and stops logging.
+		// Mutations made while the journal is closed aren't logged.
+		// Returns false if the final commit fails.
+		bool close() {
+			if (mylogfd < 0) return true;
+			bool result = commit();
+			_journal_close(mylogfd);
+			mylogfd = -1;
+			mypending.clear();
+			return result;
+		}
+
+		// insert(key, items...)
+		// Inserts a new entry into the table and logs it.
+		// Returns false if the table fails to insert the entry, true otherwise.
+		// Complexity: O(1) amortized.
+		template <typename... Ts>
+		bool insert(const KeyT& key, Ts&&... items) {
+			if (!mytable.insert(key, std::forward<Ts>(items)...)) return false;
+			log_back_row();
+			return true;
+		}
+
+		// emplace(key, args...)
+		// Constructs a new entry in the table and logs it.
+		// The row is logged as it exists after construction, so replay doesn't depend on the constructor arguments.
+		// Returns false if the table fails to emplace the entry, true otherwise.
+		// Complexity: O(1) amortized.
+		template <typename... CTypes>
+		bool emplace(const KeyT& key, CTypes&&... cargs) {
+			if (!mytable.emplace(key, std::forward<CTypes>(cargs)...)) return false;
+			log_back_row();
+			return true;
+		}
+
+		// erase_at(index)
+		// Erases the entry at the given index and logs it.
+		// Returns the number of items erased (0 or 1).
+		// Complexity: O(1) amortized.
+		size_t erase_at(size_t index) {
+			if (mytable.erase_at(index) == 0) return 0;
+			log_erase(index);
+			return 1;
+		}
+
+		// erase(key)
+		// Finds the entry with the indicated key, erases it, and logs it.
+		// Returns the number of items erased (0 or 1).
+		// Complexity: O(1) amortized.
+		inline size_t erase(const KeyT& key) {
+			size_t index = mytable.find(key, true);
+			if (index == SIZE_MAX) return 0;
+			return erase_at(index);
+		}
+
+		// erase_all(key)
+		// Erases every entry with the indicated key, and logs each one.
+		// Returns the number of items erased.
+		// Complexity: O(1) amortized per entry erased.
+		inline size_t erase_all(const KeyT& key) {
+			size_t result = 0;
+			// As htable's own erase_all, the search carries on from each erased entry rather than starting over.
+			for (size_t index = mytable.find(key, true); index != SIZE_MAX; index = mytable.find(key, false)) {
+				if (mytable.erase_found() == 0) break;
+				log_erase(index);
+				++result;
+			}
+			return result;
+		}
+
+		// clear()
+		// Erases every entry in the table and logs it.
+		// Complexity: O(n).
+		inline void clear() {
+			mytable.clear();
+			if (!logging()) return;
+			begin_record(_journal_detail::RECORD_CLEAR);
+			end_record();
+		}
+
+		// commit()
+		// Writes every pending record to the log with a single write,
+		// then fsyncs it if the sync policy calls for it.
+		// Once commit returns true, every mutation made so far will survive a crash
+		// (as long as 'sync_every' is 1).
+		// Returns false if the log can't be written.
+		bool commit() {
+			if (!write_pending()) return false;
+			if (myoptions.sync_every == 0) return true;
+			if (++mycommits >= myoptions.sync_every) {
+				mycommits = 0;
+				if (_journal_fsync(mylogfd) != 0) { mygood = false; return false; }
+			}
+			return true;
+		}
+
+		// checkpoint()
+		// Writes the whole table to a new snapshot and empties the log.
+		// Recovery from a checkpoint is much faster than replaying a long log.
+		// The table itself is left untouched.
+		// Each file is written to a temporary name and then renamed into place,
+		// so a crash at any point leaves a snapshot and log which recover correctly.
+		// Returns false if anything can't be written.
+		// Complexity: O(n).
+		bool checkpoint() {
+			using namespace _journal_detail;
+			if (mylogfd < 0) return false;
+			if (!write_pending()) return false;
+			uint64_t generation = mygeneration + 1;
+			bool written = write_file_atomically(mysnapshotpath, SNAPSHOT_MAGIC, generation,
+				[&](int fd) { return write_stream(fd, mytable); });
+			if (!written) return false;
+			// The new snapshot is in place, so the old log no longer applies.
+			mygeneration = generation;
+			_journal_close(mylogfd);
+			mylogfd = -1;
+			mycommits = 0;
+			if (!reset_log()) { mygood = false; return false; }
+			mylogfd = _journal_open(mylogpath.c_str(), O_WRONLY | O_APPEND);
+			mygood = (mylogfd >= 0);
+			return mygood;
+		}
+
+		// good()
+		// Returns false if the journal isn't open, or if writing to the log has failed.
+		// Once the log has failed, mutations are still applied to the table but are no longer logged, so they won't survive a crash.
+		inline bool good() const { return mygood; }
+
+		// replayed()
+		// Returns the number of log records which were replayed by the last call to 'open'.
+		inline size_t replayed() const { return myreplayed; }
+
+		// table()
+		// Gives read access to the journaled table.
+		// All mutations must go through the journal, or replay will not reproduce them.
+		inline const table_type& table() const { return mytable; }
+
+	protected:
+
+		// Records are only kept while the log is open and hasn't failed.
+		// Otherwise they'd pile up in memory, and could be written to a log they don't belong to.
+		inline bool logging() const { return mylogfd >= 0 && mygood; }
+
+		// Logs the row at the back of the table, which was just inserted.
+		void log_back_row() {
+			if (!logging()) return;
+			begin_record(_journal_detail::RECORD_INSERT);
+			encode_row(mytable.size() - 1, std::index_sequence_for<KeyT, ItemTs...>{});
+			end_record();
+		}
+
+		// Logs the erasure of the row at 'index'.
+		void log_erase(size_t index) {
+			if (!logging()) return;
+			uint64_t stored = index;
+			begin_record(_journal_detail::RECORD_ERASE);
+			_journal_detail::append(mypending, &stored, sizeof(stored));
+			end_record();
+		}
+
+		template <size_t... Ks>
+		void encode_row(size_t index, std::index_sequence<Ks...>) {
+			const table_type& table = mytable;
+			(_journal_detail::encode_value(mypending, table.template at<Ks>(index)), ...);
+		}
+
+		void begin_record(uint8_t type) {
+			myrecordstart = mypending.size();
+			mypending.resize(mypending.size() + sizeof(_journal_detail::record_header));
+			mypending.push_back((char)type);
+		}
+
+		void end_record() {
+			_journal_detail::record_header header;
+			size_t payload = myrecordstart + sizeof(header);
+			header.num_bytes = (uint32_t)(mypending.size() - payload);
+			header.checksum = _journal_detail::checksum(mypending.data() + payload, header.num_bytes);
+			memcpy(mypending.data() + myrecordstart, &header, sizeof(header));
+			if (mypending.size() >= myoptions.group_commit_bytes) write_pending();
+		}
+
+		bool write_pending() {
+			if (mylogfd < 0 || !mygood) return false;
+			if (mypending.empty()) return true;
+			if (!_journal_detail::write_all(mylogfd, mypending.data(), mypending.size())) {
+				// Nothing more will be logged, so the records which couldn't be written are dropped.
+				mygood = false;
+				mypending.clear();
+				return false;
+			}
+			mypending.clear();
+			return true;
+		}
+
+		// Replaces the log with an empty one for the current generation.
+		bool reset_log() {
+			return _journal_detail::write_file_atomically(mylogpath, _journal_detail::LOG_MAGIC, mygeneration,
+				[](int) { return true; });
+		}
+
+		// Replays every intact record in the log.
+		// Returns the offset just past the last intact record,
+		// or -1 if the log can't be read or an intact record can't be applied to the table.
+		int64_t replay(int fd, int64_t end) {
+			using namespace _journal_detail;
+			int64_t position = (int64_t)sizeof(file_header);
+#ifdef _MSC_VER
+			_lseeki64(fd, position, SEEK_SET);
+#else
+			::lseek(fd, position, SEEK_SET);
+#endif
+			fd_source source(fd);
+			stream_reader<fd_source> reader(source);
+			reader.expect((uint64_t)(end - position));
+			std::vector<char> payload;
+			while (end - position >= (int64_t)sizeof(record_header)) {
+				record_header header;
+				if (!reader.get_value(header)) return -1;
+				if (header.num_bytes == 0 || (int64_t)header.num_bytes > end - position - (int64_t)sizeof(record_header)) break;
+				payload.resize(header.num_bytes);
+				if (!reader.get(payload.data(), header.num_bytes)) return -1;
+				if (checksum(payload.data(), header.num_bytes) != header.checksum) break;
+				// The record is intact, so if it can't be applied, the log isn't torn; something else is wrong.
+				// Truncating here would throw away this record and every committed record after it.
+				if (!apply(payload.data(), payload.data() + header.num_bytes)) return -1;
+				position += sizeof(record_header) + header.num_bytes;
+				++myreplayed;
+			}
+			return position;
+		}
+
+		// Applies a single record to the table.
+		bool apply(const char* in, const char* end) {
+			using namespace _journal_detail;
+			uint8_t type = (uint8_t)*in++;
+			switch (type) {
+			case RECORD_INSERT: {
+				std::tuple<KeyT, ItemTs...> row;
+				if (!decode_row(in, end, row, std::index_sequence_for<KeyT, ItemTs...>{}) || in != end) return false;
+				return std::apply([&](KeyT& key, ItemTs&... items) { return mytable.insert(key, std::move(items)...); }, row);
+			}
+			case RECORD_ERASE: {
+				uint64_t index;
+				if ((size_t)(end - in) != sizeof(index)) return false;
+				memcpy(&index, in, sizeof(index));
+				return mytable.erase_at((size_t)index) == 1;
+			}
+			case RECORD_CLEAR:
+				mytable.clear();
+				return in == end;
+			default:
+				return false;
+			}
+		}
+
+		template <size_t... Ks>
+		bool decode_row(const char*& in, const char* end, std::tuple<KeyT, ItemTs...>& row, std::index_sequence<Ks...>) {
+			return (_journal_detail::decode_value(in, end, std::get<Ks>(row)) && ...);
+		}
+
+		table_type& mytable;
+		journal_options myoptions;
+		std::string mysnapshotpath;
+		std::string mylogpath;
+		std::vector<char> mypending;
+		size_t myrecordstart = 0;
+		size_t mycommits = 0;
+		size_t myreplayed = 0;
+		uint64_t mygeneration = 0;
+		int mylogfd = -1;
+		bool mygood = false;
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_HTABLEJOURNAL_H
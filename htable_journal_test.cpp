@@ -0,0 +1,164 @@
+#include "htable_journal.hpp"
+#include <string>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+static const char* journal_test_snapshot = "htable_journal_test.snap";
+static const char* journal_test_log = "htable_journal_test.log";
+
+static bool same_rows(const hvh::htable<string, int>& a, const hvh::htable<string, int>& b) {
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i) {
+		if (a.at<0>(i) != b.at<0>(i) || a.at<1>(i) != b.at<1>(i)) return false;
+	}
+	return true;
+}
+
+bool htable_journal_test() {
+	printf("Testing htable_journal...\n");
+	bool success = true;
+	remove(journal_test_snapshot);
+	remove(journal_test_log);
+
+	hvh::htable<string, int> table;
+	{
+		hvh::htable_journal<string, int> journal(table);
+		if (!journal.open(journal_test_snapshot, journal_test_log)) {
+			printf("Failed to open a fresh journal.\n");
+			return false;
+		}
+		for (int i = 0; i < 1000; ++i) journal.insert("key" + to_string(i % 300), i);
+		journal.emplace("emplaced", 12345);
+		for (int i = 0; i < 1000; i += 7) journal.erase_at(i % table.size());
+		journal.erase("key5");
+		journal.erase_all("key6");
+		if (!journal.commit()) {
+			printf("Failed to commit the journal.\n");
+			success = false;
+		}
+	}
+
+	// Simulate a crash by recovering into a different table.
+	hvh::htable<string, int> recovered;
+	{
+		hvh::htable_journal<string, int> journal(recovered);
+		if (!journal.open(journal_test_snapshot, journal_test_log)) {
+			printf("Failed to recover from the log.\n");
+			success = false;
+		}
+		if (!same_rows(table, recovered)) {
+			printf("Table recovered from the log does not match the original.\n");
+			success = false;
+		}
+		if (recovered.count("key6") != 0 || recovered.find("emplaced") == SIZE_MAX) {
+			printf("Recovered table does not contain the expected entries.\n");
+			success = false;
+		}
+
+		// After a checkpoint, only newer mutations are replayed.
+		if (!journal.checkpoint()) {
+			printf("Checkpoint failed.\n");
+			success = false;
+		}
+		journal.insert("after checkpoint", 1);
+		journal.insert("after checkpoint", 2);
+		journal.erase_at(0);
+		journal.commit();
+	}
+
+	hvh::htable<string, int> checkpointed;
+	{
+		hvh::htable_journal<string, int> journal(checkpointed);
+		if (!journal.open(journal_test_snapshot, journal_test_log) || !same_rows(recovered, checkpointed)) {
+			printf("Table recovered from a checkpoint does not match the original.\n");
+			success = false;
+		}
+		if (journal.replayed() != 3) {
+			printf("Only 3 records should be replayed after a checkpoint, instead %zi were.\n", journal.replayed());
+			success = false;
+		}
+	}
+
+	// A torn record at the end of the log is discarded.
+	FILE* log = fopen(journal_test_log, "ab");
+	fwrite("\x40\x00\x00\x00garbage", 1, 11, log);
+	fclose(log);
+	hvh::htable<string, int> torn;
+	{
+		hvh::htable_journal<string, int> journal(torn);
+		if (!journal.open(journal_test_snapshot, journal_test_log) || !same_rows(recovered, torn)) {
+			printf("Recovery should ignore a torn record at the end of the log.\n");
+			success = false;
+		}
+		journal.insert("after torn record", 3);
+	}
+	hvh::htable<string, int> repaired;
+	{
+		hvh::htable_journal<string, int> journal(repaired);
+		if (!journal.open(journal_test_snapshot, journal_test_log) || repaired.find("after torn record") == SIZE_MAX) {
+			printf("Records written after a torn record should be recovered.\n");
+			success = false;
+		}
+	}
+
+	// An intact record which can't be applied isn't a torn write: recovery must fail and leave the log alone,
+	// rather than truncating it along with every record after it.
+	log = fopen(journal_test_log, "ab");
+	for (uint64_t index : { (uint64_t)1000000, (uint64_t)0 }) {
+		char record[sizeof(hvh::_journal_detail::record_header) + 1 + sizeof(index)];
+		char* payload = record + sizeof(hvh::_journal_detail::record_header);
+		payload[0] = (char)hvh::_journal_detail::RECORD_ERASE;
+		memcpy(payload + 1, &index, sizeof(index));
+		hvh::_journal_detail::record_header header;
+		header.num_bytes = 1 + sizeof(index);
+		header.checksum = hvh::_journal_detail::checksum(payload, header.num_bytes);
+		memcpy(record, &header, sizeof(header));
+		fwrite(record, 1, sizeof(record), log);
+	}
+	long log_bytes = ftell(log);
+	fclose(log);
+	hvh::htable<string, int> unapplied;
+	{
+		hvh::htable_journal<string, int> journal(unapplied);
+		if (journal.open(journal_test_snapshot, journal_test_log)) {
+			printf("Recovery should fail when an intact record can't be applied.\n");
+			success = false;
+		}
+	}
+	log = fopen(journal_test_log, "rb");
+	fseek(log, 0, SEEK_END);
+	if (ftell(log) != log_bytes) {
+		printf("A failed recovery changed the log from %li to %li bytes.\n", log_bytes, ftell(log));
+		success = false;
+	}
+	fclose(log);
+
+	// Mutations made before the journal is opened are replaced by the recovered table, so they aren't logged.
+	remove(journal_test_snapshot);
+	remove(journal_test_log);
+	hvh::htable<string, int> early;
+	{
+		hvh::htable_journal<string, int> journal(early);
+		journal.insert("before open", 1);
+		journal.insert("before open", 2);
+		if (!journal.open(journal_test_snapshot, journal_test_log)) {
+			printf("Failed to open a fresh journal after inserting into it.\n");
+			success = false;
+		}
+		journal.insert("after open", 3);
+		journal.commit();
+	}
+	hvh::htable<string, int> reopened;
+	{
+		hvh::htable_journal<string, int> journal(reopened);
+		if (!journal.open(journal_test_snapshot, journal_test_log) || journal.replayed() != 1 || !same_rows(early, reopened)) {
+			printf("Only the mutation made after opening should be replayed, but %zi were.\n", journal.replayed());
+			success = false;
+		}
+	}
+
+	remove(journal_test_snapshot);
+	remove(journal_test_log);
+	return success;
+}
@@ -0,0 +1,203 @@
+/* htable_stats.hpp
+ * Hash distribution and probe sequence statistics for htable
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Measures how well the keys of an htable are spread over its hashmap:
+ * how long the runs of occupied slots are, how far each entry had to probe
+ * from the slot its hash chose, how evenly the hash spreads keys over those
+ * slots, and how many slots a lookup examines on average when it hits and
+ * when it misses.  The same statistics can be computed for any other hash
+ * function, by laying the table's keys out again the way a rehash would,
+ * so that hashes can be chosen for a particular key set by measurement.
+ */
+#ifndef HVH_TOOLS_HTABLESTATS_H
+#define HVH_TOOLS_HTABLESTATS_H
+
+#include "htable.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace hvh {
+
+	struct htable_stats {
+		size_t num_entries = 0;
+		size_t num_slots = 0;
+		size_t num_empty = 0;
+		// Slots left behind by erase, which lookups must probe past.
+		size_t num_deleted = 0;
+		double load_factor = 0.0;
+
+		// cluster_lengths[n] is how many runs of exactly n occupied (or deleted) slots there are,
+		// following the order that probing visits the slots in.
+		std::vector<size_t> cluster_lengths;
+		size_t num_clusters = 0;
+		size_t longest_cluster = 0;
+		double mean_cluster = 0.0;
+
+		// probe_distances[n] is how many entries sit n probe steps away from their home slot.
+		std::vector<size_t> probe_distances;
+		size_t longest_probe = 0;
+
+		// How many slots a lookup examines, on average, for a key in the table and for a key that isn't.
+		// Misses assume that absent keys hash to every slot equally often.
+		double probes_per_hit = 0.0;
+		double probes_per_miss = 0.0;
+
+		// How evenly the hash chose home slots: the number of distinct homes, the most entries sharing one,
+		// and the chi-squared statistic against a perfectly uniform hash (close to num_slots is good).
+		size_t num_homes = 0;
+		size_t busiest_home = 0;
+		double home_chi_squared = 0.0;
+
+		// Probing steps by 2 slots, so it only reaches every slot if there is an odd number of them.
+		// stride_cycles is how many separate probe sequences the slots fall into (1 is good),
+		// and the occupied slots are counted separately for even and odd slot numbers,
+		// since a probe sequence visits all of one before any of the other.
+		size_t stride_cycles = 0;
+		size_t occupied_even = 0;
+		size_t occupied_odd = 0;
+	};
+
+	namespace _htable_stats_detail {
+
+		// Fills in everything from a hashmap of 'num_slots' slots, where home(index) is the slot that
+		// entry 'index' hashes to.  Slots are probed in steps of 2, the same as htable::hash_inc.
+		template <typename HomeFn>
+		htable_stats analyze(const uint32_t* slots, size_t num_slots, size_t num_entries, HomeFn&& home) {
+			const uint32_t INDEXNUL = UINT_MAX, INDEXDEL = UINT_MAX - 1;
+			htable_stats stats;
+			stats.num_entries = num_entries;
+			stats.num_slots = num_slots;
+			if (num_slots == 0) return stats;
+			stats.load_factor = (double)num_entries / (double)num_slots;
+			stats.stride_cycles = (num_slots % 2 == 0) ? 2 : 1;
+
+			std::vector<uint32_t> home_counts(num_slots, 0);
+			double total_hit_probes = 0.0;
+			for (size_t slot = 0; slot < num_slots; ++slot) {
+				const uint32_t index = slots[slot];
+				if (index == INDEXNUL) { ++stats.num_empty; continue; }
+				if (slot % 2 == 0) ++stats.occupied_even;
+				else ++stats.occupied_odd;
+				if (index == INDEXDEL) { ++stats.num_deleted; continue; }
+
+				// The number of steps of 2 from home to here, going around the end of the map as probing does.
+				const size_t from = home(index);
+				++home_counts[from];
+				const size_t diff = (slot + num_slots - from) % num_slots;
+				const size_t distance = (diff % 2 == 0) ? diff / 2 : (diff + num_slots) / 2;
+				if (distance >= stats.probe_distances.size()) stats.probe_distances.resize(distance + 1, 0);
+				++stats.probe_distances[distance];
+				if (distance > stats.longest_probe) stats.longest_probe = distance;
+				total_hit_probes += (double)(distance + 1);
+			}
+			if (num_entries) stats.probes_per_hit = total_hit_probes / (double)num_entries;
+
+			const double expected = (double)num_entries / (double)num_slots;
+			for (uint32_t count : home_counts) {
+				if (count) ++stats.num_homes;
+				if (count > stats.busiest_home) stats.busiest_home = count;
+				stats.home_chi_squared += ((double)count - expected) * ((double)count - expected);
+			}
+			if (expected > 0.0) stats.home_chi_squared /= expected;
+
+			// Walk each probe cycle in order, starting just after an empty slot so that no cluster is split in two.
+			// A miss starting inside a cluster of n slots examines the rest of the cluster and then the empty slot;
+			// summed over the cluster that's n(n+1)/2 + n.
+			double total_miss_probes = 0.0;
+			const size_t cycle_length = num_slots / stats.stride_cycles;
+			for (size_t cycle = 0; cycle < stats.stride_cycles; ++cycle) {
+				auto slot_at = [&](size_t step) { return (cycle + 2 * (step % cycle_length)) % num_slots; };
+				size_t start = 0;
+				while (start < cycle_length && slots[slot_at(start)] != INDEXNUL) ++start;
+				if (start == cycle_length) {
+					// Nothing empty at all, so a miss would never end; report the whole cycle as one cluster.
+					stats.cluster_lengths.resize(cycle_length + 1, 0);
+					++stats.cluster_lengths[cycle_length];
+					++stats.num_clusters;
+					stats.longest_cluster = std::max(stats.longest_cluster, cycle_length);
+					total_miss_probes = std::numeric_limits<double>::infinity();
+					continue;
+				}
+				size_t run = 0;
+				for (size_t step = 1; step <= cycle_length; ++step) {
+					if (slots[slot_at(start + step)] != INDEXNUL) { ++run; continue; }
+					total_miss_probes += 1.0;
+					if (run == 0) continue;
+					if (run >= stats.cluster_lengths.size()) stats.cluster_lengths.resize(run + 1, 0);
+					++stats.cluster_lengths[run];
+					++stats.num_clusters;
+					if (run > stats.longest_cluster) stats.longest_cluster = run;
+					total_miss_probes += ((double)run * (double)(run + 1)) / 2.0 + (double)run;
+					run = 0;
+				}
+			}
+			if (stats.num_clusters) stats.mean_cluster = (double)(num_slots - stats.num_empty) / (double)stats.num_clusters;
+			stats.probes_per_miss = total_miss_probes / (double)num_slots;
+			return stats;
+		}
+
+	} // namespace _htable_stats_detail
+
+	// analyze_htable(table)
+	// Measures the hashmap of 'table' exactly as it is, including any slots left behind by erase.
+	// Complexity: O(n) in the number of hashmap slots.
+	template <typename KeyT, typename... ItemTs>
+	htable_stats analyze_htable(const htable<KeyT, ItemTs...>& table) {
+		size_t num_slots = 0;
+		const uint32_t* slots = table.see_map(num_slots);
+		return _htable_stats_detail::analyze(slots, num_slots, table.size(), [&](uint32_t index) {
+			return std::hash<KeyT>{}(table.template at<0>(index)) % num_slots;
+		});
+	}
+
+	// analyze_htable(table, hash)
+	// Measures how the keys of 'table' would be laid out if it were rehashed using 'hash' instead of std::hash,
+	// with the same number of slots.  The keys are placed in row order, as rehash() would place them,
+	// so the result has no deleted slots.  'hash' is called as hash(key) and must return a size_t.
+	// Complexity: O(n) in the number of hashmap slots, plus the cost of probing for every entry.
+	template <typename HashFn, typename KeyT, typename... ItemTs>
+	htable_stats analyze_htable(const htable<KeyT, ItemTs...>& table, HashFn&& hash) {
+		size_t num_slots = 0;
+		table.see_map(num_slots);
+		std::vector<uint32_t> slots(num_slots, UINT_MAX);
+		std::vector<size_t> homes(table.size());
+		for (size_t i = 0; i < table.size(); ++i) {
+			homes[i] = (size_t)hash(table.template at<0>(i)) % num_slots;
+			size_t slot = homes[i];
+			while (slots[slot] != UINT_MAX) slot = (slot + 2) % num_slots;
+			slots[slot] = (uint32_t)i;
+		}
+		return _htable_stats_detail::analyze(slots.data(), num_slots, table.size(), [&](uint32_t index) {
+			return homes[index];
+		});
+	}
+
+	// print(stats, out)
+	// Writes a readable summary of 'stats', including both distributions, to 'out'.
+	inline void print(const htable_stats& stats, FILE* out = stdout) {
+		fprintf(out, "entries %zu, slots %zu (load %.3f), empty %zu, deleted %zu\n",
+			stats.num_entries, stats.num_slots, stats.load_factor, stats.num_empty, stats.num_deleted);
+		fprintf(out, "probes per hit %.3f, per miss %.3f, longest probe %zu\n",
+			stats.probes_per_hit, stats.probes_per_miss, stats.longest_probe);
+		fprintf(out, "clusters %zu, mean length %.3f, longest %zu\n", stats.num_clusters, stats.mean_cluster, stats.longest_cluster);
+		fprintf(out, "homes %zu, busiest %zu, chi-squared %.1f over %zu slots\n",
+			stats.num_homes, stats.busiest_home, stats.home_chi_squared, stats.num_slots);
+		fprintf(out, "stride cycles %zu, occupied even %zu, odd %zu\n", stats.stride_cycles, stats.occupied_even, stats.occupied_odd);
+		fprintf(out, "probe distance: entries\n");
+		for (size_t n = 0; n < stats.probe_distances.size(); ++n) {
+			if (stats.probe_distances[n]) fprintf(out, "  %6zu: %zu\n", n, stats.probe_distances[n]);
+		}
+		fprintf(out, "cluster length: clusters\n");
+		for (size_t n = 0; n < stats.cluster_lengths.size(); ++n) {
+			if (stats.cluster_lengths[n]) fprintf(out, "  %6zu: %zu\n", n, stats.cluster_lengths[n]);
+		}
+	}
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_HTABLESTATS_H
@@ -0,0 +1,116 @@
+#include "htable_stats.hpp"
+#include <string>
+#include <cstdio>
+using namespace std;
+
+// Counts probes the slow way, by walking the hashmap from each entry's home slot exactly as find() does.
+template <typename HashFn>
+static double brute_force_probes_per_hit(const hvh::htable<uint64_t, int>& table, HashFn&& hash, const uint32_t* slots, size_t num_slots) {
+	double total = 0.0;
+	for (size_t i = 0; i < table.size(); ++i) {
+		size_t slot = hash(table.at<0>(i)) % num_slots;
+		size_t probes = 1;
+		while (slots[slot] != (uint32_t)i) { slot = (slot + 2) % num_slots; ++probes; }
+		total += (double)probes;
+	}
+	return total / (double)table.size();
+}
+static double brute_force_probes_per_miss(const uint32_t* slots, size_t num_slots) {
+	double total = 0.0;
+	for (size_t home = 0; home < num_slots; ++home) {
+		size_t slot = home;
+		size_t probes = 1;
+		while (slots[slot] != UINT_MAX) { slot = (slot + 2) % num_slots; ++probes; }
+		total += (double)probes;
+	}
+	return total / (double)num_slots;
+}
+
+static bool consistent(const hvh::htable_stats& stats, const char* what) {
+	bool success = true;
+	size_t entries = 0, clustered = 0;
+	for (size_t n : stats.probe_distances) entries += n;
+	for (size_t n = 0; n < stats.cluster_lengths.size(); ++n) clustered += n * stats.cluster_lengths[n];
+	if (entries != stats.num_entries) {
+		printf("%s: probe distances cover %zi entries, expected %zi.\n", what, entries, stats.num_entries);
+		success = false;
+	}
+	if (clustered != stats.num_slots - stats.num_empty || stats.occupied_even + stats.occupied_odd != clustered) {
+		printf("%s: clusters cover %zi slots, expected %zi.\n", what, clustered, stats.num_slots - stats.num_empty);
+		success = false;
+	}
+	if (stats.stride_cycles != 1) {
+		printf("%s: the +2 stride should visit every slot in one cycle, instead there are %zi.\n", what, stats.stride_cycles);
+		success = false;
+	}
+	return success;
+}
+
+bool htable_stats_test() {
+	printf("Testing htable_stats...\n");
+	bool success = true;
+
+	hvh::htable<uint64_t, int> empty;
+	hvh::htable_stats stats = hvh::analyze_htable(empty);
+	if (stats.num_slots != 0 || stats.num_entries != 0 || stats.num_clusters != 0) {
+		printf("An empty htable should have empty statistics.\n");
+		success = false;
+	}
+
+	hvh::htable<uint64_t, int> table;
+	for (uint64_t i = 0; i < 5000; ++i) table.insert(i * 7919, (int)i);
+	size_t num_slots = 0;
+	const uint32_t* slots = table.see_map(num_slots);
+
+	stats = hvh::analyze_htable(table);
+	success &= consistent(stats, "std::hash");
+	const double hit = brute_force_probes_per_hit(table, std::hash<uint64_t>{}, slots, num_slots);
+	const double miss = brute_force_probes_per_miss(slots, num_slots);
+	if (stats.probes_per_hit < hit - 1e-9 || stats.probes_per_hit > hit + 1e-9
+	 || stats.probes_per_miss < miss - 1e-9 || stats.probes_per_miss > miss + 1e-9) {
+		printf("Expected %f probes per hit and %f per miss, got %f and %f.\n", hit, miss, stats.probes_per_hit, stats.probes_per_miss);
+		success = false;
+	}
+
+	// Analyzing with the hash the table already uses should match the real layout, since it was inserted in row order.
+	hvh::htable_stats same = hvh::analyze_htable(table, std::hash<uint64_t>{});
+	if (same.probe_distances != stats.probe_distances || same.cluster_lengths != stats.cluster_lengths) {
+		printf("Re-laying out the table with std::hash should give the same distributions.\n");
+		success = false;
+	}
+
+	// A hash that sends every key to the same slot makes one long cluster.
+	stats = hvh::analyze_htable(table, [](uint64_t) { return (size_t)3; });
+	success &= consistent(stats, "constant hash");
+	if (stats.num_homes != 1 || stats.busiest_home != 5000 || stats.longest_probe != 4999
+	 || stats.num_clusters != 1 || stats.longest_cluster != 5000 || stats.probes_per_hit != 2500.5) {
+		printf("A constant hash should give one cluster of 5000 entries, got %zi clusters, longest %zi, %f probes per hit.\n",
+			stats.num_clusters, stats.longest_cluster, stats.probes_per_hit);
+		success = false;
+	}
+
+	// A multiplicative hash should spread these keys at least about as well as a uniform one would.
+	stats = hvh::analyze_htable(table, [](uint64_t key) { return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 20); });
+	success &= consistent(stats, "multiplicative hash");
+	if (stats.probes_per_hit > 2.0 || stats.home_chi_squared > 2.0 * (double)stats.num_slots) {
+		printf("A multiplicative hash gave %f probes per hit and chi-squared %f.\n", stats.probes_per_hit, stats.home_chi_squared);
+		success = false;
+	}
+
+	// Erased entries leave deleted slots behind, which still count towards clusters.
+	for (uint64_t i = 0; i < 1000; ++i) table.erase(i * 7919);
+	stats = hvh::analyze_htable(table);
+	success &= consistent(stats, "after erase");
+	if (stats.num_entries != 4000 || stats.num_deleted != 1000) {
+		printf("After erasing, expected 4000 entries and 1000 deleted slots, got %zi and %zi.\n", stats.num_entries, stats.num_deleted);
+		success = false;
+	}
+	slots = table.see_map(num_slots);
+	const double miss_after = brute_force_probes_per_miss(slots, num_slots);
+	if (stats.probes_per_miss < miss_after - 1e-9 || stats.probes_per_miss > miss_after + 1e-9) {
+		printf("Misses should probe past deleted slots.\n");
+		success = false;
+	}
+
+	return success;
+}
@@ -1,6 +1,12 @@
 #include "htable.hpp"
 #include <string>
 #include <cstdio>
+#include <cstdlib>
+
+// An allocator which resizes buffers with realloc, to exercise growing in place.
+static void* realloc_test_allocate(void*, size_t num_bytes) { return malloc(num_bytes); }
+static void realloc_test_deallocate(void*, void* mem, size_t) { free(mem); }
+static void* realloc_test_reallocate(void*, void* mem, size_t, size_t new_bytes) { return realloc(mem, new_bytes); }
 
 bool hashtable_test() {
 	bool success = true;
@@ -93,5 +99,48 @@ bool hashtable_test() {
 		printf("[%i]:[%s]\n", stringhash.at<1>(i), stringhash.at<0>(i).c_str());
 	}
 
+	// A parallel rehash must find every entry, and find duplicates in the order they were inserted.
+	hvh::htable<uint64_t, uint32_t> bigtable;
+	for (uint32_t i = 0; i < 200000; ++i) bigtable.insert((uint64_t)(i % 70000) * 7, i);
+	hvh::htable<uint64_t, uint32_t> sequential = bigtable;
+	sequential.rehash_serial();
+	bigtable.rehash_parallel(4);
+	for (uint64_t key = 0; key < 70000 && success; ++key) {
+		size_t expected = sequential.find(key * 7);
+		size_t found = bigtable.find(key * 7);
+		while (expected != SIZE_MAX || found != SIZE_MAX) {
+			if (expected != found) {
+				printf("Parallel rehash found entry %zi for key %zi, expected %zi.\n", found, (size_t)(key * 7), expected);
+				success = false;
+				break;
+			}
+			expected = sequential.find(key * 7, false);
+			found = bigtable.find(key * 7, false);
+		}
+	}
+	if (bigtable.find(3) != SIZE_MAX) {
+		printf("Parallel rehash found a key which was never inserted.\n");
+		success = false;
+	}
+
+	// Tables whose allocator can resize in place must keep every entry through growing and shrinking.
+	hvh::soa_allocator reallocator;
+	reallocator.allocate = &realloc_test_allocate;
+	reallocator.deallocate = &realloc_test_deallocate;
+	reallocator.reallocate = &realloc_test_reallocate;
+	hvh::htable<uint32_t, double, uint16_t> regrown;
+	regrown.set_allocator(&reallocator);
+	for (uint32_t i = 0; i < 5000; ++i) regrown.insert(i * 11, i * 0.5, (uint16_t)i);
+	for (uint32_t i = 0; i < 3000; ++i) regrown.erase(i * 11);
+	regrown.shrink_to_fit();
+	for (uint32_t i = 0; i < 5000; ++i) {
+		size_t index = regrown.find(i * 11);
+		if ((i < 3000) != (index == SIZE_MAX) || (index != SIZE_MAX && (regrown.at<1>(index) != i * 0.5 || regrown.at<2>(index) != (uint16_t)i))) {
+			printf("Entry %u is wrong after growing and shrinking in place.\n", i);
+			success = false;
+			break;
+		}
+	}
+
 	return success;
 }
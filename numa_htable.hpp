@@ -0,0 +1,257 @@
+/* numa_htable.hpp
+ * A hash table partitioned across NUMA nodes
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Provides numa_htable, which splits its entries between one htable per NUMA
+ * node, each of which keeps its buffer in that node's memory.  Keys are
+ * routed to a partition by their hash, so a thread which only looks up keys
+ * belonging to its own node never touches remote memory.  Also provides
+ * numa_allocator, which places any soa or htable on a chosen node.
+ * Placement needs Linux; elsewhere there is a single node and ordinary memory.
+ */
+#ifndef HVH_TOOLS_NUMAHTABLE_H
+#define HVH_TOOLS_NUMAHTABLE_H
+
+#include "htable.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+#if defined(__linux__)
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+namespace hvh {
+
+	// numa_node_count()
+	// Returns the number of NUMA nodes in the system, or 1 if it can't be determined.
+	inline size_t numa_node_count() {
+		size_t result = 1;
+	#if defined(__linux__)
+		// The online nodes are listed like "0-1,3"; the highest one tells us how many there are.
+		FILE* file = fopen("/sys/devices/system/node/online", "r");
+		if (!file) return 1;
+		unsigned first = 0, last = 0;
+		char separator = 0;
+		while (fscanf(file, "%u", &first) == 1) {
+			last = first;
+			if (fscanf(file, "%c", &separator) == 1 && separator == '-' && fscanf(file, "%u", &last) == 1)
+				(void)fscanf(file, "%c", &separator);
+			if (last + 1 > result) result = last + 1;
+			if (separator != ',') break;
+		}
+		fclose(file);
+	#endif
+		return result;
+	}
+
+	// numa_current_node()
+	// Returns the NUMA node of the CPU that the calling thread is running on, or 0 if it can't be determined.
+	// Threads can move between CPUs, so the answer is only a hint unless the thread is pinned.
+	inline int numa_current_node() {
+	#if defined(__linux__) && defined(SYS_getcpu)
+		unsigned cpu = 0, node = 0;
+		if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return (int)node;
+	#endif
+		return 0;
+	}
+
+	namespace _numa_detail {
+
+		static constexpr size_t PAGE_BYTES = 4096;
+		// From <numaif.h>, which isn't always installed.
+		static constexpr int MPOL_PREFERRED_MODE = 1;
+
+		inline size_t round_to_pages(size_t num_bytes) { return (num_bytes + PAGE_BYTES - 1) & ~(PAGE_BYTES - 1); }
+
+	#if defined(__linux__)
+		// Asks for the pages in [mem, mem + num_bytes) to come from 'node'.
+		// 'Preferred' rather than 'bind', so that a full node spills over instead of failing.
+		inline void place(void* mem, size_t num_bytes, int node) {
+		#if defined(SYS_mbind)
+			if (node < 0 || node >= 64) return;
+			unsigned long mask = 1ul << node;
+			syscall(SYS_mbind, mem, num_bytes, MPOL_PREFERRED_MODE, &mask, sizeof(mask) * 8, 0);
+		#endif
+		}
+
+		inline void* allocate(void* context, size_t num_bytes) {
+			size_t mapped = round_to_pages(num_bytes);
+			void* mem = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mem == MAP_FAILED) return nullptr;
+			// Nothing has been touched yet, so every page will be faulted in on the right node.
+			place(mem, mapped, (int)(intptr_t)context);
+		#if defined(MADV_HUGEPAGE)
+			// Big tables are probed all over, so huge pages save a lot of TLB misses.
+			madvise(mem, mapped, MADV_HUGEPAGE);
+		#endif
+			return mem;
+		}
+		inline void deallocate(void*, void* mem, size_t num_bytes) { munmap(mem, round_to_pages(num_bytes)); }
+		inline void* reallocate(void* context, void* mem, size_t old_bytes, size_t new_bytes) {
+			size_t oldmapped = round_to_pages(old_bytes), newmapped = round_to_pages(new_bytes);
+			if (oldmapped == newmapped) return mem;
+			void* result = mremap(mem, oldmapped, newmapped, MREMAP_MAYMOVE);
+			if (result == MAP_FAILED) return nullptr;
+			// Moved pages keep their node; this covers the new ones.
+			place(result, newmapped, (int)(intptr_t)context);
+		#if defined(MADV_HUGEPAGE)
+			madvise(result, newmapped, MADV_HUGEPAGE);
+		#endif
+			return result;
+		}
+	#else
+		inline void* allocate(void*, size_t num_bytes) { return _soa_aligned_malloc(16, num_bytes); }
+		inline void deallocate(void*, void* mem, size_t) { _soa_aligned_free(mem); }
+	#endif
+
+	} // namespace _numa_detail
+
+	// numa_allocator(node)
+	// Returns an allocator which keeps buffers in the memory of the given NUMA node.
+	// Memory is mapped a page at a time, so this is meant for large containers.
+	inline soa_allocator numa_allocator(int node) {
+		soa_allocator result;
+		result.allocate = &_numa_detail::allocate;
+		result.deallocate = &_numa_detail::deallocate;
+	#if defined(__linux__)
+		result.reallocate = &_numa_detail::reallocate;
+	#endif
+		result.context = (void*)(intptr_t)node;
+		return result;
+	}
+
+	// numa_htable
+	// A hash table made of one htable per partition, each allocated on its own NUMA node.
+	// By default there is one partition per node.
+	// Every entry with a given key lives in the same partition, chosen by 'partition_of'.
+	// To avoid remote memory, have threads on each node handle the keys whose partitions live there (see 'node_of').
+	// Indices returned by a partition's 'find' are only meaningful for that partition.
+	template <typename KeyT, typename... ItemTs>
+	class numa_htable {
+	public:
+
+		// numa_htable(num_partitions)
+		// Creates an empty table with the given number of partitions, spread over the NUMA nodes in turn.
+		// 0 creates one partition per node.
+		// Complexity: O(partitions).
+		explicit numa_htable(size_t num_partitions = 0) {
+			size_t num_nodes = numa_node_count();
+			if (num_partitions == 0) num_partitions = num_nodes;
+			mynumpartitions = num_partitions;
+			mypartitions.reset(new shard[num_partitions]);
+			for (size_t p = 0; p < num_partitions; ++p) {
+				mypartitions[p].node = (int)(p % num_nodes);
+				mypartitions[p].allocator = numa_allocator(mypartitions[p].node);
+				mypartitions[p].table.set_allocator(&mypartitions[p].allocator);
+			}
+		}
+
+		numa_htable(const numa_htable&) = delete;
+		numa_htable& operator = (const numa_htable&) = delete;
+
+		// partition_of(key)
+		// Returns the index of the partition which holds entries with the given key.
+		// Complexity: O(1).
+		inline size_t partition_of(const KeyT& key) const {
+			// With a single partition, don't make every lookup wait on the hash just to find its table.
+			if (mynumpartitions == 1) return 0;
+			// Mix the hash before picking a partition, so that each partition still sees well spread hashes.
+			uint64_t mixed = (uint64_t)std::hash<KeyT>{}(key) * 0x9E3779B97F4A7C15ull;
+			return (size_t)(((mixed >> 32) * (uint64_t)mynumpartitions) >> 32);
+		}
+
+		// partition(p)
+		// Returns the htable for partition p.
+		inline htable<KeyT, ItemTs...>& partition(size_t p) { return mypartitions[p].table; }
+		inline const htable<KeyT, ItemTs...>& partition(size_t p) const { return mypartitions[p].table; }
+
+		// partition_for(key)
+		// Returns the htable which holds entries with the given key.
+		inline htable<KeyT, ItemTs...>& partition_for(const KeyT& key) { return partition(partition_of(key)); }
+		inline const htable<KeyT, ItemTs...>& partition_for(const KeyT& key) const { return partition(partition_of(key)); }
+
+		// num_partitions()
+		// Returns the number of partitions.
+		inline size_t num_partitions() const { return mynumpartitions; }
+
+		// node_of(p)
+		// Returns the NUMA node whose memory holds partition p.
+		inline int node_of(size_t p) const { return mypartitions[p].node; }
+
+		// size()
+		// Returns the number of entries across every partition.
+		// Complexity: O(partitions).
+		size_t size() const {
+			size_t result = 0;
+			for (size_t p = 0; p < mynumpartitions; ++p) result += mypartitions[p].table.size();
+			return result;
+		}
+
+		// reserve(n)
+		// Ensures that the table can hold n entries without reallocating, assuming they're evenly spread.
+		// Returns false if a memory allocation error occurs, or true otherwise.
+		// Complexity: O(n).
+		bool reserve(size_t n) {
+			size_t each = (n + mynumpartitions - 1) / mynumpartitions;
+			// Leave some slack, since keys never split exactly evenly.
+			each += each / 8;
+			for (size_t p = 0; p < mynumpartitions; ++p) {
+				if (!mypartitions[p].table.reserve(each)) return false;
+			}
+			return true;
+		}
+
+		// clear()
+		// Erases every entry, keeping the memory.
+		// Complexity: O(n).
+		void clear() {
+			for (size_t p = 0; p < mynumpartitions; ++p) mypartitions[p].table.clear();
+		}
+
+		// insert(key, items...)
+		// Inserts a new entry into the key's partition.
+		// Returns false if a memory allocation failure occurs, true otherwise.
+		// Complexity: O(1) amortized.
+		template <typename... Ts>
+		inline bool insert(const KeyT& key, Ts&&... items) { return partition_for(key).insert(key, std::forward<Ts>(items)...); }
+
+		// count(key)
+		// Returns the number of entries which have the indicated key.
+		// Complexity: O(1) amortized.
+		inline size_t count(const KeyT& key) const { return partition_for(key).count(key); }
+
+		// contains(key)
+		// Returns true if any entry has the indicated key.
+		// Complexity: O(1) amortized.
+		inline bool contains(const KeyT& key) const { return partition_for(key).find(key) != SIZE_MAX; }
+
+		// erase(key)
+		// Erases one entry with the indicated key, returning the number of entries erased (0 or 1).
+		// Complexity: O(1) amortized.
+		inline size_t erase(const KeyT& key) { return partition_for(key).erase(key); }
+
+		// erase_all(key)
+		// Erases every entry with the indicated key, returning the number of entries erased.
+		// Complexity: O(1) amortized.
+		inline size_t erase_all(const KeyT& key) { return partition_for(key).erase_all(key); }
+
+	private:
+		struct shard {
+			// The allocator has to outlive the table, so it comes first.
+			soa_allocator allocator;
+			htable<KeyT, ItemTs...> table;
+			int node = 0;
+		};
+
+		std::unique_ptr<shard[]> mypartitions;
+		size_t mynumpartitions = 0;
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_NUMAHTABLE_H
@@ -0,0 +1,68 @@
+#include "numa_htable.hpp"
+#include <string>
+#include <vector>
+#include <cstdio>
+using namespace std;
+
+bool numa_htable_test() {
+	printf("Testing numa_htable...\n");
+	bool success = true;
+
+	// More partitions than this machine probably has nodes, so that routing gets exercised everywhere.
+	hvh::numa_htable<uint64_t, double, string> table(4);
+	if (table.num_partitions() != 4 || table.node_of(3) != (int)(3 % hvh::numa_node_count())) {
+		printf("numa_htable should have 4 partitions spread over %zi nodes.\n", hvh::numa_node_count());
+		success = false;
+	}
+
+	table.reserve(100000);
+	for (uint64_t i = 0; i < 100000; ++i) table.insert(i, i * 0.5, to_string(i));
+	table.insert(42, -1.0, string("duplicate"));
+	if (table.size() != 100001) {
+		printf("numa_htable should have 100001 entries, instead it has %zi.\n", table.size());
+		success = false;
+	}
+
+	// Each key must live in the partition it routes to, and the partitions should be roughly even.
+	for (size_t p = 0; p < table.num_partitions(); ++p) {
+		const hvh::htable<uint64_t, double, string>& part = table.partition(p);
+		if (part.size() < 20000 || part.size() > 30000) {
+			printf("Partition %zi holds %zi of 100001 entries, which is badly unbalanced.\n", p, part.size());
+			success = false;
+		}
+		for (size_t i = 0; i < part.size(); ++i) {
+			if (table.partition_of(part.at<0>(i)) != p) {
+				printf("Key %zi is stored in partition %zi, but routes to another.\n", (size_t)part.at<0>(i), p);
+				success = false;
+				break;
+			}
+		}
+	}
+
+	for (uint64_t i = 0; i < 100000; i += 13) {
+		hvh::htable<uint64_t, double, string>& part = table.partition_for(i);
+		size_t index = part.find(i);
+		if (index == SIZE_MAX || part.at<1>(index) != i * 0.5 || part.at<2>(index) != to_string(i)) {
+			printf("Key %zi was not found with the expected items.\n", (size_t)i);
+			success = false;
+			break;
+		}
+	}
+	if (table.count(42) != 2 || table.contains(100000) || table.erase_all(42) != 2 || table.contains(42) || table.erase(43) != 1) {
+		printf("count, contains, or erase gave the wrong answer.\n");
+		success = false;
+	}
+
+	// The allocator can also place an ordinary soa, and grow it in place.
+	hvh::soa_allocator allocator = hvh::numa_allocator(0);
+	hvh::soa<int, double> numbers;
+	numbers.set_allocator(&allocator);
+	for (int i = 0; i < 50000; ++i) numbers.push_back(i, i * 2.0);
+	numbers.shrink_to_fit();
+	if (numbers.size() != 50000 || numbers.at<0>(49999) != 49999 || numbers.at<1>(12345) != 24690.0) {
+		printf("An soa using numa_allocator lost its contents.\n");
+		success = false;
+	}
+
+	return success;
+}
@@ -0,0 +1,432 @@
+/* shm_htable.hpp
+ * A hash table shared between processes
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Provides shm_htable, an htable which lives in a POSIX shared memory object
+ * (or any shareable file descriptor, like a memfd) so that many processes on
+ * one host can share a single copy of a lookup table.
+ *
+ * The shared memory holds no pointers: a header records the capacity, and
+ * every column sits at an offset which follows from it, exactly as it would
+ * in an htable's buffer.  Each process maps the memory wherever it likes and
+ * points its own view at it.  One process writes, and any number read;
+ * readers never block the writer, and retry if the writer changed the table
+ * while they were looking (a sequence lock).  The writer's pid is kept in the
+ * header, so that if it dies partway through a change, readers give up
+ * rather than waiting forever for it to finish.  The capacity is fixed when the
+ * table is created, since growing would move the memory out from under the
+ * readers.  Requires a POSIX system.
+ */
+#ifndef HVH_TOOLS_SHMHTABLE_H
+#define HVH_TOOLS_SHMHTABLE_H
+
+#include "htable.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <thread>
+#include <signal.h> // For kill
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace hvh {
+
+	static constexpr char SHM_HTABLE_MAGIC[8] = { 'H', 'V', 'H', 'S', 'H', 'M', 'T', '\0' };
+	static constexpr uint32_t SHM_HTABLE_VERSION = 2;
+
+	// The first page of the shared memory holds this header; the table's buffer follows it.
+	struct shm_htable_header {
+		char magic[8];
+		uint32_t version;
+		uint32_t num_columns;
+		uint64_t column_signature;
+		uint64_t capacity;
+		uint64_t hashcapacity;
+		// Odd while the writer is changing the table, and incremented again once it's done.
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> size;
+		// The process which most recently attached as the writer.
+		std::atomic<int64_t> writer_pid;
+	};
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm_htable needs lock-free 64-bit atomics to work across processes.");
+
+	// shm_htable
+	// A fixed-capacity hash table in shared memory, with one writing process and many reading processes.
+	// Only trivially copyable keys and items can be stored, since other processes can only see their bytes.
+	// Each thread should use its own shm_htable to access the table.
+	template <typename KeyT, typename... ItemTs>
+	class shm_htable {
+		static_assert(std::is_trivially_copyable<KeyT>::value && (std::is_trivially_copyable<ItemTs>::value && ...),
+			"Only trivially copyable types can be stored in a shm_htable.");
+	public:
+
+		shm_htable() {}
+		shm_htable(const shm_htable&) = delete;
+		shm_htable& operator = (const shm_htable&) = delete;
+
+		// ~shm_htable()
+		// Unmaps the shared memory.  The table itself lives on until it is unlinked.
+		~shm_htable() { close(); }
+
+		// create(name, capacity)
+		// Creates (or replaces) the shared memory object 'name' (as passed to shm_open),
+		// sizes it to hold 'capacity' entries, and attaches to it as the writer.
+		// An existing object is unlinked rather than truncated, so processes which still have it mapped
+		// keep reading the old table instead of faulting; they see the new one once they open 'name' again.
+		// Returns false if the memory can't be created or mapped.
+		// Complexity: O(capacity).
+		bool create(const char* name, size_t capacity) {
+			shm_unlink(name);
+			int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+			if (fd < 0) return false;
+			bool result = create(fd, capacity);
+			::close(fd);
+			return result;
+		}
+
+		// create(fd, capacity)
+		// As above, but uses a file descriptor which is already open for reading and writing, like a memfd.
+		// The file descriptor is not closed, and can be handed to other processes so that they can 'open' it.
+		bool create(int fd, size_t capacity) {
+			close();
+			if (capacity == 0) capacity = 16;
+			if (capacity % 16 != 0) capacity += 16 - (capacity % 16);
+			if (capacity > view.max_size()) return false;
+			size_t hashcapacity = capacity + capacity + 4 - 1;
+			size_t num_bytes = HEADER_BYTES + buffer_bytes(capacity, hashcapacity);
+			if (ftruncate(fd, (off_t)num_bytes) != 0) return false;
+			if (!map(fd, num_bytes, true)) return false;
+
+			memcpy(myheader->magic, SHM_HTABLE_MAGIC, sizeof(SHM_HTABLE_MAGIC));
+			myheader->version = SHM_HTABLE_VERSION;
+			myheader->num_columns = (uint32_t)(1 + sizeof...(ItemTs));
+			myheader->column_signature = column_signature();
+			myheader->capacity = capacity;
+			myheader->hashcapacity = hashcapacity;
+			myheader->sequence.store(0, std::memory_order_relaxed);
+			myheader->size.store(0, std::memory_order_relaxed);
+			myheader->writer_pid.store((int64_t)getpid(), std::memory_order_relaxed);
+			view.attach((char*)mymap + HEADER_BYTES, capacity, hashcapacity, 0);
+			memset(view.hashmap, 0xFF, sizeof(uint32_t) * (hashcapacity + 1));
+			std::atomic_thread_fence(std::memory_order_release);
+			return true;
+		}
+
+		// open(name, writable)
+		// Attaches to the existing shared memory object 'name'.
+		// Readers should leave 'writable' false.  The table must only ever have one writer at a time.
+		// Returns false if the memory can't be mapped, or holds a table with different column types.
+		// A writer also can't attach to a table whose last writer died partway through a change; it has to be created again.
+		// Complexity: O(1).
+		bool open(const char* name, bool writable = false) {
+			int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+			if (fd < 0) return false;
+			bool result = open(fd, writable);
+			::close(fd);
+			return result;
+		}
+
+		// open(fd, writable)
+		// As above, but uses a file descriptor which is already open.  The file descriptor is not closed.
+		bool open(int fd, bool writable = false) {
+			close();
+			struct stat info;
+			if (fstat(fd, &info) != 0 || (size_t)info.st_size < HEADER_BYTES) return false;
+			if (!map(fd, (size_t)info.st_size, writable)) return false;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (memcmp(myheader->magic, SHM_HTABLE_MAGIC, sizeof(SHM_HTABLE_MAGIC)) != 0 ||
+				myheader->version != SHM_HTABLE_VERSION ||
+				myheader->num_columns != 1 + sizeof...(ItemTs) ||
+				myheader->column_signature != column_signature() ||
+				myheader->hashcapacity != (myheader->capacity * 2) + 3 ||
+				mymapped != HEADER_BYTES + buffer_bytes((size_t)myheader->capacity, (size_t)myheader->hashcapacity) ||
+				(writable && (myheader->sequence.load(std::memory_order_acquire) & 1))) {
+				close();
+				return false;
+			}
+			if (writable) myheader->writer_pid.store((int64_t)getpid(), std::memory_order_relaxed);
+			view.attach((char*)mymap + HEADER_BYTES, (size_t)myheader->capacity, (size_t)myheader->hashcapacity,
+				(size_t)myheader->size.load(std::memory_order_acquire));
+			return true;
+		}
+
+		// close()
+		// Unmaps the shared memory.  Other processes are unaffected.
+		void close() {
+			if (!mymap) return;
+			view.detach();
+			munmap(mymap, mymapped);
+			mymap = nullptr;
+			myheader = nullptr;
+			mymapped = 0;
+			mywritable = false;
+		}
+
+		// unlink(name)
+		// Removes the shared memory object 'name'.
+		// Processes which have it open can keep using it; it is freed once they all close it.
+		static inline bool unlink(const char* name) { return shm_unlink(name) == 0; }
+
+		// is_open()
+		// Returns true if the table is attached to shared memory.
+		inline bool is_open() const { return mymap != nullptr; }
+
+		// capacity()
+		// Returns the number of entries the table can hold.
+		inline size_t capacity() const { return myheader ? (size_t)myheader->capacity : 0; }
+
+		// size()
+		// Returns the number of entries in the table, as of the writer's last completed change.
+		inline size_t size() const { return myheader ? (size_t)myheader->size.load(std::memory_order_acquire) : 0; }
+
+		// version()
+		// Returns a number which goes up every time the writer changes the table,
+		// so that readers can tell when anything they've cached has gone stale.
+		inline uint64_t version() const { return myheader ? myheader->sequence.load(std::memory_order_acquire) / 2 : 0; }
+
+		// abandoned()
+		// Returns true if the writer died partway through a change, leaving the table half-changed.
+		// Lookups on an abandoned table return false.  The writer's pid is only meaningful within its own pid namespace,
+		// so processes sharing a table across containers should share a pid namespace too.
+		bool abandoned() const {
+			if (!myheader || !(myheader->sequence.load(std::memory_order_acquire) & 1)) return false;
+			pid_t pid = (pid_t)myheader->writer_pid.load(std::memory_order_relaxed);
+			if (pid == getpid()) return false;
+			return kill(pid, 0) != 0 && errno == ESRCH;
+		}
+
+		/**************************************************************************
+		 * Reading
+		 * Safe to call from any process while the writer is working.
+		 *************************************************************************/
+
+		// find(key, items&...)
+		// Looks up the first entry with the given key and copies its items into 'items'.
+		// Returns false if there is no such entry, or if the table has been abandoned (see 'abandoned').
+		// If the writer changes the table during the lookup, the lookup is retried,
+		// so the items always come from a single consistent version of the table.
+		// Complexity: O(1).
+		bool find(const KeyT& key, ItemTs&... items) const {
+			if (!myheader) return false;
+			return read_consistent([&]() {
+				size_t index = locate(key);
+				if (index == SIZE_MAX) return false;
+				copy_items(index, std::index_sequence_for<ItemTs...>{}, items...);
+				return true;
+			});
+		}
+
+		// contains(key)
+		// Returns true if the table has an entry with the given key.
+		// Complexity: O(1).
+		bool contains(const KeyT& key) const {
+			if (!myheader) return false;
+			return read_consistent([&]() { return locate(key) != SIZE_MAX; });
+		}
+
+		/**************************************************************************
+		 * Writing
+		 * Only for the writer.  Each change is published to readers as a whole.
+		 *************************************************************************/
+
+		// insert(key, items...)
+		// Inserts a new entry.  Tables may hold multiple entries with the same key.
+		// Returns false if the table is full or wasn't opened for writing.
+		// Complexity: O(1).
+		template <typename... Ts>
+		bool insert(const KeyT& key, Ts&&... items) {
+			if (!mywritable || view.size() == view.capacity()) return false;
+			begin_write();
+			bool result = view.insert(key, std::forward<Ts>(items)...);
+			end_write();
+			return result;
+		}
+
+		// assign(key, items...)
+		// Overwrites the items of the first entry with the given key, or inserts a new entry if there isn't one.
+		// Returns false if a new entry was needed but the table is full, or the table wasn't opened for writing.
+		// Complexity: O(1).
+		template <typename... Ts>
+		bool assign(const KeyT& key, Ts&&... items) {
+			if (!mywritable) return false;
+			size_t index = view.find(key);
+			if (index == SIZE_MAX) return insert(key, std::forward<Ts>(items)...);
+			begin_write();
+			assign_items(index, std::index_sequence_for<ItemTs...>{}, std::forward<Ts>(items)...);
+			end_write();
+			return true;
+		}
+
+		// erase(key)
+		// Erases the first entry with the given key.
+		// Returns the number of entries erased (0 or 1).
+		// Complexity: O(1).
+		size_t erase(const KeyT& key) {
+			if (!mywritable) return 0;
+			begin_write();
+			size_t result = view.erase(key);
+			myerased += result;
+			end_write();
+			return result;
+		}
+
+		// erase_all(key)
+		// Erases every entry with the given key.
+		// Returns the number of entries erased.
+		// Complexity: O(1) amortized.
+		size_t erase_all(const KeyT& key) {
+			if (!mywritable) return 0;
+			begin_write();
+			size_t result = view.erase_all(key);
+			myerased += result;
+			end_write();
+			return result;
+		}
+
+		// clear()
+		// Erases every entry.
+		// Complexity: O(capacity).
+		void clear() {
+			if (!mywritable) return;
+			begin_write();
+			view.clear();
+			myerased = 0;
+			end_write();
+		}
+
+	private:
+		// The header takes up a whole page, so that the buffer after it is page aligned.
+		static constexpr size_t HEADER_BYTES = 4096;
+		// How many times a reader waits for a change to finish between checks that the writer is still alive.
+		static constexpr size_t WRITER_CHECK_WAITS = 1024;
+
+		// An htable which doesn't own its buffer; it's pointed at the shared memory instead.
+		class shared_view : public htable<KeyT, ItemTs...> {
+		public:
+			using htable<KeyT, ItemTs...>::INDEXNUL;
+			using htable<KeyT, ItemTs...>::INDEXDEL;
+			using htable<KeyT, ItemTs...>::hashmap;
+			using htable<KeyT, ItemTs...>::hashcapacity;
+
+			~shared_view() { detach(); }
+
+			void attach(char* mem, size_t capacity, size_t hashcap, size_t size) {
+				hashmap = (uint32_t*)mem;
+				hashcapacity = hashcap;
+				this->hashcursor = SIZE_MAX;
+				this->mycapacity = capacity;
+				this->mysize = size;
+				_soa_base<KeyT, ItemTs...>& base = *this;
+				base.nullify();
+				base.divy_buffer(mem + (sizeof(uint32_t) * (hashcap + 1)));
+			}
+
+			void detach() {
+				_soa_base<KeyT, ItemTs...>& base = *this;
+				base.nullify();
+				hashmap = nullptr;
+				hashcapacity = 0;
+				this->hashcursor = SIZE_MAX;
+				this->mycapacity = 0;
+				this->mysize = 0;
+			}
+		};
+
+		shared_view view;
+		void* mymap = nullptr;
+		shm_htable_header* myheader = nullptr;
+		size_t mymapped = 0;
+		bool mywritable = false;
+		size_t myerased = 0;
+
+		static inline size_t buffer_bytes(size_t capacity, size_t hashcapacity) {
+			return (sizeof(uint32_t) * (hashcapacity + 1)) + ((sizeof(KeyT) + (sizeof(ItemTs) + ... + 0)) * capacity);
+		}
+
+		// A fingerprint of the column sizes, so that memory isn't opened as the wrong kind of table.
+		static uint64_t column_signature() {
+			uint64_t result = 14695981039346656037ull;
+			for (size_t size : { sizeof(KeyT), sizeof(ItemTs)... }) { result ^= (uint64_t)size; result *= 1099511628211ull; }
+			return result;
+		}
+
+		bool map(int fd, size_t num_bytes, bool writable) {
+			int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+			void* mem = mmap(nullptr, num_bytes, protection, MAP_SHARED, fd, 0);
+			if (mem == MAP_FAILED) return false;
+			mymap = mem;
+			myheader = (shm_htable_header*)mem;
+			mymapped = num_bytes;
+			mywritable = writable;
+			return true;
+		}
+
+		// Sequence lock: the sequence is odd while a change is being made.
+		inline void begin_write() {
+			myheader->sequence.store(myheader->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+		}
+
+		inline void end_write() {
+			// Deleted markers pile up in the hashmap as entries are erased,
+			// and a lookup only stops at an empty slot, so clear them out before they can fill it.
+			if (myerased >= view.capacity()) {
+				view.rehash();
+				myerased = 0;
+			}
+			myheader->size.store(view.size(), std::memory_order_relaxed);
+			myheader->sequence.store(myheader->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		// Runs 'fn' until it completes without the writer changing anything in the meantime, and returns its result.
+		// Returns false without running it if the writer has died partway through a change.
+		template <typename Fn>
+		bool read_consistent(Fn fn) const {
+			for (size_t waits = 1; true; ++waits) {
+				uint64_t before = myheader->sequence.load(std::memory_order_acquire);
+				if (before & 1) {
+					// A change only takes a moment, so checking that the writer is still alive can wait until it's taken a while.
+					if (waits % WRITER_CHECK_WAITS == 0 && abandoned()) return false;
+					std::this_thread::yield();
+					continue;
+				}
+				bool result = fn();
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (myheader->sequence.load(std::memory_order_relaxed) == before) return result;
+			}
+		}
+
+		// Finds the index of the first entry with the given key, or SIZE_MAX.
+		// The writer may be changing the table underneath us, so nothing read from the hashmap is trusted:
+		// indices are bounds checked and the probe is limited, and 'read_consistent' discards the result if anything changed.
+		size_t locate(const KeyT& key) const {
+			const size_t hashcapacity = view.hashcapacity;
+			const size_t capacity = view.capacity();
+			const KeyT* keys = view.template data<0>();
+			size_t hash = std::hash<KeyT>{}(key) % hashcapacity;
+			for (size_t probes = 0; probes < hashcapacity; ++probes) {
+				uint32_t index = ((const volatile uint32_t*)view.hashmap)[hash];
+				if (index == shared_view::INDEXNUL) return SIZE_MAX;
+				if (index != shared_view::INDEXDEL && index < capacity && keys[index] == key) return index;
+				hash = (hash + 2) % hashcapacity;
+			}
+			return SIZE_MAX;
+		}
+
+		template <size_t... Ks>
+		inline void copy_items(size_t index, std::index_sequence<Ks...>, ItemTs&... items) const {
+			((items = view.template data<Ks + 1>()[index]), ...);
+		}
+
+		template <size_t... Ks, typename... Ts>
+		inline void assign_items(size_t index, std::index_sequence<Ks...>, Ts&&... items) {
+			((view.template data<Ks + 1>()[index] = std::forward<Ts>(items)), ...);
+		}
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SHMHTABLE_H
@@ -0,0 +1,114 @@
+#include "shm_htable.hpp"
+#include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <sys/wait.h>
+using namespace std;
+
+static const char* shm_test_name = "/hvh_shm_htable_test";
+
+bool shm_htable_test() {
+	printf("Testing shm_htable...\n");
+	bool success = true;
+
+	hvh::shm_htable<uint64_t, uint64_t, uint64_t> writer;
+	if (!writer.create(shm_test_name, 10000)) {
+		printf("Failed to create a shm_htable.\n");
+		return false;
+	}
+	for (uint64_t i = 0; i < 10000; ++i) writer.insert(i, i * 2, i * 3);
+	if (writer.insert(10000, 0, 0)) {
+		printf("Inserting into a full shm_htable should fail.\n");
+		success = false;
+	}
+
+	// A reader maps the table at a different address, and sees the same entries.
+	hvh::shm_htable<uint64_t, uint64_t, uint64_t> reader;
+	if (!reader.open(shm_test_name) || reader.size() != 10000) {
+		printf("Failed to open a shm_htable for reading.\n");
+		success = false;
+	}
+	uint64_t doubled = 0, tripled = 0;
+	if (!reader.find(1234, doubled, tripled) || doubled != 2468 || tripled != 3702 || reader.contains(20000)) {
+		printf("shm_htable reader found the wrong entries.\n");
+		success = false;
+	}
+	if (reader.insert(20000, 1, 1) || reader.erase(5)) {
+		printf("A read-only shm_htable should refuse changes.\n");
+		success = false;
+	}
+
+	// Readers on other threads always see entries which are consistent with each other,
+	// no matter what the writer is doing.
+	atomic<bool> done(false);
+	atomic<bool> torn(false);
+	thread readthread([&]() {
+		hvh::shm_htable<uint64_t, uint64_t, uint64_t> threadreader;
+		if (!threadreader.open(shm_test_name)) { torn = true; return; }
+		uint64_t key = 0;
+		while (!done) {
+			uint64_t a, b;
+			if (threadreader.find(key, a, b) && (a * 3 != b * 2)) torn = true;
+			key = (key + 7919) % 10000;
+		}
+	});
+	for (uint64_t round = 1; round < 200; ++round) {
+		for (uint64_t i = 0; i < 10000; i += 13) writer.assign(i, i * 2 * round, i * 3 * round);
+		for (uint64_t i = round; i < 10000; i += 97) writer.erase(i);
+		for (uint64_t i = round; i < 10000; i += 97) writer.insert(i, i * 2, i * 3);
+	}
+	done = true;
+	readthread.join();
+	if (torn) {
+		printf("shm_htable reader saw a torn entry.\n");
+		success = false;
+	}
+
+	// Attaching with the wrong column types must fail.
+	hvh::shm_htable<uint64_t, uint32_t> wrong;
+	if (wrong.open(shm_test_name)) {
+		printf("shm_htable should refuse to open a table with different column types.\n");
+		success = false;
+	}
+
+	// Creating the table again leaves readers of the old one looking at the old one.
+	hvh::shm_htable<uint64_t, uint64_t, uint64_t> replacement;
+	if (!replacement.create(shm_test_name, 100) || !reader.find(1234, doubled, tripled) || reader.capacity() != 10000) {
+		printf("Replacing a shm_htable should leave existing readers with the old table.\n");
+		success = false;
+	}
+	hvh::shm_htable<uint64_t, uint64_t, uint64_t> newreader;
+	if (!newreader.open(shm_test_name) || newreader.capacity() != 112 || newreader.size() != 0) {
+		printf("Opening a replaced shm_htable should find the new table.\n");
+		success = false;
+	}
+
+	// A writer which dies partway through a change mustn't leave readers waiting forever.
+	replacement.insert(1, 2, 3);
+	pid_t child = fork();
+	if (child == 0) {
+		hvh::shm_htable<uint64_t, uint64_t, uint64_t> doomed;
+		_exit(doomed.open(shm_test_name, true) ? 0 : 1);
+	}
+	int status = 0;
+	waitpid(child, &status, 0);
+	int fd = shm_open(shm_test_name, O_RDWR, 0);
+	hvh::shm_htable_header* header = (hvh::shm_htable_header*)mmap(nullptr, sizeof(hvh::shm_htable_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	header->sequence.fetch_add(1); // As if the child had died inside a change.
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !newreader.abandoned() || newreader.find(1, doubled, tripled) ||
+		newreader.contains(1)) {
+		printf("Readers should give up on a table whose writer died partway through a change.\n");
+		success = false;
+	}
+	hvh::shm_htable<uint64_t, uint64_t, uint64_t> rescuer;
+	if (rescuer.open(shm_test_name, true)) {
+		printf("A writer shouldn't be able to attach to a half-changed table.\n");
+		success = false;
+	}
+	munmap(header, sizeof(hvh::shm_htable_header));
+
+	hvh::shm_htable<uint64_t, uint64_t, uint64_t>::unlink(shm_test_name);
+	return success;
+}
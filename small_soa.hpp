@@ -0,0 +1,361 @@
+/* small_soa.hpp
+ * Struct-Of-Arrays and hash tables with inline storage for a few entries
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * An empty soa or htable costs nothing, but the first entry allocates room
+ * for at least 16, and an htable adds a hashmap on top of that.  When there
+ * are a great many containers which each hold only a handful of entries,
+ * that's mostly wasted memory and allocations.  small_soa and small_htable
+ * keep their first N entries in arrays inside the object itself, one per
+ * column just like soa, and only move to an ordinary soa or htable on the
+ * heap once they grow past N.  While they're small, small_htable has no
+ * hashmap at all: looking up a key scans the key column.
+ */
+#ifndef HVH_TOOLS_SMALLSOA_H
+#define HVH_TOOLS_SMALLSOA_H
+
+#include "htable.hpp"
+
+#include <new>
+#include <tuple>
+#include <utility>
+
+namespace hvh {
+
+	// Uninitialized room for N items of type T.
+	// The empty constructor keeps std::tuple from zeroing the bytes when it value-initializes a column.
+	template <size_t N, typename T>
+	struct _small_column {
+		_small_column() {}
+		alignas(T) unsigned char bytes[N * sizeof(T)];
+		inline T* data() { return std::launder(reinterpret_cast<T*>(bytes)); }
+		inline const T* data() const { return std::launder(reinterpret_cast<const T*>(bytes)); }
+	};
+
+	// Adding and erasing rows once the entries have moved to the heap.
+	// An soa pushes rows onto the back; an htable also puts them in its hashmap.
+	// Both erase by moving the last row into the erased row's place.
+	template <typename... Ts, typename... Args>
+	inline bool _small_append(soa<Ts...>& heap, Args&&... args) { return heap.push_back(std::forward<Args>(args)...); }
+	template <typename KeyT, typename... ItemTs, typename... Args>
+	inline bool _small_append(htable<KeyT, ItemTs...>& heap, Args&&... args) { return heap.insert(std::forward<Args>(args)...); }
+	template <typename... Ts>
+	inline size_t _small_erase(soa<Ts...>& heap, size_t index) {
+		if (index >= heap.size()) return 0;
+		heap.erase_swap(index);
+		return 1;
+	}
+	template <typename KeyT, typename... ItemTs>
+	inline size_t _small_erase(htable<KeyT, ItemTs...>& heap, size_t index) { return heap.erase_at(index); }
+
+	// The storage shared by small_soa and small_htable.
+	// Rows live in the inline columns until there are more than N of them, then in 'HeapT'.
+	// The columns and the heap container share the same bytes, since only one of them is ever in use,
+	// and the heap container is only constructed when the rows move to the heap.
+	template <size_t N, typename HeapT, typename... Ts>
+	class _small_rows {
+		static_assert(N > 0, "A small container needs room for at least 1 entry.");
+	public:
+
+		// inline_capacity
+		// How many entries fit inside the object.
+		static const size_t inline_capacity = N;
+
+		_small_rows() { start_inline(); }
+		_small_rows(const _small_rows& other) {
+			start_inline();
+			copy_from(other);
+		}
+		_small_rows(_small_rows&& other) {
+			start_inline();
+			move_from(other);
+		}
+		_small_rows& operator = (const _small_rows& other) {
+			if (this != &other) {
+				clear();
+				copy_from(other);
+			}
+			return *this;
+		}
+		_small_rows& operator = (_small_rows&& other) {
+			if (this != &other) {
+				clear();
+				move_from(other);
+			}
+			return *this;
+		}
+		~_small_rows() {
+			if (myspilled) myheap.~HeapT();
+			else destruct_inline();
+		}
+
+		// is_inline()
+		// Returns true if the entries are stored inside the object, false if they've moved to the heap.
+		inline bool is_inline() const { return !myspilled; }
+
+		// empty(), size(), capacity()
+		// As soa.  The capacity is N until the entries move to the heap.
+		inline bool empty() const { return size() == 0; }
+		inline size_t size() const { return myspilled ? myheap.size() : mysize; }
+		inline size_t capacity() const { return myspilled ? myheap.capacity() : N; }
+
+		// data<K>()
+		// Returns a pointer to the beginning of the Kth array, wherever it currently lives.
+		// Pointers are only good until the entries move to or from the heap.
+		template <size_t K>
+		inline auto* data() { return myspilled ? myheap.template data<K>() : std::get<K>(mycolumns).data(); }
+		template <size_t K>
+		inline const auto* data() const { return myspilled ? myheap.template data<K>() : std::get<K>(mycolumns).data(); }
+
+		// at<K>(i)
+		// Returns the ith item of the Kth array.
+		template <size_t K>
+		inline auto& at(size_t i) { return data<K>()[i]; }
+		template <size_t K>
+		inline const auto& at(size_t i) const { return data<K>()[i]; }
+
+		// reserve(n)
+		// Ensures that the container has enough space to hold n entries.
+		// If n is more than N, the entries move to the heap.
+		// Returns false if a memory allocation error occurs, true otherwise.
+		// Complexity: O(n).
+		bool reserve(size_t n) {
+			if (myspilled) return myheap.reserve(n);
+			if (n <= N) return true;
+			return spill(n);
+		}
+
+		// shrink_to_fit()
+		// If the entries are on the heap but would fit inside the object, moves them back and frees the heap memory.
+		// Otherwise, shrinks the heap container as its own 'shrink_to_fit' does.
+		// Returns false if a memory allocation error occurs, true otherwise.
+		// Complexity: O(n).
+		bool shrink_to_fit() {
+			if (!myspilled) return true;
+			if (myheap.size() > N) return myheap.shrink_to_fit();
+			// The columns overlap the heap container, so the rows are moved out of a local copy of it.
+			HeapT heap(std::move(myheap));
+			end_heap();
+			for (size_t i = 0; i < heap.size(); ++i) construct_inline(i, take_row(heap, i, std::index_sequence_for<Ts...>()));
+			mysize = heap.size();
+			return true;
+		}
+
+		// clear()
+		// Destructs every entry.  If the entries were on the heap, the heap memory is freed,
+		// and the container goes back to storing entries inside the object.
+		// Complexity: O(n).
+		void clear() {
+			if (myspilled) end_heap();
+			else destruct_inline();
+		}
+
+	protected:
+
+		// Adds a row, moving every row to the heap first if the inline columns are full.
+		template <typename... Args>
+		bool append(Args&&... args) {
+			if (!myspilled) {
+				if (mysize < N) {
+					construct_inline(mysize, std::forward_as_tuple(std::forward<Args>(args)...));
+					++mysize;
+					return true;
+				}
+				if (!spill(N * 2)) return false;
+			}
+			return _small_append(myheap, std::forward<Args>(args)...);
+		}
+
+		// Erases a row by moving the last row into its place.  Returns the number of rows erased (0 or 1).
+		size_t erase_row(size_t index) {
+			if (myspilled) return _small_erase(myheap, index);
+			if (index >= mysize) return 0;
+			--mysize;
+			if (index != mysize) move_row(index, mysize, std::index_sequence_for<Ts...>());
+			destruct_row(mysize, std::index_sequence_for<Ts...>());
+			return 1;
+		}
+
+		// Only 'mycolumns' is alive while the rows are inline, and only 'myheap' once they've moved to the heap.
+		union {
+			std::tuple<_small_column<N, Ts>...> mycolumns;
+			HeapT myheap;
+		};
+		size_t mysize = 0;
+		bool myspilled = false;
+
+		// An empty heap container, for 'heap()' to return while the rows are inline.
+		static inline const HeapT& empty_heap() {
+			static const HeapT empty;
+			return empty;
+		}
+
+	private:
+
+		// Switching between the two halves of the union.  The columns are trivially destructible, so
+		// nothing needs to be done to end them; mysize must be 0 before 'start_heap' is called.
+		inline void start_inline() { ::new ((void*)&mycolumns) std::tuple<_small_column<N, Ts>...>(); }
+		inline void start_heap(HeapT&& heap) {
+			::new ((void*)&myheap) HeapT(std::move(heap));
+			myspilled = true;
+		}
+		inline void end_heap() {
+			myheap.~HeapT();
+			myspilled = false;
+			start_inline();
+		}
+
+		// Moves every row into a new heap container with room for n.
+		bool spill(size_t n) {
+			HeapT heap;
+			if (!heap.reserve(n)) return false;
+			for (size_t i = 0; i < mysize; ++i) {
+				std::apply([&](auto&&... items) { _small_append(heap, std::move(items)...); }, take_row(*this, i, std::index_sequence_for<Ts...>()));
+			}
+			destruct_inline();
+			start_heap(std::move(heap));
+			return true;
+		}
+
+		template <typename RowsT, size_t... Is>
+		static inline auto take_row(RowsT& rows, size_t i, std::index_sequence<Is...>) {
+			return std::forward_as_tuple(std::move(rows.template at<Is>(i))...);
+		}
+
+		template <typename Tuple>
+		inline void construct_inline(size_t i, Tuple&& row) { construct_inline(i, std::forward<Tuple>(row), std::index_sequence_for<Ts...>()); }
+		template <typename Tuple, size_t... Is>
+		inline void construct_inline(size_t i, Tuple&& row, std::index_sequence<Is...>) {
+			(::new ((void*)(std::get<Is>(mycolumns).data() + i)) Ts(std::get<Is>(std::forward<Tuple>(row))), ...);
+		}
+		template <size_t... Is>
+		inline void move_row(size_t to, size_t from, std::index_sequence<Is...>) {
+			((std::get<Is>(mycolumns).data()[to] = std::move(std::get<Is>(mycolumns).data()[from])), ...);
+		}
+		template <size_t... Is>
+		inline void destruct_row(size_t i, std::index_sequence<Is...>) {
+			(std::get<Is>(mycolumns).data()[i].~Ts(), ...);
+		}
+		inline void destruct_inline() {
+			for (size_t i = 0; i < mysize; ++i) destruct_row(i, std::index_sequence_for<Ts...>());
+			mysize = 0;
+		}
+
+		void copy_from(const _small_rows& other) {
+			if (other.myspilled) {
+				start_heap(HeapT(other.myheap));
+				return;
+			}
+			for (size_t i = 0; i < other.mysize; ++i) construct_inline(i, copy_row(other, i, std::index_sequence_for<Ts...>()));
+			mysize = other.mysize;
+		}
+		template <size_t... Is>
+		static inline auto copy_row(const _small_rows& rows, size_t i, std::index_sequence<Is...>) {
+			return std::forward_as_tuple(rows.template at<Is>(i)...);
+		}
+		void move_from(_small_rows& other) {
+			if (other.myspilled) {
+				start_heap(std::move(other.myheap));
+				other.end_heap();
+				return;
+			}
+			for (size_t i = 0; i < other.mysize; ++i) construct_inline(i, take_row(other, i, std::index_sequence_for<Ts...>()));
+			mysize = other.mysize;
+			other.destruct_inline();
+		}
+	};
+
+	template <size_t N, typename... Ts>
+	class small_soa : public _small_rows<N, soa<Ts...>, Ts...> {
+	public:
+
+		// push_back(args...)
+		// Adds an entry at the back of each array.  The (N+1)th entry moves every entry to the heap.
+		// Returns false if a memory allocation error occurs, true otherwise.
+		// Complexity: O(1) unless the entries move to the heap, then O(n).
+		template <typename... Args>
+		inline bool push_back(Args&&... args) {
+			static_assert(sizeof...(Args) == sizeof...(Ts), "push_back takes one item for every array.");
+			return this->append(std::forward<Args>(args)...);
+		}
+
+		// pop_back()
+		// Destructs the items at the back of the arrays.
+		// Complexity: O(1).
+		inline void pop_back() { if (this->size()) this->erase_row(this->size() - 1); }
+
+		// erase_swap(where)
+		// Moves the last entry into 'where', then destructs the last entry, as soa does.
+		// Complexity: O(1).
+		inline void erase_swap(size_t where) { this->erase_row(where); }
+
+		// heap()
+		// Returns the soa that holds the entries once they've moved to the heap.  It's empty until then.
+		inline const soa<Ts...>& heap() const { return this->myspilled ? this->myheap : this->empty_heap(); }
+	};
+
+	template <size_t N, typename KeyT, typename... ItemTs>
+	class small_htable : public _small_rows<N, htable<KeyT, ItemTs...>, KeyT, ItemTs...> {
+	public:
+
+		// insert(key, items...)
+		// Inserts a new entry.  Like htable, several entries may share a key.
+		// The (N+1)th entry moves every entry to an htable on the heap.
+		// Returns false if a memory allocation error occurs, true otherwise.
+		// Complexity: O(1) unless the entries move to the heap, then O(n).
+		template <typename... Ts>
+		inline bool insert(const KeyT& key, Ts&&... items) {
+			static_assert(sizeof...(Ts) == sizeof...(ItemTs), "insert takes one item for every array.");
+			return this->append(key, std::forward<Ts>(items)...);
+		}
+
+		// find(key)
+		// Returns the index of the first entry with the indicated key, or SIZE_MAX if there isn't one.
+		// While the entries are inline, the key column is scanned from the front.  For a handful of keys that's
+		// quicker than hashing; a branchless scan which compares every key was measured to be slower.
+		// Complexity: O(N) while inline, O(1) amortized after.
+		size_t find(const KeyT& key) const {
+			if (this->myspilled) return this->myheap.find(key);
+			const KeyT* keys = std::get<0>(this->mycolumns).data();
+			for (size_t i = 0; i < this->mysize; ++i) {
+				if (keys[i] == key) return i;
+			}
+			return SIZE_MAX;
+		}
+
+		// contains(key), count(key)
+		// Return whether any entry has the indicated key, and how many do.
+		inline bool contains(const KeyT& key) const { return find(key) != SIZE_MAX; }
+		size_t count(const KeyT& key) const {
+			if (this->myspilled) return this->myheap.count(key);
+			const KeyT* keys = std::get<0>(this->mycolumns).data();
+			size_t result = 0;
+			for (size_t i = 0; i < this->mysize; ++i) result += (keys[i] == key);
+			return result;
+		}
+
+		// erase(key), erase_all(key), erase_at(index)
+		// As htable: the last entry is moved into each erased entry's place.
+		// Each returns the number of entries erased.
+		// Complexity: O(N) while inline, O(1) amortized after.
+		inline size_t erase(const KeyT& key) {
+			size_t index = find(key);
+			return (index == SIZE_MAX) ? 0 : this->erase_row(index);
+		}
+		inline size_t erase_all(const KeyT& key) {
+			if (this->myspilled) return this->myheap.erase_all(key);
+			size_t result = 0;
+			for (size_t index = find(key); index != SIZE_MAX; index = find(key)) result += this->erase_row(index);
+			return result;
+		}
+		inline size_t erase_at(size_t index) { return this->erase_row(index); }
+
+		// heap()
+		// Returns the htable that holds the entries once they've moved to the heap.  It's empty until then.
+		inline const htable<KeyT, ItemTs...>& heap() const { return this->myspilled ? this->myheap : this->empty_heap(); }
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SMALLSOA_H
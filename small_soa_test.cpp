@@ -0,0 +1,132 @@
+#include "small_soa.hpp"
+#include <string>
+#include <algorithm>
+#include <cstdio>
+using namespace std;
+
+// Checks that every key in [0, n) except 'missing' can be found, with the right item.
+static bool check_entries(const hvh::small_htable<4, int, string>& table, int n, int missing, const char* when) {
+	if (table.size() != (size_t)(n - (missing >= 0))) {
+		printf("%s, the table holds %zi entries.\n", when, table.size());
+		return false;
+	}
+	for (int key = 0; key < n; ++key) {
+		size_t index = table.find(key);
+		if (key == missing) {
+			if (index != SIZE_MAX) {
+				printf("%s, erased key %i can still be found.\n", when, key);
+				return false;
+			}
+		}
+		else if (index == SIZE_MAX || table.at<1>(index) != to_string(key)) {
+			printf("%s, key %i can't be found or has the wrong item.\n", when, key);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool small_soa_test() {
+	printf("Testing small_soa...\n");
+	bool success = true;
+
+	// Up to N entries live inside the object.
+	hvh::small_htable<4, int, string> table;
+	for (int i = 0; i < 4; ++i) table.insert(i, to_string(i));
+	if (!table.is_inline() || table.heap().capacity() != 0 || table.capacity() != 4) {
+		printf("A small_htable of 4 holding 4 entries should not have allocated.\n");
+		success = false;
+	}
+	success &= check_entries(table, 4, -1, "Inline");
+
+	// The inline entries share their bytes with the htable they move to.
+	const size_t inline_bytes = 4 * (sizeof(int) + sizeof(string));
+	if (sizeof(table) > std::max(inline_bytes, sizeof(hvh::htable<int, string>)) + (2 * sizeof(size_t))) {
+		printf("A small_htable of 4 is %zi bytes, but should overlap its entries and its htable.\n", sizeof(table));
+		success = false;
+	}
+	if (table.find(4) != SIZE_MAX || table.count(2) != 1) {
+		printf("Inline lookups are wrong.\n");
+		success = false;
+	}
+
+	// Erasing moves the last entry into the gap, as htable does.
+	hvh::small_htable<4, int, string> erased = table;
+	if (erased.erase(1) != 1 || erased.erase(1) != 0 || erased.at<0>(1) != 3) {
+		printf("Erasing inline should move the last entry into the erased entry's place.\n");
+		success = false;
+	}
+	success &= check_entries(erased, 4, 1, "After erasing inline");
+	success &= check_entries(table, 4, -1, "After erasing from a copy");
+
+	// The 5th entry moves everything into an htable.
+	table.insert(4, string("4"));
+	if (table.is_inline() || table.heap().size() != 5) {
+		printf("The 5th entry should have moved the entries to the heap.\n");
+		success = false;
+	}
+	for (int i = 5; i < 100; ++i) table.insert(i, to_string(i));
+	success &= check_entries(table, 100, -1, "On the heap");
+
+	// Copies and moves of a table on the heap.
+	hvh::small_htable<4, int, string> copy = table;
+	hvh::small_htable<4, int, string> moved = std::move(copy);
+	success &= check_entries(moved, 100, -1, "After copying and moving");
+	if (!copy.empty() || !copy.is_inline()) {
+		printf("A moved-from table should be empty and inline.\n");
+		success = false;
+	}
+
+	// Shrinking back down to N entries moves them back inside the object.
+	for (int i = 3; i < 100; ++i) moved.erase(i);
+	moved.insert(3, string("3"));
+	if (moved.is_inline() || !moved.shrink_to_fit() || !moved.is_inline() || moved.heap().capacity() != 0) {
+		printf("shrink_to_fit should move 4 entries back inline.\n");
+		success = false;
+	}
+	success &= check_entries(moved, 4, -1, "After shrinking");
+
+	// Duplicate keys, inline and on the heap.
+	hvh::small_htable<8, uint64_t, double> duplicates;
+	for (uint64_t i = 0; i < 6; ++i) duplicates.insert(i % 3, i * 0.5);
+	if (duplicates.count(1) != 2 || duplicates.erase_all(1) != 2 || duplicates.contains(1) || duplicates.size() != 4) {
+		printf("Duplicate keys should be counted and erased together while inline.\n");
+		success = false;
+	}
+	for (uint64_t i = 0; i < 20; ++i) duplicates.insert(7, (double)i);
+	if (duplicates.is_inline() || duplicates.count(7) != 20 || duplicates.erase_all(7) != 20 || duplicates.size() != 4) {
+		printf("Duplicate keys should be counted and erased together on the heap.\n");
+		success = false;
+	}
+	duplicates.clear();
+	if (!duplicates.is_inline() || duplicates.size() != 0 || duplicates.heap().capacity() != 0) {
+		printf("clear should free the heap and go back inline.\n");
+		success = false;
+	}
+
+	// small_soa behaves like soa.
+	hvh::small_soa<3, string, int> rows;
+	rows.push_back(string("a"), 1);
+	rows.push_back(string("b"), 2);
+	rows.push_back(string("c"), 3);
+	rows.erase_swap(0);
+	if (!rows.is_inline() || rows.size() != 2 || rows.at<0>(0) != "c" || rows.data<1>()[1] != 2) {
+		printf("small_soa's inline rows are wrong.\n");
+		success = false;
+	}
+	for (int i = 0; i < 10; ++i) rows.push_back(to_string(i), i);
+	rows.pop_back();
+	if (rows.is_inline() || rows.size() != 11 || rows.at<0>(10) != "8" || rows.heap().size() != 11) {
+		printf("small_soa's rows on the heap are wrong.\n");
+		success = false;
+	}
+	hvh::small_soa<3, string, int> assigned;
+	assigned.push_back(string("x"), 0);
+	assigned = rows;
+	if (assigned.size() != 11 || assigned.at<0>(1) != "b" || rows.size() != 11) {
+		printf("Assigning a small_soa should copy its rows.\n");
+		success = false;
+	}
+
+	return success;
+}
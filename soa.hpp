@@ -20,6 +20,15 @@
 #include <tuple>
 #include <functional>
 #include <vector>
+#include <new> // For placement new
+#include <type_traits>
+#include <atomic>
+#include <chrono> // For timing trace events
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 
 /******************************************************************************
@@ -45,11 +54,273 @@
 
 namespace hvh {
 
+	// 'copy_from' hands each task roughly this many bytes of rows at a time.
+	// Big enough that starting a task costs nothing next to the copy itself.
+	static constexpr size_t SOA_COPY_CHUNK_BYTES = 1 << 20;
+
+	// soa_allocator
+	// Lets an soa or htable get its buffer from somewhere other than the heap.
+	// A container uses the heap (via _soa_aligned_malloc) unless it's given an allocator with 'set_allocator'.
+	// The allocator must outlive every container which uses it.
+	struct soa_allocator {
+		// Returns a buffer of at least num_bytes bytes, aligned to at least 16 bytes, or nullptr on failure.
+		void* (*allocate)(void* context, size_t num_bytes) = nullptr;
+		// Releases a buffer which was returned by 'allocate' or 'clone'.
+		void (*deallocate)(void* context, void* mem, size_t num_bytes) = nullptr;
+		// Optional.  Returns a new buffer with the same contents as 'mem' (usually by sharing its pages copy-on-write),
+		// or nullptr if that isn't possible right now.  Used by 'clone'.
+		void* (*clone)(void* context, void* mem, size_t num_bytes) = nullptr;
+		// Optional.  Resizes a buffer, keeping its first min(old_bytes, new_bytes) bytes, and returns where it now lives.
+		// Returns nullptr on failure, in which case the buffer is left as it was.
+		// When present, containers of trivially copyable types grow and shrink in place rather than allocating a second buffer and copying.
+		void* (*reallocate)(void* context, void* mem, size_t old_bytes, size_t new_bytes) = nullptr;
+		// Passed to each of the above.
+		void* context = nullptr;
+	};
+
+	// soa_trace_kind
+	// What a container was doing when it reported a trace event.
+	enum class soa_trace_kind { allocate, reallocate, free, reserve, shrink_to_fit, rehash };
+
+	// soa_trace_event
+	// Describes one buffer allocation, reallocation, or free, or one reserve, shrink_to_fit, or rehash which did any work.
+	struct soa_trace_event {
+		soa_trace_kind kind;
+		// The container which did it.
+		const void* container;
+		// The number of bytes allocated, reallocated to, or freed; for the others, the size of the container's buffer afterwards.
+		size_t bytes;
+		// The container's capacity before and after.  Allocations and frees happen part-way through a reserve,
+		// so for those both are the capacity at the time.
+		size_t old_capacity;
+		size_t new_capacity;
+		// When it started, in seconds since std::chrono::steady_clock's epoch, and how long it took.
+		double start;
+		double seconds;
+	};
+
+	// soa_trace_sink
+	// Receives trace events from every soa and htable while it's installed with 'set_trace_sink'.
+	// 'record' is called on the thread which did the work, as soon as it's finished,
+	// so it must be safe to call from several threads at once, and should be quick.
+	struct soa_trace_sink {
+		void (*record)(void* context, const soa_trace_event& event) = nullptr;
+		// Passed to 'record'.
+		void* context = nullptr;
+	};
+
+	inline std::atomic<const soa_trace_sink*>& _soa_trace_sink() {
+		static std::atomic<const soa_trace_sink*> sink{ nullptr };
+		return sink;
+	}
+
+	// set_trace_sink(sink)
+	// Sends trace events from every container to 'sink', or stops tracing if it's nullptr.
+	// The sink must stay alive until it's been replaced and any containers still using it have finished.
+	inline void set_trace_sink(const soa_trace_sink* sink) { _soa_trace_sink().store(sink, std::memory_order_release); }
+
+	// get_trace_sink()
+	// Returns the trace sink that's currently installed, or nullptr.
+	inline const soa_trace_sink* get_trace_sink() { return _soa_trace_sink().load(std::memory_order_acquire); }
+
+	// Times the scope it's declared in, and reports it to the trace sink (if any) when the scope ends.
+	// 'capacity' is read at both ends, and bytes() gives the event's byte count at the end.
+	// When there's no sink, this costs one atomic load.
+	template <typename BytesFn>
+	class _soa_trace_scope {
+	public:
+		_soa_trace_scope(soa_trace_kind kind, const void* container, const size_t& capacity, BytesFn bytes)
+			: sink(get_trace_sink()), kind(kind), container(container), capacity(capacity), bytes(bytes) {
+			if (!sink) return;
+			old_capacity = capacity;
+			start = std::chrono::steady_clock::now();
+		}
+		~_soa_trace_scope() {
+			if (!sink || !sink->record) return;
+			const auto end = std::chrono::steady_clock::now();
+			soa_trace_event event;
+			event.kind = kind;
+			event.container = container;
+			event.bytes = bytes();
+			event.old_capacity = old_capacity;
+			event.new_capacity = capacity;
+			event.start = std::chrono::duration<double>(start.time_since_epoch()).count();
+			event.seconds = std::chrono::duration<double>(end - start).count();
+			sink->record(sink->context, event);
+		}
+		_soa_trace_scope(const _soa_trace_scope&) = delete;
+		_soa_trace_scope& operator=(const _soa_trace_scope&) = delete;
+
+	private:
+		const soa_trace_sink* sink;
+		soa_trace_kind kind;
+		const void* container;
+		const size_t& capacity;
+		BytesFn bytes;
+		size_t old_capacity = 0;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	template <typename BytesFn>
+	inline _soa_trace_scope<BytesFn> _soa_trace(soa_trace_kind kind, const void* container, const size_t& capacity, BytesFn bytes) {
+		return _soa_trace_scope<BytesFn>(kind, container, capacity, bytes);
+	}
+
+	// thread_pool
+	// A fixed set of threads which run batches of tasks, stealing work from each other as needed.
+	// The thread which calls 'run' works on the batch too, so a pool of size N starts N - 1 threads.
+	// 'run' may be called from inside a task; the calling thread keeps working until its own batch is finished.
+	class thread_pool {
+	public:
+		// thread_pool(num_threads)
+		// Creates a pool which runs tasks on 'num_threads' threads, counting the caller.  0 uses one per core.
+		explicit thread_pool(size_t num_threads = 0) {
+			if (num_threads == 0) num_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+			mynumqueues = num_threads;
+			myqueues.reset(new queue[num_threads]);
+			mythreads.reserve(num_threads - 1);
+			for (size_t i = 1; i < num_threads; ++i) mythreads.emplace_back([this, i]() { work(i); });
+		}
+
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator = (const thread_pool&) = delete;
+
+		// ~thread_pool()
+		// Waits for the threads to finish whatever they're doing, then stops them.
+		~thread_pool() {
+			{
+				std::lock_guard<std::mutex> lock(mysleepmutex);
+				mystopping = true;
+			}
+			mysleepcv.notify_all();
+			for (auto& thread : mythreads) thread.join();
+		}
+
+		// size()
+		// Returns the number of threads which run tasks, counting the caller.
+		inline size_t size() const { return mynumqueues; }
+
+		// run(num_tasks, fn)
+		// Calls fn(i) for every i in [0, num_tasks), spread across the pool, and waits for them all to finish.
+		// Neighbouring tasks start out on the same thread.
+		template <typename Fn>
+		void run(size_t num_tasks, Fn&& fn) {
+			if (num_tasks == 0) return;
+			if (num_tasks == 1 || mynumqueues == 1) {
+				for (size_t i = 0; i < num_tasks; ++i) fn(i);
+				return;
+			}
+
+			batch work;
+			work.call = [](void* context, size_t i) { (*(typename std::remove_reference<Fn>::type*)context)(i); };
+			work.context = (void*)&fn;
+			work.remaining.store(num_tasks, std::memory_order_relaxed);
+
+			// Deal the tasks out in contiguous blocks, counting them first so that the count never goes negative.
+			{
+				std::lock_guard<std::mutex> lock(mysleepmutex);
+				myqueued.fetch_add(num_tasks, std::memory_order_relaxed);
+			}
+			for (size_t q = 0; q < mynumqueues; ++q) {
+				size_t begin = (num_tasks * q) / mynumqueues;
+				size_t end = (num_tasks * (q + 1)) / mynumqueues;
+				if (begin == end) continue;
+				std::lock_guard<std::mutex> lock(myqueues[q].mutex);
+				for (size_t i = begin; i < end; ++i) myqueues[q].tasks.push_back(task{ &work, i });
+			}
+			mysleepcv.notify_all();
+
+			// Help out until our own batch is done.
+			size_t home = (current_pool == this) ? current_index : 0;
+			while (work.remaining.load(std::memory_order_acquire) > 0) {
+				if (!run_one(home)) std::this_thread::yield();
+			}
+		}
+
+	private:
+		struct batch {
+			void (*call)(void* context, size_t i);
+			void* context;
+			std::atomic<size_t> remaining;
+		};
+
+		struct task {
+			batch* work;
+			size_t index;
+		};
+
+		struct queue {
+			std::mutex mutex;
+			std::deque<task> tasks;
+		};
+
+		std::unique_ptr<queue[]> myqueues;
+		size_t mynumqueues = 0;
+		std::vector<std::thread> mythreads;
+		std::mutex mysleepmutex;
+		std::condition_variable mysleepcv;
+		std::atomic<size_t> myqueued{ 0 };
+		bool mystopping = false;
+
+		// Which pool (if any) the current thread works for, and which queue is its own.
+		static inline thread_local thread_pool* current_pool = nullptr;
+		static inline thread_local size_t current_index = 0;
+
+		// Runs one task: the newest from our own queue, or failing that, the oldest from somebody else's.
+		// Returns false if there was nothing to do.
+		bool run_one(size_t home) {
+			task next;
+			bool found = false;
+			{
+				queue& own = myqueues[home];
+				std::lock_guard<std::mutex> lock(own.mutex);
+				if (!own.tasks.empty()) {
+					next = own.tasks.back();
+					own.tasks.pop_back();
+					found = true;
+				}
+			}
+			for (size_t offset = 1; !found && offset < mynumqueues; ++offset) {
+				queue& victim = myqueues[(home + offset) % mynumqueues];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (!victim.tasks.empty()) {
+					next = victim.tasks.front();
+					victim.tasks.pop_front();
+					found = true;
+				}
+			}
+			if (!found) return false;
+			myqueued.fetch_sub(1, std::memory_order_relaxed);
+			next.work->call(next.work->context, next.index);
+			next.work->remaining.fetch_sub(1, std::memory_order_acq_rel);
+			return true;
+		}
+
+		void work(size_t index) {
+			current_pool = this;
+			current_index = index;
+			while (true) {
+				if (run_one(index)) continue;
+				std::unique_lock<std::mutex> lock(mysleepmutex);
+				mysleepcv.wait(lock, [this]() { return mystopping || myqueued.load(std::memory_order_acquire) > 0; });
+				if (mystopping && myqueued.load(std::memory_order_acquire) == 0) return;
+			}
+		}
+	};
+
+	// default_thread_pool()
+	// Returns a pool with one thread per core, which is started the first time it's needed.
+	inline thread_pool& default_thread_pool() {
+		static thread_pool pool;
+		return pool;
+	}
+
 	template <typename... Ts>
 	class _soa_base {
 	public:
 		inline size_t constexpr size_per_entry() const { return 0; }
 		inline void nullify() {}
+		inline void relayout(char*, size_t, size_t, size_t) {}
 		inline void construct_range(size_t, size_t) {}
 		inline void destruct_range(size_t, size_t) {}
 		inline void divy_buffer(void*) {}
@@ -64,6 +335,7 @@ namespace hvh {
 		inline void erase_shift(size_t) {}
 		friend inline void swap(_soa_base<Ts...>& lhs, _soa_base<Ts...>& rhs) { std::swap(lhs.mysize, rhs.mysize); std::swap(lhs.mycapacity, rhs.mycapacity); }
 		inline void copy(const _soa_base<Ts...>& other) { mysize = other.mysize; }
+		inline void copy_range(const _soa_base<Ts...>&, size_t, size_t) {}
 		inline void swap_entries(size_t, size_t) {}
 		inline std::tuple<> make_row_tuple(size_t) const { return std::tuple<>(); }
 
@@ -123,7 +395,7 @@ namespace hvh {
 		// As a reference to the internal array, the result will remain valid even after a reallocation.
 		template <size_t K>
 		typename std::enable_if<K != 0, const typename elem_type_holder<K, _soa_base<FT, RTs...>>::type* const&>::type
-			inline data() const { _soa_base<RTs...>& base = *this; return base.template data<K - 1>(); }
+			inline data() const { const _soa_base<RTs...>& base = *this; return base.template data<K - 1>(); }
 
 		// at<K>(i)
 		// Gets a reference to the ith item of the Kth array.
@@ -151,7 +423,7 @@ namespace hvh {
 		// Does not perform bounds checking; do not use with an out-of-bounds index!
 		template <size_t K>
 		typename std::enable_if<K != 0, const typename elem_type_holder<K, _soa_base<FT, RTs...>>::type&>::type
-			inline at(size_t index) const { _soa_base<RTs...>& base = *this; return base.template at<K - 1>(index); }
+			inline at(size_t index) const { const _soa_base<RTs...>& base = *this; return base.template at<K - 1>(index); }
 
 		// front<K>()
 		// Gets a reference to the item at the front of the Kth array.
@@ -179,7 +451,7 @@ namespace hvh {
 		// Does not perform bounds checking; do not call on an empty container!
 		template <size_t K>
 		typename std::enable_if<K != 0, const typename elem_type_holder<K, _soa_base<FT, RTs...>>::type&>::type
-			inline front() const { _soa_base<RTs...>& base = *this; return base.template front<K - 1>(); }
+			inline front() const { const _soa_base<RTs...>& base = *this; return base.template front<K - 1>(); }
 
 		// back<K>()
 		// Gets a reference to the item at the back of the Kth array.
@@ -207,7 +479,7 @@ namespace hvh {
 		// Does not perform bounds checking; do not call on an empty container!
 		template <size_t K>
 		typename std::enable_if<K != 0, const typename elem_type_holder<K, _soa_base<FT, RTs...>>::type&>::type
-			inline back() const { _soa_base<RTs...>& base = *this; return base.template back<K - 1>(); }
+			inline back() const { const _soa_base<RTs...>& base = *this; return base.template back<K - 1>(); }
 
 		// lower_bound<K>(goal)
 		// Performs a binary search looking for 'goal' in sorted array 'K'.
@@ -346,15 +618,51 @@ namespace hvh {
 			base.destruct_range(begin, end);
 		}
 
+		// relocate moves 'count' entries from 'src' to 'dst', which are allowed to overlap.
+		// Trivially copyable types are simply memmove'd.  Anything else is move-constructed
+		// into its new home and then destructed, since types like std::string may hold
+		// pointers into themselves and cannot survive being copied bytewise.
+		static inline void relocate(FT* dst, FT* src, size_t count) {
+			if (dst == src || count == 0) return;
+			if constexpr (std::is_trivially_copyable<FT>::value) {
+				memmove(dst, src, sizeof(FT) * count);
+			}
+			else if (dst < src) {
+				for (size_t i = 0; i < count; ++i) {
+					new (&dst[i]) FT(std::move(src[i]));
+					src[i].~FT();
+				}
+			}
+			else {
+				for (size_t i = count; i > 0; --i) {
+					new (&dst[i - 1]) FT(std::move(src[i - 1]));
+					src[i - 1].~FT();
+				}
+			}
+		}
+
 		// divy_buffer splits a big buffer of memory into a series of column arrays.
-		// This also copies existing data into the new memory buffer.
+		// This also moves existing data into the new memory buffer.
 		inline void divy_buffer(void* newmem) {
-			if (mydata) { memcpy(newmem, mydata, sizeof(FT) * std::min(this->mysize, this->mycapacity)); }
+			if (mydata) { relocate((FT*)newmem, mydata, std::min(this->mysize, this->mycapacity)); }
 			mydata = (FT*)newmem;
 			_soa_base<RTs...>& base = *this;
 			base.divy_buffer(((FT*)newmem) + this->mycapacity);
 		}
 
+		// relayout moves every column within a single buffer, from where it sits at 'oldcapacity' to where it belongs at the current capacity.
+		// The columns start at 'oldoffset' and 'newoffset' bytes into the buffer respectively.
+		// When columns move up, the last one is moved first (and vice versa), so that nothing is overwritten before it has been moved.
+		inline void relayout(char* mem, size_t oldoffset, size_t newoffset, size_t oldcapacity) {
+			_soa_base<RTs...>& base = *this;
+			size_t nextold = oldoffset + (sizeof(FT) * oldcapacity);
+			size_t nextnew = newoffset + (sizeof(FT) * this->mycapacity);
+			if (newoffset > oldoffset) base.relayout(mem, nextold, nextnew, oldcapacity);
+			relocate((FT*)(mem + newoffset), (FT*)(mem + oldoffset), this->mysize);
+			mydata = (FT*)(mem + newoffset);
+			if (newoffset <= oldoffset) base.relayout(mem, nextold, nextnew, oldcapacity);
+		}
+
 		// push_back copies a row onto the back of the container.
 		template <typename FirstType = FT, typename... RestTypes>
 		typename std::enable_if<std::is_copy_constructible<FirstType>::value, void>::type inline push_back(const FirstType& first, RestTypes&&... rest) {
@@ -413,7 +721,7 @@ namespace hvh {
 		// inserts (copies) a row at the specified index, moving later entries back by one.
 		template <typename FirstType = FT, typename... RestTypes>
 		typename std::enable_if<std::is_copy_constructible<FirstType>::value, void>::type inline insert(size_t location, const FirstType& first, RestTypes&& ... rest) {
-			memmove(mydata + (location + 1), mydata + location, sizeof(FT) * (this->mysize - location));
+			relocate(mydata + (location + 1), mydata + location, this->mysize - location);
 			new (&mydata[location]) FT(first);
 			_soa_base<RTs...>& base = *this;
 			base.insert(location, rest...);
@@ -422,7 +730,7 @@ namespace hvh {
 		// inserts (moves) a row at the specified index, moving later entries back by one.
 		template <typename FirstType = FT, typename... RestTypes>
 		typename std::enable_if<std::is_move_constructible<FirstType>::value, void>::type inline insert(size_t location, FirstType&& first, RestTypes&& ... rest) {
-			memmove(mydata + (location + 1), mydata + location, sizeof(FT) * (this->mysize - location));
+			relocate(mydata + (location + 1), mydata + location, this->mysize - location);
 			new (&mydata[location]) FT(std::move(first));
 			_soa_base<RTs...>& base = *this;
 			base.insert(location, rest...);
@@ -431,7 +739,7 @@ namespace hvh {
 		// emplace using a single argument to copy-construct the object.
 		template <typename FirstType, typename... RestTypes>
 		typename std::enable_if<std::is_copy_constructible<FirstType>::value, void>::type inline emplace(size_t location, const FirstType& first, RestTypes&& ... rest) {
-			memmove(mydata + (location + 1), mydata + location, sizeof(FT) * (this->mysize - location));
+			relocate(mydata + (location + 1), mydata + location, this->mysize - location);
 			new (&mydata[location]) FT(first);
 			_soa_base<RTs...>& base = *this;
 			base.emplace_back(location, rest...);
@@ -440,7 +748,7 @@ namespace hvh {
 		// emplace using a single argument to move-construct the object.
 		template <typename FirstType, typename... RestTypes>
 		typename std::enable_if<std::is_move_constructible<FirstType>::value, void>::type inline emplace(size_t location, FirstType&& first, RestTypes&& ... rest) {
-			memmove(mydata + (location + 1), mydata + location, sizeof(FT) * (this->mysize - location));
+			relocate(mydata + (location + 1), mydata + location, this->mysize - location);
 			new (&mydata[location]) FT(first);
 			_soa_base<RTs...>& base = *this;
 			base.emplace_back(location, rest...);
@@ -449,7 +757,7 @@ namespace hvh {
 		// emplace using no arguments to construct the object.
 		template <typename... RestTypes>
 		inline void emplace(size_t location, decltype(std::ignore), RestTypes&& ... rest) {
-			memmove(mydata + (location + 1), mydata + location, sizeof(FT) * (this->mysize - location));
+			relocate(mydata + (location + 1), mydata + location, this->mysize - location);
 			new (&mydata[location]) FT();
 			_soa_base<RTs...>& base = *this;
 			base.emplace_back(location, rest...);
@@ -458,7 +766,7 @@ namespace hvh {
 		// emplace using multiple arguments to construct the object.
 		template <typename... FirstTypes, typename... RestTypes>
 		inline void emplace(size_t location, const std::tuple<FirstTypes...>& first, RestTypes&& ... rest) {
-			memmove(mydata + (location + 1), mydata + location, sizeof(FT) * (this->mysize - location));
+			relocate(mydata + (location + 1), mydata + location, this->mysize - location);
 			std::apply([=](const FirstTypes& ... args) {new (&mydata[location]) FT(args...); }, first);
 			_soa_base<RTs...>& base = *this;
 			base.emplace_back(location, rest...);
@@ -466,7 +774,7 @@ namespace hvh {
 
 		// emplace using all default constructors.
 		inline void emplace_default(size_t location) {
-			memmove(mydata + (location + 1), mydata + location, sizeof(FT) * (this->mysize - location));
+			relocate(mydata + (location + 1), mydata + location, this->mysize - location);
 			new (&mydata[location]) FT();
 			_soa_base<RTs...>& base = *this;
 			base.emplace_back(location);
@@ -491,7 +799,7 @@ namespace hvh {
 		// erase_shift removes the given row, and move all further rows forward by one.
 		inline void erase_shift(size_t location) {
 			mydata[location].~FT();
-			memmove(mydata + location, mydata + (location + 1), sizeof(FT) * (this->mysize - location));
+			relocate(mydata + location, mydata + (location + 1), this->mysize - location - 1);
 			_soa_base<RTs...>& base = *this;
 			base.erase_shift(location);
 		}
@@ -507,10 +815,23 @@ namespace hvh {
 
 		// performs a deep copy.
 		inline void copy(const _soa_base<FT, RTs...>& other) {
-			memcpy(mydata, other.mydata, sizeof(FT) * other.mysize);
+			copy_range(other, 0, other.mysize);
+			this->mysize = other.mysize;
+		}
+
+		// copy-constructs rows [begin, end) from the same rows of 'other', into memory which holds no objects yet.
+		// Trivially copyable types are simply memcpy'd.
+		inline void copy_range(const _soa_base<FT, RTs...>& other, size_t begin, size_t end) {
+			if (begin >= end) return;
+			if constexpr (std::is_trivially_copyable<FT>::value) {
+				memcpy(mydata + begin, other.mydata + begin, sizeof(FT) * (end - begin));
+			}
+			else {
+				for (size_t i = begin; i < end; ++i) new (&mydata[i]) FT(other.mydata[i]);
+			}
 			_soa_base<RTs...>& lhs = *this;
 			const _soa_base<RTs...>& rhs = other;
-			lhs.copy(rhs);
+			lhs.copy_range(rhs, begin, end);
 		}
 
 		// swaps the position of two indicated rows.
@@ -575,7 +896,7 @@ namespace hvh {
 		// Move constructor for Struct-Of-Arrays.
 		// Moves the contents from the rhs struct-of-arrays into ourselves.
 		// Complexity: O(1).
-		soa(soa<Ts...>&& other) { swap(other); }
+		soa(soa<Ts...>&& other) { swap(*this, other); }
 		// soa(const& rhs)
 		// Copy constructor for Struct-Of-Arrays.
 		// Copies the contents from the rhs struct-of-arrays into ourselves.
@@ -583,19 +904,19 @@ namespace hvh {
 		soa(const soa<Ts...>& other) {
 			reserve(other.size());
 			_soa_base<Ts...>& base = *this;
-			_soa_base<Ts...>& otherbase = other;
+			const _soa_base<Ts...>& otherbase = other;
 			base.copy(otherbase);
 		}
 		// operator = (&& rhs)
 		// Move-assignment operator for Struct-Of-Arrays.
 		// Moves the contents from the rhs struct-of-arrays into ourselves.
 		// Complexity: O(1).
-		soa<Ts...>& operator = (soa<Ts...>&& other) { swap(other); return *this; }
+		soa<Ts...>& operator = (soa<Ts...>&& other) { swap(*this, other); return *this; }
 		// operator = (const& rhs)
 		// Copy-assignment operator for Struct-Of-Arrays.
 		// Copies the contents from the rhs struct-of-arrays into ourselves.
 		// Complexity: O(n).
-		soa<Ts...>& operator = (soa<Ts...> other) { swap(other); return *this; }
+		soa<Ts...>& operator = (const soa<Ts...>& other) { soa<Ts...> copy(other); swap(*this, copy); return *this; }
 		// ~soa()
 		// Destructor for Struct-Of-Arrays.
 		// Destructs all stored elements and frees held memory.
@@ -604,18 +925,35 @@ namespace hvh {
 			_soa_base<Ts...>& base = *this;
 			base.destruct_range(0, this->mysize);
 			void* oldmem = this->template data<0>();
-			if (oldmem) _soa_aligned_free(oldmem);
+			if (oldmem) free_buffer(oldmem, base.size_per_entry() * this->mycapacity);
 		}
 
 		// swap(& rhs)
 		// Swaps the contents of this container with the other container.
 		// Complexity: O(1).
 		friend inline void swap(soa<Ts...>& lhs, soa<Ts...>& rhs) {
+			std::swap(lhs.myallocator, rhs.myallocator);
 			_soa_base<Ts...>& lhsbase = lhs;
 			_soa_base<Ts...>& rhsbase = rhs;
 			swap(lhsbase, rhsbase);
 		}
 
+		// set_allocator(allocator)
+		// Makes the container get its memory from 'allocator' instead of the heap.
+		// Passing nullptr goes back to using the heap.
+		// This can only be done before the container allocates any memory.
+		// Returns false if the container already holds memory, true otherwise.
+		// Complexity: O(1).
+		inline bool set_allocator(const soa_allocator* allocator) {
+			if (this->mycapacity != 0) return false;
+			myallocator = allocator;
+			return true;
+		}
+
+		// get_allocator()
+		// Returns the allocator that the container gets its memory from, or nullptr if it uses the heap.
+		inline const soa_allocator* get_allocator() const { return myallocator; }
+
 		// clear()
 		// Clears and destructs all held items.
 		// Does not change capacity.
@@ -645,9 +983,21 @@ namespace hvh {
 			// Remember the old memory so we can free it.
 			_soa_base<Ts...>& base = *this;
 			void* oldmem = this->template data<0>();
+			size_t oldbytes = base.size_per_entry() * this->mycapacity;
+			auto trace = _soa_trace(soa_trace_kind::reserve, this, this->mycapacity, [&]() { return base.size_per_entry() * this->mycapacity; });
+
+			// If the allocator can grow the buffer in place, spread the columns out inside it.
+			if (oldmem && can_reallocate()) {
+				void* realloc_result = reallocate_buffer(oldmem, oldbytes, base.size_per_entry() * newsize);
+				if (!realloc_result) return false;
+				size_t oldcapacity = this->mycapacity;
+				this->mycapacity = newsize;
+				base.relayout((char*)realloc_result, 0, 0, oldcapacity);
+				return true;
+			}
 
 			// Allocate new memory.
-			void* alloc_result = _soa_aligned_malloc(16, base.size_per_entry() * newsize);
+			void* alloc_result = allocate_buffer(base.size_per_entry() * newsize);
 			if (!alloc_result) return false;
 
 			// Copy the old data into the new memory.
@@ -655,7 +1005,7 @@ namespace hvh {
 			base.divy_buffer(alloc_result);
 
 			// Free the old memory.
-			if (oldmem) _soa_aligned_free(oldmem);
+			if (oldmem) free_buffer(oldmem, oldbytes);
 			return true;
 		}
 
@@ -676,10 +1026,26 @@ namespace hvh {
 			// Remember the old memory so we can free it.
 			_soa_base<Ts...>& base = *this;
 			void* oldmem = this->template data<0>();
+			size_t oldbytes = base.size_per_entry() * this->mycapacity;
+			auto trace = _soa_trace(soa_trace_kind::shrink_to_fit, this, this->mycapacity, [&]() { return base.size_per_entry() * this->mycapacity; });
 
-			if (newsize > 0) {
+			if (newsize > 0 && can_reallocate()) {
+				// Pack the columns together, then shrink the buffer around them.
+				size_t oldcapacity = this->mycapacity;
+				this->mycapacity = newsize;
+				base.relayout((char*)oldmem, 0, 0, oldcapacity);
+				void* realloc_result = reallocate_buffer(oldmem, oldbytes, base.size_per_entry() * newsize);
+				if (!realloc_result) {
+					this->mycapacity = oldcapacity;
+					base.relayout((char*)oldmem, 0, 0, newsize);
+					return false;
+				}
+				base.relayout((char*)realloc_result, 0, 0, newsize);
+				return true;
+			}
+			else if (newsize > 0) {
 				// Allocate new memory.
-				void* alloc_result = _soa_aligned_malloc(16, base.size_per_entry() * newsize);
+				void* alloc_result = allocate_buffer(base.size_per_entry() * newsize);
 				if (!alloc_result) return false;
 
 				// Copy the old data into the new memory.
@@ -692,7 +1058,7 @@ namespace hvh {
 			}
 
 			// Free the old memory.
-			if (oldmem) _soa_aligned_free(oldmem);
+			if (oldmem) free_buffer(oldmem, oldbytes);
 			return true;
 		}
 
@@ -909,6 +1275,7 @@ namespace hvh {
 		// then returns a pointer to the raw data buffer that stores the container's data.
 		// num_bytes is filled with the number of bytes in that buffer.
 		// This function should be used in tandem with 'deserialize' to save and load a container to disk.
+		// To save without shrinking the container, use 'write_stream' from soa_stream.hpp instead.
 		void* serialize(size_t& num_bytes) {
 			shrink_to_fit();
 			num_bytes = this->size_per_entry() * this->mycapacity;
@@ -937,6 +1304,57 @@ namespace hvh {
 			return quicksort(this->template data<K>(), 0, this->mysize - 1);
 		}
 
+		// copy_from(other, executor)
+		// Replaces the contents of the container with a copy of 'other', like copy-assignment,
+		// but splits the rows into chunks which are copied by 'executor' (such as a thread_pool from soa_parallel.hpp).
+		// Copying on many threads at once is what it takes to keep up with memory bandwidth on a big container.
+		// Returns false if a memory allocation error occurs, in which case the container is left empty.
+		// Complexity: O(n / threads).
+		template <typename Executor>
+		bool copy_from(const soa<Ts...>& other, Executor& executor) {
+			if (&other == this) return true;
+			clear();
+			if (!reserve(other.size())) return false;
+			_soa_base<Ts...>& base = *this;
+			const _soa_base<Ts...>& otherbase = other;
+			const size_t num_rows = other.size();
+			const size_t rows_per_chunk = std::max<size_t>(1, SOA_COPY_CHUNK_BYTES / base.size_per_entry());
+			executor.run((num_rows + rows_per_chunk - 1) / rows_per_chunk, [&](size_t chunk) {
+				size_t begin = chunk * rows_per_chunk;
+				base.copy_range(otherbase, begin, std::min(num_rows, begin + rows_per_chunk));
+			});
+			this->mysize = num_rows;
+			return true;
+		}
+
+		// clone()
+		// Returns a copy of the container which uses the same allocator.
+		// If the allocator supports it, the copy shares memory with the original copy-on-write,
+		// so cloning costs next to nothing no matter how big the container is;
+		// otherwise, the entries are copied as usual.
+		// Only containers of trivially copyable types can be cloned.
+		// With cow_allocator, cloning while an older clone is still alive copies the whole buffer once.
+		// Complexity: O(1) if the allocator can share memory, O(n) otherwise.
+		soa<Ts...> clone() const {
+			static_assert((std::is_trivially_copyable<Ts>::value && ...), "Only containers of trivially copyable types can be cloned.");
+			soa<Ts...> result;
+			result.myallocator = myallocator;
+			if (this->mycapacity == 0) return result;
+			const _soa_base<Ts...>& base = *this;
+			_soa_base<Ts...>& resultbase = result;
+			size_t num_bytes = base.size_per_entry() * this->mycapacity;
+			void* mem = clone_buffer((void*)this->template data<0>(), num_bytes);
+			if (mem) {
+				result.mycapacity = this->mycapacity;
+				result.mysize = this->mysize;
+				resultbase.divy_buffer(mem);
+			}
+			else if (result.reserve(this->mysize)) {
+				resultbase.copy(base);
+			}
+			return result;
+		}
+
 		// Iterators
 		// These iterators allow you to iterate over each row of the container.
 		// As this is as struct-of-arrays and not an array-of-structs, you should generally not do this.
@@ -993,12 +1411,51 @@ namespace hvh {
 		const_iterator end()	const { return const_iterator(*this, this->mysize); }
 
 	protected:
+		const soa_allocator* myallocator = nullptr;
+
+		// Gets a new buffer from the allocator, or the heap if there isn't one.
+		inline void* allocate_buffer(size_t num_bytes) const {
+			auto trace = _soa_trace(soa_trace_kind::allocate, this, this->mycapacity, [num_bytes]() { return num_bytes; });
+			if (myallocator) return myallocator->allocate(myallocator->context, num_bytes);
+			return _soa_aligned_malloc(16, num_bytes);
+		}
+
+		// Gives a buffer back to wherever it came from.
+		inline void free_buffer(void* mem, size_t num_bytes) const {
+			if (!mem) return;
+			auto trace = _soa_trace(soa_trace_kind::free, this, this->mycapacity, [num_bytes]() { return num_bytes; });
+			if (myallocator) myallocator->deallocate(myallocator->context, mem, num_bytes);
+			else _soa_aligned_free(mem);
+		}
+
+		// Resizes a buffer using the allocator; only valid if 'can_reallocate' is true.
+		inline void* reallocate_buffer(void* mem, size_t old_bytes, size_t new_bytes) const {
+			auto trace = _soa_trace(soa_trace_kind::reallocate, this, this->mycapacity, [new_bytes]() { return new_bytes; });
+			return myallocator->reallocate(myallocator->context, mem, old_bytes, new_bytes);
+		}
+
+		// Whether or not the allocator can resize a buffer in place.
+		// Resizing may move the buffer bytewise, so it's only used for trivially copyable types.
+		inline bool can_reallocate() const {
+			return (std::is_trivially_copyable<Ts>::value && ...) && myallocator && myallocator->reallocate;
+		}
+
+		// Asks the allocator for a copy-on-write copy of a buffer.
+		// Returns nullptr if the allocator can't do that, in which case the caller has to copy the buffer itself.
+		inline void* clone_buffer(void* mem, size_t num_bytes) const {
+			if (!myallocator || !myallocator->clone) return nullptr;
+			auto trace = _soa_trace(soa_trace_kind::allocate, this, this->mycapacity, [num_bytes]() { return num_bytes; });
+			return myallocator->clone(myallocator->context, mem, num_bytes);
+		}
+
 		// Ban access to certain parent methods.
 		using _soa_base<Ts...>::nullify;
 		using _soa_base<Ts...>::divy_buffer;
+		using _soa_base<Ts...>::relayout;
 		using _soa_base<Ts...>::construct_range;
 		using _soa_base<Ts...>::destruct_range;
 		using _soa_base<Ts...>::copy;
+		using _soa_base<Ts...>::copy_range;
 		using _soa_base<Ts...>::emplace_back_default;
 		using _soa_base<Ts...>::emplace_default;
 
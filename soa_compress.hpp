@@ -0,0 +1,304 @@
+/* soa_compress.hpp
+ * Lightweight integer column compression
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Self-contained block encodings for integer columns, used by soa_stream.hpp
+ * to shrink snapshots.  Each block of up to COMPRESS_BLOCK_SIZE values is
+ * stored using whichever of the following is smallest:
+ * raw bytes, run-length encoding, frame-of-reference bit packing,
+ * delta + bit packing (sorted data), or delta + varint (sorted data).
+ * Everything here is simple enough to decode at memory speed.
+ */
+#ifndef HVH_TOOLS_SOACOMPRESS_H
+#define HVH_TOOLS_SOACOMPRESS_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <algorithm> // For std::min
+#include <cstddef>
+
+namespace hvh {
+
+	// The number of values in each compressed block.
+	// The last block in a column may be shorter.
+	static constexpr size_t COMPRESS_BLOCK_SIZE = 4096;
+
+	enum block_encoding : uint8_t {
+		BLOCK_RAW = 0,			// Values stored as-is.
+		BLOCK_RLE = 1,			// (value, uint16_t run length) pairs.
+		BLOCK_FOR = 2,			// Minimum value, then every value minus the minimum, bit packed.
+		BLOCK_DELTA_FOR = 3,	// First value, then the difference between neighbours, bit packed.  Sorted blocks only.
+		BLOCK_DELTA_VARINT = 4,	// First value, then the difference between neighbours as LEB128 varints.  Sorted blocks only.
+	};
+
+	struct block_header {
+		uint8_t encoding;
+		uint8_t bits;
+		uint16_t reserved;
+		uint32_t num_bytes;
+	};
+
+	// The largest number of bytes a block of T's can take up after encoding.
+	// No encoding is chosen unless it beats raw, so this is the size of a raw block.
+	template <typename T>
+	inline constexpr size_t max_encoded_block_size() { return sizeof(T) * COMPRESS_BLOCK_SIZE; }
+
+	// Whether or not T can be compressed by these encodings.
+	template <typename T>
+	struct is_compressible : std::integral_constant<bool,
+		std::is_integral<T>::value && !std::is_same<T, bool>::value && sizeof(T) <= sizeof(uint64_t)> {};
+
+	namespace _compress_detail {
+
+		// Integers are mapped to unsigned values which sort in the same order,
+		// so that minimums and deltas work identically for signed and unsigned types.
+		template <typename T>
+		inline uint64_t to_ordered(T value) {
+			using U = typename std::make_unsigned<T>::type;
+			uint64_t result = (uint64_t)(U)value;
+			if constexpr (std::is_signed<T>::value) result ^= (uint64_t)1 << (sizeof(T) * 8 - 1);
+			return result;
+		}
+
+		template <typename T>
+		inline T from_ordered(uint64_t value) {
+			using U = typename std::make_unsigned<T>::type;
+			if constexpr (std::is_signed<T>::value) value ^= (uint64_t)1 << (sizeof(T) * 8 - 1);
+			return (T)(U)value;
+		}
+
+		inline uint8_t bit_width(uint64_t value) {
+			uint8_t bits = 0;
+			while (value) { ++bits; value >>= 1; }
+			return bits;
+		}
+
+		inline size_t packed_size(size_t count, uint8_t bits) {
+			return (((count * bits) + 63) / 64) * sizeof(uint64_t);
+		}
+
+		inline size_t varint_size(uint64_t value) {
+			size_t size = 1;
+			while (value >= 0x80) { value >>= 7; ++size; }
+			return size;
+		}
+
+		inline uint64_t load64(const char* src) { uint64_t result; memcpy(&result, src, sizeof(result)); return result; }
+		inline void store64(char* dst, uint64_t value) { memcpy(dst, &value, sizeof(value)); }
+
+		// Packs 'count' values, each of which fits in 'bits' bits, into a stream of 64-bit words.
+		template <typename Getter>
+		inline void pack(char* out, size_t count, uint8_t bits, Getter get) {
+			size_t num_words = packed_size(count, bits) / sizeof(uint64_t);
+			memset(out, 0, num_words * sizeof(uint64_t));
+			if (bits == 0) return;
+			for (size_t i = 0; i < count; ++i) {
+				uint64_t value = get(i);
+				size_t bitpos = i * bits;
+				size_t word = bitpos / 64;
+				size_t shift = bitpos % 64;
+				store64(out + (word * 8), load64(out + (word * 8)) | (value << shift));
+				if (shift + bits > 64)
+					store64(out + ((word + 1) * 8), load64(out + ((word + 1) * 8)) | (value >> (64 - shift)));
+			}
+		}
+
+		// Unpacks 'count' values of 'bits' bits each, handing each one to 'put'.
+		template <typename Putter>
+		inline void unpack(const char* in, size_t count, uint8_t bits, Putter put) {
+			if (bits == 0) {
+				for (size_t i = 0; i < count; ++i) put(i, 0);
+				return;
+			}
+			const uint64_t mask = (bits == 64) ? UINT64_MAX : (((uint64_t)1 << bits) - 1);
+			for (size_t i = 0; i < count; ++i) {
+				size_t bitpos = i * bits;
+				size_t word = bitpos / 64;
+				size_t shift = bitpos % 64;
+				uint64_t value = load64(in + (word * 8)) >> shift;
+				if (shift + bits > 64) value |= load64(in + ((word + 1) * 8)) << (64 - shift);
+				put(i, value & mask);
+			}
+		}
+
+	} // namespace _compress_detail
+
+	// plan_block(values, n)
+	// Chooses the smallest encoding for a block of n values.
+	// Returns a header describing the encoding and its size in bytes, which can be passed to 'encode_block'.
+	// When sizes tie, the encoding which is fastest to decode wins.
+	// Complexity: O(n).
+	template <typename T>
+	block_header plan_block(const T* values, size_t count) {
+		using namespace _compress_detail;
+		static_assert(is_compressible<T>::value, "Only integer columns can be compressed.");
+
+		block_header result = {};
+		result.encoding = BLOCK_RAW;
+		result.num_bytes = (uint32_t)(sizeof(T) * count);
+		if (count == 0) return result;
+
+		// Gather everything we need to know in a single pass.
+		uint64_t minval = to_ordered(values[0]);
+		uint64_t maxval = minval;
+		uint64_t maxdelta = 0;
+		size_t varint_bytes = 0;
+		size_t runs = 1;
+		bool sorted = true;
+		uint64_t prev = minval;
+		for (size_t i = 1; i < count; ++i) {
+			uint64_t value = to_ordered(values[i]);
+			if (value < minval) minval = value;
+			if (value > maxval) maxval = value;
+			if (value != prev) ++runs;
+			if (value < prev) sorted = false;
+			else if (sorted) {
+				uint64_t delta = value - prev;
+				if (delta > maxdelta) maxdelta = delta;
+				varint_bytes += varint_size(delta);
+			}
+			prev = value;
+		}
+
+		auto consider = [&](block_encoding encoding, uint8_t bits, size_t num_bytes) {
+			if (num_bytes < result.num_bytes) {
+				result.encoding = encoding;
+				result.bits = bits;
+				result.num_bytes = (uint32_t)num_bytes;
+			}
+		};
+		consider(BLOCK_RLE, 0, runs * (sizeof(T) + sizeof(uint16_t)));
+		uint8_t for_bits = bit_width(maxval - minval);
+		consider(BLOCK_FOR, for_bits, sizeof(uint64_t) + packed_size(count, for_bits));
+		if (sorted) {
+			uint8_t delta_bits = bit_width(maxdelta);
+			consider(BLOCK_DELTA_FOR, delta_bits, sizeof(uint64_t) + packed_size(count - 1, delta_bits));
+			consider(BLOCK_DELTA_VARINT, 0, sizeof(uint64_t) + varint_bytes);
+		}
+		return result;
+	}
+
+	// encode_block(values, n, header, out)
+	// Encodes a block of n values as described by 'header', which must have come from 'plan_block'.
+	// 'out' must have room for header.num_bytes bytes.
+	// Complexity: O(n).
+	template <typename T>
+	void encode_block(const T* values, size_t count, const block_header& header, char* out) {
+		using namespace _compress_detail;
+		switch (header.encoding) {
+		case BLOCK_RAW:
+			memcpy(out, values, sizeof(T) * count);
+			break;
+		case BLOCK_RLE: {
+			size_t i = 0;
+			while (i < count) {
+				size_t run = 1;
+				while (i + run < count && values[i + run] == values[i]) ++run;
+				memcpy(out, &values[i], sizeof(T)); out += sizeof(T);
+				// A run is never empty, so run - 1 is stored.
+				uint16_t stored = (uint16_t)(run - 1);
+				memcpy(out, &stored, sizeof(stored)); out += sizeof(stored);
+				i += run;
+			}
+			break;
+		}
+		case BLOCK_FOR: {
+			uint64_t base = UINT64_MAX;
+			for (size_t i = 0; i < count; ++i) base = std::min(base, to_ordered(values[i]));
+			store64(out, base);
+			pack(out + sizeof(uint64_t), count, header.bits, [&](size_t i) { return to_ordered(values[i]) - base; });
+			break;
+		}
+		case BLOCK_DELTA_FOR: {
+			store64(out, to_ordered(values[0]));
+			pack(out + sizeof(uint64_t), count - 1, header.bits,
+				[&](size_t i) { return to_ordered(values[i + 1]) - to_ordered(values[i]); });
+			break;
+		}
+		case BLOCK_DELTA_VARINT: {
+			store64(out, to_ordered(values[0]));
+			out += sizeof(uint64_t);
+			for (size_t i = 1; i < count; ++i) {
+				uint64_t delta = to_ordered(values[i]) - to_ordered(values[i - 1]);
+				while (delta >= 0x80) { *out++ = (char)((delta & 0x7F) | 0x80); delta >>= 7; }
+				*out++ = (char)delta;
+			}
+			break;
+		}
+		}
+	}
+
+	// decode_block(header, in, n, values)
+	// Decodes a block of n values which was encoded with 'encode_block'.
+	// 'in' must hold header.num_bytes bytes.
+	// Returns false if the block is malformed.
+	// Complexity: O(n).
+	template <typename T>
+	bool decode_block(const block_header& header, const char* in, size_t count, T* values) {
+		using namespace _compress_detail;
+		static_assert(is_compressible<T>::value, "Only integer columns can be compressed.");
+		if (header.bits > 64) return false;
+		const char* end = in + header.num_bytes;
+		switch (header.encoding) {
+		case BLOCK_RAW:
+			if (header.num_bytes != sizeof(T) * count) return false;
+			memcpy(values, in, sizeof(T) * count);
+			return true;
+		case BLOCK_RLE: {
+			size_t i = 0;
+			while (i < count) {
+				if (end - in < (std::ptrdiff_t)(sizeof(T) + sizeof(uint16_t))) return false;
+				T value; memcpy(&value, in, sizeof(T)); in += sizeof(T);
+				uint16_t stored; memcpy(&stored, in, sizeof(stored)); in += sizeof(stored);
+				size_t run = (size_t)stored + 1;
+				if (run > count - i) return false;
+				for (size_t j = 0; j < run; ++j) values[i + j] = value;
+				i += run;
+			}
+			return in == end;
+		}
+		case BLOCK_FOR: {
+			if (header.num_bytes != sizeof(uint64_t) + packed_size(count, header.bits)) return false;
+			uint64_t base = load64(in);
+			unpack(in + sizeof(uint64_t), count, header.bits,
+				[&](size_t i, uint64_t value) { values[i] = from_ordered<T>(base + value); });
+			return true;
+		}
+		case BLOCK_DELTA_FOR: {
+			if (count == 0 || header.num_bytes != sizeof(uint64_t) + packed_size(count - 1, header.bits)) return false;
+			uint64_t running = load64(in);
+			values[0] = from_ordered<T>(running);
+			unpack(in + sizeof(uint64_t), count - 1, header.bits,
+				[&](size_t i, uint64_t delta) { running += delta; values[i + 1] = from_ordered<T>(running); });
+			return true;
+		}
+		case BLOCK_DELTA_VARINT: {
+			if (count == 0 || header.num_bytes < sizeof(uint64_t)) return false;
+			uint64_t running = load64(in);
+			in += sizeof(uint64_t);
+			values[0] = from_ordered<T>(running);
+			for (size_t i = 1; i < count; ++i) {
+				uint64_t delta = 0;
+				unsigned shift = 0;
+				while (true) {
+					if (in == end || shift > 63) return false;
+					uint8_t byte = (uint8_t)*in++;
+					delta |= (uint64_t)(byte & 0x7F) << shift;
+					if (!(byte & 0x80)) break;
+					shift += 7;
+				}
+				running += delta;
+				values[i] = from_ordered<T>(running);
+			}
+			return in == end;
+		}
+		default:
+			return false;
+		}
+	}
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SOACOMPRESS_H
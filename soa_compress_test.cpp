@@ -0,0 +1,73 @@
+#include "soa_compress.hpp"
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+using namespace std;
+
+template <typename T>
+static bool roundtrip(const char* name, const vector<T>& values, hvh::block_encoding expected) {
+	bool success = true;
+	hvh::block_header header = hvh::plan_block(values.data(), values.size());
+	if (header.encoding != expected) {
+		printf("%s: expected encoding %i, got %i.\n", name, (int)expected, (int)header.encoding);
+		success = false;
+	}
+	if (header.num_bytes > sizeof(T) * values.size()) {
+		printf("%s: encoded block is bigger than the raw data.\n", name);
+		success = false;
+	}
+	vector<char> encoded(header.num_bytes);
+	hvh::encode_block(values.data(), values.size(), header, encoded.data());
+	vector<T> decoded(values.size());
+	if (!hvh::decode_block(header, encoded.data(), decoded.size(), decoded.data())) {
+		printf("%s: decode_block reported a malformed block.\n", name);
+		success = false;
+	}
+	else if (decoded != values) {
+		printf("%s: decoded values do not match the originals.\n", name);
+		success = false;
+	}
+	return success;
+}
+
+bool soa_compress_test() {
+	printf("Testing soa_compress...\n");
+	bool success = true;
+	srand(12345);
+
+	vector<int64_t> sorted_ids;
+	for (int64_t i = 0; i < 4096; ++i) sorted_ids.push_back(1000000000 + (i * 3) + (rand() % 3));
+	success &= roundtrip("sorted ids", sorted_ids, hvh::BLOCK_DELTA_FOR);
+
+	vector<uint32_t> repeated(4096, 7);
+	for (size_t i = 2048; i < 4096; ++i) repeated[i] = 9;
+	success &= roundtrip("repeated values", repeated, hvh::BLOCK_RLE);
+
+	vector<int32_t> small_counters;
+	for (int i = 0; i < 4096; ++i) small_counters.push_back(-50 + (rand() % 100));
+	success &= roundtrip("small counters", small_counters, hvh::BLOCK_FOR);
+
+	vector<uint64_t> skewed;
+	uint64_t running = 0;
+	for (int i = 0; i < 4096; ++i) { running += (i % 1000 == 0) ? ((uint64_t)1 << 40) : 1; skewed.push_back(running); }
+	success &= roundtrip("skewed timestamps", skewed, hvh::BLOCK_DELTA_VARINT);
+
+	vector<uint64_t> noise;
+	for (int i = 0; i < 4096; ++i) noise.push_back(((uint64_t)rand() << 33) ^ ((uint64_t)rand() << 11) ^ (uint64_t)rand());
+	success &= roundtrip("random noise", noise, hvh::BLOCK_RAW);
+
+	vector<int8_t> short_block = { -128, 127, 0, 5 };
+	success &= roundtrip("short signed block", short_block, hvh::BLOCK_RAW);
+
+	// A truncated block must be rejected rather than read out of bounds.
+	hvh::block_header header = hvh::plan_block(skewed.data(), skewed.size());
+	vector<char> encoded(header.num_bytes);
+	hvh::encode_block(skewed.data(), skewed.size(), header, encoded.data());
+	header.num_bytes -= 1;
+	if (hvh::decode_block(header, encoded.data(), skewed.size(), skewed.data())) {
+		printf("decode_block should reject a truncated varint block.\n");
+		success = false;
+	}
+
+	return success;
+}
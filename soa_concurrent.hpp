@@ -0,0 +1,231 @@
+/* soa_concurrent.hpp
+ * Concurrent appends to a struct-of-arrays
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Provides concurrent_soa, an soa which many threads can append rows to at
+ * once without a lock around every push_back.  Each append claims a range of
+ * rows with a single atomic increment and writes its columns independently
+ * of the other threads.  Finished rows are flagged, and whichever thread
+ * finishes the row at the watermark moves it past every finished row after
+ * it, so readers only ever see rows which are completely written and no
+ * writer waits for another.  When the capacity runs out, one thread grows
+ * the container while the others wait.
+ */
+#ifndef HVH_TOOLS_SOACONCURRENT_H
+#define HVH_TOOLS_SOACONCURRENT_H
+
+#include "soa.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+
+namespace hvh {
+
+	// concurrent_soa
+	// An soa with a thread-safe 'append'.
+	// While any thread might be appending, only 'append', 'append_range', 'committed', and 'read' may be used.
+	// Once the appending threads are done, call 'sync', and then it can be used like any other soa;
+	// call 'sync' again after changing its size by other means, before appending again.
+	template <typename... Ts>
+	class concurrent_soa : public soa<Ts...> {
+	public:
+		concurrent_soa() {}
+		concurrent_soa(const concurrent_soa&) = delete;
+		concurrent_soa& operator = (const concurrent_soa&) = delete;
+		~concurrent_soa() { adopt_committed(); }
+
+		// append(args...)
+		// Adds a row to the back of the container, constructing each column from the corresponding argument.
+		// Safe to call from many threads at once.  The row is visible to readers once it, and every row claimed before it,
+		// has been written; 'append' never waits for other threads' rows.
+		// If a constructor throws, see 'append_range'.
+		// Returns false if a memory allocation failure occurs while growing.
+		// Complexity: O(1) amortized.
+		template <typename... Args>
+		bool append(Args&&... args) {
+			static_assert(sizeof...(Args) == sizeof...(Ts), "append needs one argument for each column.");
+			return append_range(1, [&](size_t) { return std::forward_as_tuple(std::forward<Args>(args)...); });
+		}
+
+		// append_range(count, fn)
+		// Claims 'count' consecutive rows with a single atomic increment, and constructs the ith of them from
+		// the items in the tuple returned by fn(i), e.g. `[&](size_t i) { return std::make_tuple(a[i], b[i]); }`.
+		// Safe to call from many threads at once; each thread's rows stay together.
+		// If a constructor (or 'fn') throws, the range's rows are taken back if nothing was claimed after them.
+		// Otherwise, the rows which weren't constructed are value-initialized and published, so that other threads
+		// aren't held up.  Either way, the exception is then rethrown.
+		// Returns false if a memory allocation failure occurs while growing.
+		// Complexity: O(count) amortized.
+		template <typename Fn>
+		bool append_range(size_t count, Fn&& fn) {
+			if (count == 0) return true;
+			while (true) {
+				{
+					std::shared_lock<std::shared_mutex> lock(mygrowmutex);
+					// Acquire, in case these rows were handed back by a thread which had started writing them.
+					size_t first = myclaimed.fetch_add(count, std::memory_order_acquire);
+					if (first + count <= mylimit) {
+						construct_rows(first, count, fn);
+						return true;
+					}
+				}
+				if (!grow(count)) return false;
+			}
+		}
+
+		// committed()
+		// Returns the number of rows which are completely written, all of which are at the front of the container.
+		// Safe to call while other threads are appending.
+		inline size_t committed() const { return mypublished.load(std::memory_order_acquire); }
+
+		// read(fn)
+		// Calls fn(container, n) with the first n rows of the container, all of which are completely written.
+		// The container won't be reallocated until fn returns, though rows after the first n may be changing.
+		// Safe to call while other threads are appending.
+		template <typename Fn>
+		auto read(Fn&& fn) const {
+			std::shared_lock<std::shared_mutex> lock(mygrowmutex);
+			const soa<Ts...>& base = *this;
+			return fn(base, committed());
+		}
+
+		// sync()
+		// Must be called once the appending threads are done, before the container is used as an ordinary soa,
+		// so that its size includes the appended rows.  Must also be called after the container's size is changed
+		// by anything other than 'append', before 'append' is used again.
+		// Complexity: O(n) in the unused capacity.
+		inline void sync() {
+			adopt_committed();
+			myclaimed.store(this->mysize, std::memory_order_relaxed);
+			mypublished.store(this->mysize, std::memory_order_release);
+			reset_ready();
+		}
+
+	private:
+		mutable std::shared_mutex mygrowmutex;
+		std::atomic<size_t> myclaimed{ 0 };
+		std::atomic<size_t> mypublished{ 0 };
+		// One flag per row, set once the row is written.  Only rows below 'mylimit' can be claimed.
+		std::unique_ptr<std::atomic<uint8_t>[]> myready;
+		size_t myreadysize = 0;
+		size_t mylimit = 0;
+		// The size this class last gave the soa, to tell whether anything else has changed it since.
+		size_t mysynced = 0;
+
+		// Only ever called while no thread is appending.
+		inline void adopt_committed() {
+			if (this->mysize == mysynced) this->mysize = committed();
+			mysynced = this->mysize;
+		}
+
+		template <typename Fn>
+		void construct_rows(size_t first, size_t count, Fn& fn) {
+			size_t i = 0;
+			try {
+				for (; i < count; ++i) construct_row(first + i, fn(i), std::index_sequence_for<Ts...>{});
+			}
+			catch (...) {
+				// If nobody has claimed anything since, the rows can be handed back.  They're destructed first,
+				// since another thread may claim them the moment they're handed back.
+				size_t end = first + count;
+				if (myclaimed.load(std::memory_order_relaxed) == end) {
+					for (size_t j = first; j < first + i; ++j) destruct_row(j, sizeof...(Ts), std::index_sequence_for<Ts...>{});
+					i = 0;
+					if (myclaimed.compare_exchange_strong(end, first, std::memory_order_release, std::memory_order_relaxed)) throw;
+				}
+				fill_rows(first + i, count - i, std::index_sequence_for<Ts...>{});
+				publish(first, count);
+				throw;
+			}
+			publish(first, count);
+		}
+
+		// Constructs every column of a row, or none of them if one of the constructors throws.
+		template <typename Tuple, size_t... Ks>
+		inline void construct_row(size_t index, Tuple&& items, std::index_sequence<Ks...> columns) {
+			size_t constructed = 0;
+			try {
+				((::new ((void*)&this->template data<Ks>()[index]) Ts(std::get<Ks>(std::forward<Tuple>(items))), ++constructed), ...);
+			}
+			catch (...) {
+				destruct_row(index, constructed, columns);
+				throw;
+			}
+		}
+
+		// Destructs the first 'num_columns' columns of a row.
+		template <size_t... Ks>
+		inline void destruct_row(size_t index, size_t num_columns, std::index_sequence<Ks...>) {
+			((Ks < num_columns ? this->template data<Ks>()[index].~Ts() : void()), ...);
+		}
+
+		// Stands in for rows whose constructors threw.  A row can't be left unconstructed once later rows depend on it,
+		// so if value-initializing one throws as well, there's nothing left to do but terminate.
+		template <size_t... Ks>
+		void fill_rows(size_t first, size_t count, std::index_sequence<Ks...>) noexcept {
+			for (size_t i = first; i < first + count; ++i) (::new ((void*)&this->template data<Ks>()[i]) Ts(), ...);
+		}
+
+		// Flags the rows as written, then moves the watermark past them if they're next.
+		// The first row is flagged last, so a thread which sees it flagged sees the rest of the range too.
+		inline void publish(size_t first, size_t count) {
+			for (size_t i = first + count - 1; i > first; --i) myready[i].store(1, std::memory_order_relaxed);
+			myready[first].store(1);
+			advance();
+		}
+
+		// Moves the watermark past every flagged row after it.
+		// Whichever thread flags the row at the watermark carries it on, so no thread waits for another.
+		// The flags and the watermark are sequentially consistent, so that a thread flagging a row just past the
+		// watermark and a thread moving the watermark up to it can't both miss each other.
+		inline void advance() {
+			size_t published = mypublished.load();
+			while (true) {
+				size_t end = published;
+				while (end < mylimit && myready[end].load()) ++end;
+				if (end == published) return;
+				if (mypublished.compare_exchange_weak(published, end)) published = end;
+			}
+		}
+
+		// Makes room for at least 'count' more rows once every in-flight append has finished.
+		bool grow(size_t count) {
+			std::unique_lock<std::shared_mutex> lock(mygrowmutex);
+			// Every claimed row below the limit is published by now.
+			// Anything claimed past the limit gets claimed again after we're done.
+			advance();
+			size_t published = mypublished.load(std::memory_order_acquire);
+			myclaimed.store(published, std::memory_order_relaxed);
+			this->mysize = published;
+			mysynced = published;
+			if (published + count <= mylimit) return true;
+			if (published + count > this->mycapacity) {
+				soa<Ts...>& base = *this;
+				if (!base.reserve(std::max(this->mycapacity * 2, published + count))) return false;
+			}
+			return reset_ready();
+		}
+
+		// Clears the flags of every row past the size, and makes the whole capacity claimable.
+		// Returns false if the flags can't be allocated, in which case only the rows which already had flags are claimable.
+		bool reset_ready() {
+			if (myreadysize != this->mycapacity) {
+				std::unique_ptr<std::atomic<uint8_t>[]> ready(new (std::nothrow) std::atomic<uint8_t>[this->mycapacity]());
+				if (ready) {
+					myready = std::move(ready);
+					myreadysize = this->mycapacity;
+				}
+			}
+			for (size_t i = this->mysize; i < myreadysize; ++i) myready[i].store(0, std::memory_order_relaxed);
+			mylimit = std::min(myreadysize, this->mycapacity);
+			return mylimit == this->mycapacity;
+		}
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SOACONCURRENT_H
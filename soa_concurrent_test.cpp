@@ -0,0 +1,143 @@
+#include "soa_concurrent.hpp"
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cstdio>
+#include <tuple>
+#include <stdexcept>
+using namespace std;
+
+// A column whose constructor throws for negative values.
+struct picky {
+	int value = 0;
+	picky() {}
+	picky(int v) : value(v) { if (v < 0) throw runtime_error("negative"); }
+};
+
+bool soa_concurrent_test() {
+	printf("Testing soa_concurrent...\n");
+	bool success = true;
+
+	const int num_threads = 6;
+	const int per_thread = 40000;
+	hvh::concurrent_soa<int, int, string> rows;
+
+	// Readers must only ever see rows which are completely written.
+	atomic<bool> done{ false };
+	atomic<bool> torn{ false };
+	thread reader([&]() {
+		while (!done.load()) {
+			rows.read([&](const hvh::soa<int, int, string>& view, size_t n) {
+				for (size_t i = (n > 64) ? n - 64 : 0; i < n; ++i) {
+					if (view.at<1>(i) != view.at<0>(i) * 2 || view.at<2>(i) != to_string(view.at<0>(i))) torn = true;
+				}
+			});
+		}
+	});
+
+	vector<thread> writers;
+	for (int t = 0; t < num_threads; ++t) {
+		writers.emplace_back([&, t]() {
+			for (int i = 0; i < per_thread; ++i) {
+				int value = t * per_thread + i;
+				if (!rows.append(value, value * 2, to_string(value))) torn = true;
+			}
+		});
+	}
+	for (auto& writer : writers) writer.join();
+	done = true;
+	reader.join();
+	rows.sync();
+
+	if (torn) {
+		printf("A reader saw a partially written row, or an append failed.\n");
+		success = false;
+	}
+	if (rows.size() != (size_t)(num_threads * per_thread) || rows.committed() != rows.size()) {
+		printf("concurrent_soa should have %i rows, instead it has %zi (%zi committed).\n", num_threads * per_thread, rows.size(), rows.committed());
+		success = false;
+	}
+
+	// Every value must appear exactly once, and each thread's rows must keep their order.
+	vector<char> seen(num_threads * per_thread, 0);
+	vector<int> last(num_threads, -1);
+	for (size_t i = 0; i < rows.size(); ++i) {
+		int value = rows.at<0>(i);
+		if (value < 0 || value >= num_threads * per_thread || seen[value] || value <= last[value / per_thread]) {
+			printf("Row %zi holds an unexpected value %i.\n", i, value);
+			success = false;
+			break;
+		}
+		seen[value] = 1;
+		last[value / per_thread] = value;
+	}
+
+	// Once appending is done it's an ordinary soa, and appending can pick up again after a sync.
+	rows.erase_swap(0);
+	rows.sync();
+	rows.append(-1, -2, string("-1"));
+	rows.sync();
+	if (rows.size() != (size_t)(num_threads * per_thread) || rows.at<2>(rows.size() - 1) != "-1") {
+		printf("Appending after sync did not add the row to the back.\n");
+		success = false;
+	}
+
+	// Ranges of rows are claimed together, and stay together.
+	hvh::concurrent_soa<int, int> ranges;
+	vector<thread> rangers;
+	for (int t = 0; t < num_threads; ++t) {
+		rangers.emplace_back([&, t]() {
+			for (int block = 0; block < 100; ++block) {
+				ranges.append_range(37, [&](size_t i) { return make_tuple(t, block * 37 + (int)i); });
+			}
+		});
+	}
+	for (auto& ranger : rangers) ranger.join();
+	ranges.sync();
+	bool contiguous = (ranges.size() == (size_t)(num_threads * 100 * 37));
+	for (size_t i = 0; contiguous && i < ranges.size(); i += 37) {
+		for (size_t j = 1; j < 37; ++j) {
+			if (ranges.at<0>(i + j) != ranges.at<0>(i) || ranges.at<1>(i + j) != ranges.at<1>(i) + (int)j) contiguous = false;
+		}
+	}
+	if (!contiguous) {
+		printf("Rows appended with append_range should stay together.\n");
+		success = false;
+	}
+
+	// A constructor which throws mustn't stop the other threads' rows from being published.
+	hvh::concurrent_soa<int, picky> failing;
+	atomic<int> num_thrown{ 0 };
+	vector<thread> failers;
+	for (int t = 0; t < num_threads; ++t) {
+		failers.emplace_back([&, t]() {
+			for (int i = 0; i < 5000; ++i) {
+				int value = (i % 1000 == 999) ? -1 : t * 5000 + i;
+				try { failing.append(value, value); }
+				catch (const runtime_error&) { ++num_thrown; }
+			}
+		});
+	}
+	for (auto& failer : failers) failer.join();
+	size_t num_committed = failing.committed();
+	failing.sync();
+	// Failed rows were either handed back or value-initialized, and every other row is there once.
+	vector<int> found(num_threads * 5000, 0);
+	size_t num_good = 0;
+	bool duplicated = false;
+	for (size_t i = 0; i < failing.size(); ++i) {
+		int value = failing.at<0>(i);
+		if (failing.at<1>(i).value != value || value < 0 || value % 1000 == 999) continue;
+		if (value == 0) continue; // Can't be told apart from a value-initialized row.
+		duplicated |= (found[value]++ != 0);
+		++num_good;
+	}
+	if (num_thrown != num_threads * 5 || num_committed != failing.size() || num_good != (size_t)(num_threads * 4995 - 1)
+		|| duplicated || failing.size() > (size_t)(num_threads * 5000)) {
+		printf("After %i failed appends, %zi rows are committed and %zi of them are intact.\n", num_thrown.load(), num_committed, num_good);
+		success = false;
+	}
+
+	return success;
+}
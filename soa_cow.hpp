@@ -0,0 +1,272 @@
+/* soa_cow.hpp
+ * Copy-on-write cloning and background snapshots
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Provides cow_allocator, which gives soa's and htable's buffers that can be
+ * cloned copy-on-write, usually in constant time, and write_stream_async, which writes
+ * a clone to disk on a background thread.  Together they allow a consistent
+ * point-in-time snapshot of a table to be saved while writers keep going.
+ *
+ * On Linux, each buffer is a shared mapping of a memfd.  Cloning freezes the
+ * memfd, remaps the original privately on top of it (so that its future
+ * writes are copied-on-write), and maps the clone privately from the same
+ * memfd.  Nothing is copied until somebody writes.  The exception is cloning
+ * a buffer again while an older clone of it is still alive: the older clone
+ * pins the memfd, so the whole buffer is first copied into a fresh memfd, in
+ * O(n) time on the calling thread.  Destroy each snapshot before taking the
+ * next to keep cloning cheap.  On other platforms the allocator falls back to
+ * the heap, and clones are ordinary copies.
+ */
+#ifndef HVH_TOOLS_SOACOW_H
+#define HVH_TOOLS_SOACOW_H
+
+#include "soa_stream.hpp"
+
+#include <future>
+
+#if defined(__linux__)
+  #include <mutex>
+  #include <unordered_map>
+  #include <sys/mman.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #define HVH_COW_SUPPORTED 1
+#else
+  #define HVH_COW_SUPPORTED 0
+#endif
+
+namespace hvh {
+
+	// cow_allocator
+	// An allocator whose buffers can be cloned copy-on-write.
+	// Pass it to 'set_allocator' on an soa or htable, then use 'clone' to take cheap snapshots.
+	// Cloning while an older clone of the same buffer is still alive copies the whole buffer, so don't let snapshots overlap.
+	// The allocator must outlive every container (and clone) which uses it.
+	// It is safe for a clone to be destroyed on a different thread than its original.
+	class cow_allocator {
+	public:
+		cow_allocator() {
+			myinterface.allocate = &cow_allocator::do_allocate;
+			myinterface.deallocate = &cow_allocator::do_deallocate;
+#if HVH_COW_SUPPORTED
+			myinterface.clone = &cow_allocator::do_clone;
+#endif
+			myinterface.context = this;
+		}
+
+		cow_allocator(const cow_allocator&) = delete;
+		cow_allocator& operator = (const cow_allocator&) = delete;
+
+		// get()
+		// Returns the interface to pass to 'set_allocator'.
+		inline const soa_allocator* get() const { return &myinterface; }
+		inline operator const soa_allocator*() const { return &myinterface; }
+
+		// supported()
+		// Returns true if clones really are copy-on-write on this platform.
+		static constexpr bool supported() { return HVH_COW_SUPPORTED != 0; }
+
+	private:
+		soa_allocator myinterface;
+
+#if HVH_COW_SUPPORTED
+
+		// A memfd holding the contents of a buffer.
+		// Shared by a buffer and all of its clones until the last of them is freed.
+		struct segment {
+			int fd;
+			size_t refs;
+		};
+
+		// A mapping which we have handed out as a buffer.
+		// A 'private' mapping is copy-on-write, so it may hold pages which its segment doesn't.
+		struct mapping {
+			segment* seg;
+			size_t num_bytes;
+			bool isprivate;
+		};
+
+		std::mutex mymutex;
+		std::unordered_map<void*, mapping> mymappings;
+
+		static inline size_t page_size() { return (size_t)sysconf(_SC_PAGESIZE); }
+		static inline size_t round_to_pages(size_t num_bytes) {
+			size_t page = page_size();
+			return ((num_bytes + page - 1) / page) * page;
+		}
+
+		static segment* new_segment(size_t num_bytes) {
+			int fd = memfd_create("hvh_cow", MFD_CLOEXEC);
+			if (fd < 0) return nullptr;
+			if (ftruncate(fd, (off_t)num_bytes) != 0) { ::close(fd); return nullptr; }
+			return new segment{ fd, 1 };
+		}
+
+		static void release_segment(segment* seg) {
+			if (--seg->refs > 0) return;
+			::close(seg->fd);
+			delete seg;
+		}
+
+		static bool write_to_segment(segment* seg, const char* src, size_t num_bytes, size_t offset) {
+			while (num_bytes > 0) {
+				ssize_t result = pwrite(seg->fd, src, num_bytes, (off_t)offset);
+				if (result < 0) {
+					if (errno == EINTR) continue;
+					return false;
+				}
+				src += result;
+				offset += (size_t)result;
+				num_bytes -= (size_t)result;
+			}
+			return true;
+		}
+
+		// Calls fn(offset, length) for every run of pages in a private mapping which differ from its segment,
+		// which are the pages the process has written to since the mapping was made private.
+		// Uses /proc/self/pagemap to tell them apart; if that isn't available, every page is reported.
+		template <typename Fn>
+		static bool for_each_private_run(void* mem, size_t num_bytes, Fn fn) {
+			size_t page = page_size();
+			size_t num_pages = num_bytes / page;
+			int fd = ::open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+			if (fd < 0) return fn(0, num_bytes);
+
+			static constexpr size_t BATCH = 4096;
+			uint64_t entries[BATCH];
+			size_t first_page = (size_t)(uintptr_t)mem / page;
+			size_t run_start = SIZE_MAX;
+			bool result = true;
+			for (size_t i = 0; i < num_pages && result; i += BATCH) {
+				size_t n = std::min(BATCH, num_pages - i);
+				off_t where = (off_t)((first_page + i) * sizeof(uint64_t));
+				if (pread(fd, entries, n * sizeof(uint64_t), where) != (ssize_t)(n * sizeof(uint64_t))) {
+					// Can't tell which pages are private, so report everything that's left.
+					if (run_start == SIZE_MAX) run_start = i;
+					i = num_pages;
+					break;
+				}
+				for (size_t j = 0; j < n; ++j) {
+					uint64_t entry = entries[j];
+					bool present = (entry >> 63) & 1;
+					bool swapped = (entry >> 62) & 1;
+					bool filepage = (entry >> 61) & 1;
+					bool isprivate = (present && !filepage) || swapped;
+					if (isprivate && run_start == SIZE_MAX) run_start = i + j;
+					else if (!isprivate && run_start != SIZE_MAX) {
+						result = fn(run_start * page, ((i + j) - run_start) * page);
+						run_start = SIZE_MAX;
+						if (!result) break;
+					}
+				}
+			}
+			::close(fd);
+			if (result && run_start != SIZE_MAX) result = fn(run_start * page, (num_pages - run_start) * page);
+			return result;
+		}
+
+		void* allocate(size_t num_bytes) {
+			num_bytes = round_to_pages(num_bytes);
+			segment* seg = new_segment(num_bytes);
+			if (!seg) return nullptr;
+			void* mem = mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, seg->fd, 0);
+			if (mem == MAP_FAILED) {
+				release_segment(seg);
+				return nullptr;
+			}
+			std::lock_guard<std::mutex> lock(mymutex);
+			mymappings[mem] = mapping{ seg, num_bytes, false };
+			return mem;
+		}
+
+		void deallocate(void* mem) {
+			std::lock_guard<std::mutex> lock(mymutex);
+			auto it = mymappings.find(mem);
+			if (it == mymappings.end()) return;
+			munmap(mem, it->second.num_bytes);
+			release_segment(it->second.seg);
+			mymappings.erase(it);
+		}
+
+		void* clone(void* mem) {
+			std::lock_guard<std::mutex> lock(mymutex);
+			auto it = mymappings.find(mem);
+			if (it == mymappings.end()) return nullptr;
+			mapping& original = it->second;
+
+			if (!original.isprivate) {
+				// The segment holds everything, so it becomes the snapshot.
+				// From now on, the original's writes land in private pages instead.
+				void* remapped = mmap(mem, original.num_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, original.seg->fd, 0);
+				if (remapped == MAP_FAILED) return nullptr;
+				original.isprivate = true;
+			}
+			else if (original.seg->refs == 1) {
+				// The original was cloned before, but that clone is gone.
+				// Write back the pages which have changed since, and let the original share them again.
+				bool result = for_each_private_run(mem, original.num_bytes, [&](size_t offset, size_t length) {
+					if (!write_to_segment(original.seg, (const char*)mem + offset, length, offset)) return false;
+					madvise((char*)mem + offset, length, MADV_DONTNEED);
+					return true;
+				});
+				if (!result) return nullptr;
+			}
+			else {
+				// An older clone is still using the segment, so it can't change.
+				// Copy the original into a fresh segment instead.
+				// This is the one case where cloning is O(n), and the copy happens here on the caller's thread.
+				segment* fresh = new_segment(original.num_bytes);
+				if (!fresh) return nullptr;
+				if (!write_to_segment(fresh, (const char*)mem, original.num_bytes, 0)) {
+					release_segment(fresh);
+					return nullptr;
+				}
+				void* remapped = mmap(mem, original.num_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fresh->fd, 0);
+				if (remapped == MAP_FAILED) {
+					release_segment(fresh);
+					return nullptr;
+				}
+				release_segment(original.seg);
+				original.seg = fresh;
+			}
+
+			void* copy = mmap(nullptr, original.num_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, original.seg->fd, 0);
+			if (copy == MAP_FAILED) return nullptr;
+			++original.seg->refs;
+			mymappings[copy] = mapping{ original.seg, original.num_bytes, true };
+			return copy;
+		}
+
+		static void* do_allocate(void* context, size_t num_bytes) { return ((cow_allocator*)context)->allocate(num_bytes); }
+		static void do_deallocate(void* context, void* mem, size_t) { ((cow_allocator*)context)->deallocate(mem); }
+		static void* do_clone(void* context, void* mem, size_t) { return ((cow_allocator*)context)->clone(mem); }
+
+#else
+
+		static void* do_allocate(void*, size_t num_bytes) { return _soa_aligned_malloc(16, num_bytes); }
+		static void do_deallocate(void*, void* mem, size_t) { _soa_aligned_free(mem); }
+
+#endif
+	};
+
+	// write_stream_async(snapshot, fd, options)
+	// Writes 'snapshot' to file descriptor 'fd' (as 'write_stream' does) on a background thread.
+	// The snapshot is moved into the background thread and destroyed as soon as it has been written,
+	// before the future becomes ready.
+	// Pass the result of 'clone' to save a point-in-time copy of a table without blocking its writers:
+	// `auto saved = hvh::write_stream_async(table.clone(), fd);`
+	// Returns a future which becomes true once the snapshot has been written successfully.
+	template <typename Container>
+	std::future<bool> write_stream_async(Container snapshot, int fd, const stream_options& options = stream_options()) {
+		return std::async(std::launch::async, [snapshot = std::move(snapshot), fd, options]() mutable {
+			// The future's shared state keeps this lambda alive until the future is gone,
+			// so the snapshot is moved out of it to be freed when the write finishes.
+			Container written(std::move(snapshot));
+			return write_stream(fd, written, options);
+		});
+	}
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SOACOW_H
@@ -0,0 +1,118 @@
+#include "soa_cow.hpp"
+#include <cstdio>
+#include <cstdint>
+using namespace std;
+
+static bool cow_values_match(const hvh::htable<uint64_t, uint64_t>& table, size_t num_rows, uint64_t offset) {
+	if (table.size() != num_rows) return false;
+	for (uint64_t i = 0; i < num_rows; ++i) {
+		size_t index = table.find(i);
+		if (index == SIZE_MAX || table.at<1>(index) != i + offset) return false;
+	}
+	return true;
+}
+
+// An soa which notes when it's destroyed while it still holds rows.
+static bool snapshot_freed = false;
+struct tracked_snapshot : hvh::soa<int> {
+	tracked_snapshot() = default;
+	tracked_snapshot(tracked_snapshot&&) = default;
+	~tracked_snapshot() { if (size()) snapshot_freed = true; }
+};
+
+bool soa_cow_test() {
+	printf("Testing soa_cow...\n");
+	bool success = true;
+
+	hvh::cow_allocator allocator;
+	hvh::htable<uint64_t, uint64_t> table;
+	table.set_allocator(allocator);
+	for (uint64_t i = 0; i < 100000; ++i) table.insert(i, i);
+
+	{
+		// The clone keeps its point-in-time view while the original changes.
+		hvh::htable<uint64_t, uint64_t> snapshot = table.clone();
+		for (size_t i = 0; i < table.size(); ++i) table.at<1>(i) += 1;
+		table.erase(5);
+		if (!cow_values_match(snapshot, 100000, 0)) {
+			printf("Snapshot changed when the original was modified.\n");
+			success = false;
+		}
+		table.insert(5, 6);
+		if (!cow_values_match(table, 100000, 1)) {
+			printf("Original is wrong after taking a snapshot.\n");
+			success = false;
+		}
+	}
+
+	{
+		// Cloning again after the first clone is gone folds the changes back into shared memory.
+		for (size_t i = 0; i < 1000; ++i) table.at<1>(i * 50) = table.at<0>(i * 50) + 2;
+		for (size_t i = 0; i < table.size(); ++i) table.at<1>(i) = table.at<0>(i) + 2;
+		hvh::htable<uint64_t, uint64_t> snapshot = table.clone();
+		for (size_t i = 0; i < table.size(); ++i) table.at<1>(i) += 1;
+
+		// Cloning while an older clone is alive.
+		hvh::htable<uint64_t, uint64_t> snapshot2 = table.clone();
+		for (size_t i = 0; i < table.size(); ++i) table.at<1>(i) += 1;
+		if (!cow_values_match(snapshot, 100000, 2) || !cow_values_match(snapshot2, 100000, 3) || !cow_values_match(table, 100000, 4)) {
+			printf("Repeated snapshots are inconsistent.\n");
+			success = false;
+		}
+
+		// Growing the original while clones are alive.
+		for (uint64_t i = 100000; i < 300000; ++i) table.insert(i, i + 4);
+		if (!cow_values_match(snapshot, 100000, 2) || !cow_values_match(table, 300000, 4)) {
+			printf("Snapshot is wrong after the original grew.\n");
+			success = false;
+		}
+	}
+
+	{
+		// Write a snapshot in the background while the original keeps changing.
+		FILE* file = tmpfile();
+		int fd = fileno(file);
+		future<bool> saved = hvh::write_stream_async(table.clone(), fd);
+		for (size_t i = 0; i < table.size(); ++i) table.at<1>(i) += 1;
+		if (!saved.get()) {
+			printf("Background snapshot failed.\n");
+			success = false;
+		}
+		rewind(file);
+		hvh::htable<uint64_t, uint64_t> loaded;
+		if (!hvh::read_stream(fd, loaded) || !cow_values_match(loaded, 300000, 4)) {
+			printf("Background snapshot does not match the table at the time it was taken.\n");
+			success = false;
+		}
+		fclose(file);
+	}
+
+	{
+		// The snapshot is freed as soon as it's been written, not when the future is.
+		FILE* file = tmpfile();
+		tracked_snapshot snapshot;
+		for (int i = 0; i < 1000; ++i) snapshot.push_back(i);
+		future<bool> saved = hvh::write_stream_async(std::move(snapshot), fileno(file));
+		saved.wait();
+		if (!snapshot_freed || !saved.get()) {
+			printf("A background snapshot should be freed before its future is ready.\n");
+			success = false;
+		}
+		fclose(file);
+	}
+
+	{
+		// Plain soa's can be cloned too.
+		hvh::soa<int, float> columns;
+		columns.set_allocator(allocator);
+		for (int i = 0; i < 5000; ++i) columns.push_back(i, (float)i);
+		hvh::soa<int, float> snapshot = columns.clone();
+		columns.data<0>()[10] = -1;
+		if (snapshot.size() != 5000 || snapshot.at<0>(10) != 10 || snapshot.at<1>(4999) != 4999.0f) {
+			printf("soa clone is wrong.\n");
+			success = false;
+		}
+	}
+
+	return success;
+}
@@ -0,0 +1,237 @@
+/* soa_mmap.hpp
+ * A persistent, file-backed struct-of-arrays
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Provides mapped_soa, an soa whose buffer is a shared mapping of a file.
+ * The file grows and shrinks along with the container's capacity, rows
+ * survive the process exiting, and the operating system pages columns in and
+ * out on demand, so the container can be much bigger than physical memory.
+ * Requires a POSIX system; growing in place uses mremap where available.
+ */
+#ifndef HVH_TOOLS_SOAMMAP_H
+#define HVH_TOOLS_SOAMMAP_H
+
+#include "soa.hpp"
+
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace hvh {
+
+	static constexpr char MAPPED_SOA_MAGIC[8] = { 'H', 'V', 'H', 'M', 'S', 'O', 'A', '\0' };
+	static constexpr uint32_t MAPPED_SOA_VERSION = 1;
+
+	// The first page of the file holds this header; the container's buffer follows it.
+	struct mapped_soa_header {
+		char magic[8];
+		uint32_t version;
+		uint32_t num_columns;
+		uint64_t column_signature;
+		uint64_t size;
+		uint64_t capacity;
+	};
+
+	// mapped_soa
+	// An soa which keeps its rows in a file.
+	// Only trivially copyable types can be stored, since their bytes are all that is saved.
+	// Everything soa can do works as usual; 'open' attaches the container to a file, and 'sync' makes it durable.
+	// The number of rows is recorded by 'sync' and 'close'; if the process dies in between,
+	// the file comes back with the rows it had as of the last 'sync' (as many of them as still fit, if it has since shrunk).
+	template <typename... Ts>
+	class mapped_soa : public soa<Ts...> {
+		static_assert((std::is_trivially_copyable<Ts>::value && ...), "Only trivially copyable types can be stored in a mapped_soa.");
+	public:
+
+		// mapped_soa()
+		// Constructs a container which isn't attached to a file.
+		// Until 'open' is called it behaves like an ordinary soa.
+		mapped_soa() {
+			myinterface.allocate = &mapped_soa::do_allocate;
+			myinterface.deallocate = &mapped_soa::do_deallocate;
+			myinterface.reallocate = &mapped_soa::do_reallocate;
+			myinterface.context = this;
+		}
+
+		mapped_soa(const mapped_soa&) = delete;
+		mapped_soa& operator = (const mapped_soa&) = delete;
+
+		// ~mapped_soa()
+		// Records the number of rows in the file and unmaps it.
+		~mapped_soa() { close(); }
+
+		// open(path)
+		// Attaches the container to the file at 'path', creating it if necessary.
+		// If the file already holds rows, they are loaded (lazily, by the operating system).
+		// The container must be empty and have no capacity.
+		// Returns false if the file can't be opened or mapped, or holds a container with different column types.
+		// Complexity: O(1).
+		bool open(const char* path) {
+			if (myfd >= 0 || this->mycapacity != 0) return false;
+			myfd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+			if (myfd < 0) return false;
+
+			struct stat info;
+			if (fstat(myfd, &info) != 0) return fail();
+			if (info.st_size == 0) {
+				// A new file gets a fresh header and no rows.
+				if (ftruncate(myfd, (off_t)HEADER_BYTES) != 0) return fail();
+				if (!map(HEADER_BYTES)) return fail();
+				memcpy(myheader->magic, MAPPED_SOA_MAGIC, sizeof(MAPPED_SOA_MAGIC));
+				myheader->version = MAPPED_SOA_VERSION;
+				myheader->num_columns = (uint32_t)sizeof...(Ts);
+				myheader->column_signature = column_signature();
+				myheader->size = 0;
+				myheader->capacity = 0;
+			}
+			else {
+				if ((size_t)info.st_size < HEADER_BYTES) return fail();
+				if (!map((size_t)info.st_size)) return fail();
+				if (memcmp(myheader->magic, MAPPED_SOA_MAGIC, sizeof(MAPPED_SOA_MAGIC)) != 0 ||
+					myheader->version != MAPPED_SOA_VERSION ||
+					myheader->num_columns != sizeof...(Ts) ||
+					myheader->column_signature != column_signature() ||
+					(mymapped - HEADER_BYTES) % buffer_bytes(1) != 0) return fail();
+				// The file is resized (and the columns moved) as soon as the capacity changes,
+				// but the header is only written by 'sync' and 'close', so the file's length is what says where the columns are.
+				// Rows past the last 'sync' are never counted, and if the container shrank since then, only the rows that fit are kept.
+				myheader->capacity = (mymapped - HEADER_BYTES) / buffer_bytes(1);
+				if (myheader->size > myheader->capacity) myheader->size = myheader->capacity;
+			}
+
+			this->myallocator = &myinterface;
+			if (myheader->capacity > 0) {
+				this->mycapacity = (size_t)myheader->capacity;
+				this->mysize = (size_t)myheader->size;
+				_soa_base<Ts...>& base = *this;
+				base.divy_buffer(buffer());
+			}
+			return true;
+		}
+
+		// sync()
+		// Records the number of rows in the file and waits for every change to reach the disk.
+		// Returns false if the container isn't attached to a file or the data can't be written.
+		// Complexity: O(n) in the number of modified pages.
+		bool sync() {
+			if (myfd < 0) return false;
+			write_header();
+			return msync(mymap, mymapped, MS_SYNC) == 0;
+		}
+
+		// close()
+		// Records the number of rows in the file, unmaps it, and detaches the container.
+		// The container is left empty, and can then be used as an ordinary soa or attached to another file.
+		// Changes reach the disk eventually, but use 'sync' first to be certain that they have.
+		// Complexity: O(1).
+		void close() {
+			if (myfd < 0) return;
+			write_header();
+			munmap(mymap, mymapped);
+			::close(myfd);
+			myfd = -1;
+			mymap = nullptr;
+			myheader = nullptr;
+			mymapped = 0;
+			_soa_base<Ts...>& base = *this;
+			base.nullify();
+			this->mysize = 0;
+			this->mycapacity = 0;
+			this->myallocator = nullptr;
+		}
+
+		// is_open()
+		// Returns true if the container is attached to a file.
+		inline bool is_open() const { return myfd >= 0; }
+
+		// The buffer belongs to the file, so it can't be cloned or given a different allocator.
+		soa<Ts...> clone() const = delete;
+		bool set_allocator(const soa_allocator*) = delete;
+
+	private:
+		// The header takes up a whole page, so that the buffer after it is page aligned.
+		static constexpr size_t HEADER_BYTES = 4096;
+
+		soa_allocator myinterface;
+		int myfd = -1;
+		void* mymap = nullptr;
+		mapped_soa_header* myheader = nullptr;
+		size_t mymapped = 0;
+
+		inline char* buffer() const { return (char*)mymap + HEADER_BYTES; }
+		inline size_t buffer_bytes(size_t capacity) const { return this->size_per_entry() * capacity; }
+
+		// A fingerprint of the column sizes, so that a file isn't opened as the wrong kind of container.
+		static uint64_t column_signature() {
+			uint64_t result = 14695981039346656037ull;
+			for (size_t size : { sizeof(Ts)... }) { result ^= (uint64_t)size; result *= 1099511628211ull; }
+			return result;
+		}
+
+		bool fail() {
+			if (mymap) munmap(mymap, mymapped);
+			::close(myfd);
+			myfd = -1;
+			mymap = nullptr;
+			myheader = nullptr;
+			mymapped = 0;
+			return false;
+		}
+
+		void write_header() {
+			myheader->size = this->mysize;
+			myheader->capacity = this->mycapacity;
+		}
+
+		bool map(size_t num_bytes) {
+			void* mem = mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, myfd, 0);
+			if (mem == MAP_FAILED) return false;
+			mymap = mem;
+			myheader = (mapped_soa_header*)mem;
+			mymapped = num_bytes;
+			return true;
+		}
+
+		// Changes the length of the file and of the mapping, keeping everything that fits in both.
+		bool resize_file(size_t num_bytes) {
+			if (num_bytes > mymapped && ftruncate(myfd, (off_t)num_bytes) != 0) return false;
+#if defined(__linux__)
+			void* mem = mremap(mymap, mymapped, num_bytes, MREMAP_MAYMOVE);
+			if (mem == MAP_FAILED) return false;
+#else
+			// The contents live in the file, so mapping it again brings them back.
+			void* mem = mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, myfd, 0);
+			if (mem == MAP_FAILED) return false;
+			munmap(mymap, mymapped);
+#endif
+			size_t oldmapped = mymapped;
+			mymap = mem;
+			myheader = (mapped_soa_header*)mem;
+			mymapped = num_bytes;
+			if (num_bytes < oldmapped) ftruncate(myfd, (off_t)num_bytes);
+			return true;
+		}
+
+		// The container only ever has one buffer: the part of the file after the header.
+		void* allocate(size_t num_bytes) {
+			if (mymapped != HEADER_BYTES) return nullptr;
+			if (!resize_file(HEADER_BYTES + num_bytes)) return nullptr;
+			return buffer();
+		}
+		void deallocate() { resize_file(HEADER_BYTES); }
+		void* reallocate(size_t new_bytes) {
+			if (!resize_file(HEADER_BYTES + new_bytes)) return nullptr;
+			return buffer();
+		}
+
+		static void* do_allocate(void* context, size_t num_bytes) { return ((mapped_soa*)context)->allocate(num_bytes); }
+		static void do_deallocate(void* context, void*, size_t) { ((mapped_soa*)context)->deallocate(); }
+		static void* do_reallocate(void* context, void*, size_t, size_t new_bytes) { return ((mapped_soa*)context)->reallocate(new_bytes); }
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SOAMMAP_H
@@ -0,0 +1,94 @@
+#include "soa_mmap.hpp"
+#include <cstdio>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/wait.h>
+using namespace std;
+
+static const char* mmap_test_path = "soa_mmap_test.dat";
+
+bool soa_mmap_test() {
+	printf("Testing soa_mmap...\n");
+	bool success = true;
+	remove(mmap_test_path);
+
+	{
+		hvh::mapped_soa<uint64_t, float, char> columns;
+		if (!columns.open(mmap_test_path)) {
+			printf("Failed to open a new mapped_soa.\n");
+			return false;
+		}
+		// Growing moves every column to its new place in the file.
+		for (uint64_t i = 0; i < 100000; ++i) columns.push_back(i, (float)i * 0.5f, (char)(i % 128));
+		if (!columns.sync()) {
+			printf("Failed to sync a mapped_soa.\n");
+			success = false;
+		}
+	}
+
+	{
+		// Rows survive being closed and reopened.
+		hvh::mapped_soa<uint64_t, float, char> columns;
+		if (!columns.open(mmap_test_path) || columns.size() != 100000) {
+			printf("Reopened mapped_soa should have 100000 rows, instead it has %zi.\n", columns.size());
+			success = false;
+		}
+		for (uint64_t i = 0; i < columns.size(); ++i) {
+			if (columns.at<0>(i) != i || columns.at<1>(i) != (float)i * 0.5f || columns.at<2>(i) != (char)(i % 128)) {
+				printf("Row %zi of the reopened mapped_soa is wrong.\n", (size_t)i);
+				success = false;
+				break;
+			}
+		}
+
+		// Shrinking packs the columns back together.
+		for (int i = 0; i < 60000; ++i) columns.pop_back();
+		columns.shrink_to_fit();
+		if (columns.capacity() != 40000 || columns.at<0>(39999) != 39999 || columns.at<1>(39999) != 39999 * 0.5f || columns.at<2>(12345) != (char)(12345 % 128)) {
+			printf("mapped_soa is wrong after shrink_to_fit.\n");
+			success = false;
+		}
+	}
+
+	{
+		// A file holding different column types must be refused.
+		hvh::mapped_soa<uint64_t, double> wrong;
+		if (wrong.open(mmap_test_path)) {
+			printf("mapped_soa should refuse a file with different column types.\n");
+			success = false;
+		}
+		hvh::mapped_soa<uint64_t, float, char> columns;
+		if (!columns.open(mmap_test_path) || columns.size() != 40000) {
+			printf("mapped_soa should have 40000 rows after shrinking and reopening.\n");
+			success = false;
+		}
+	}
+
+	{
+		// A process which grows the container after its last sync, then dies without closing it,
+		// leaves a file that's bigger than its header says.  It must still open, with the synced rows.
+		pid_t child = fork();
+		if (child == 0) {
+			hvh::mapped_soa<uint64_t, float, char> columns;
+			if (!columns.open(mmap_test_path)) _exit(1);
+			for (uint64_t i = 0; i < 100; ++i) columns.at<0>(i) = i * 7;
+			columns.sync();
+			for (uint64_t i = 0; i < 200000; ++i) columns.push_back(i, 0.0f, 'x');
+			_exit(0);
+		}
+		int status = -1;
+		waitpid(child, &status, 0);
+		hvh::mapped_soa<uint64_t, float, char> columns;
+		if (!columns.open(mmap_test_path) || columns.size() != 40000 || columns.capacity() < 240000) {
+			printf("mapped_soa should reopen with its 40000 synced rows after growing without a sync, instead it has %zi.\n", columns.size());
+			success = false;
+		}
+		else if (columns.at<0>(99) != 99 * 7 || columns.at<0>(39999) != 39999 || columns.at<2>(12345) != (char)(12345 % 128)) {
+			printf("Rows synced before growing were damaged.\n");
+			success = false;
+		}
+	}
+
+	remove(mmap_test_path);
+	return success;
+}
@@ -0,0 +1,103 @@
+/* soa_parallel.hpp
+ * Parallel loops over soa rows
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Provides parallel_for_each_row and parallel_transform, which split an soa
+ * (or htable) into cache-sized chunks of rows and process them on every core,
+ * and parallel_copy, which deep-copies a container the same way.
+ * Chunks run on thread_pool (from soa.hpp), a small work-stealing pool: each
+ * thread works through its own queue of chunks and steals from the others
+ * once it runs dry, so uneven chunks still keep every core busy.  Any other
+ * executor with a 'run(num_tasks, fn)' method can be used instead.
+ */
+#ifndef HVH_TOOLS_SOAPARALLEL_H
+#define HVH_TOOLS_SOAPARALLEL_H
+
+#include "soa.hpp"
+
+namespace hvh {
+
+	// The number of bytes of the selected columns to hand each task at a time.
+	// Chunks of this size fit comfortably in a core's L2 cache.
+	static constexpr size_t PARALLEL_CHUNK_BYTES = 1 << 16;
+
+	namespace _parallel_detail {
+
+		// Chunks are always a multiple of 64 rows, so each chunk spans a whole number of 64-byte lines of every column.
+		// Column buffers are only 16-byte aligned, though, so a chunk boundary can still fall inside a cache line,
+		// and the two chunks beside it may share that one line (costing a little false sharing, never a wrong result).
+		inline size_t chunk_rows(size_t row_bytes) {
+			size_t rows = PARALLEL_CHUNK_BYTES / std::max<size_t>(1, row_bytes);
+			return std::max<size_t>(64, rows - (rows % 64));
+		}
+
+		// Calls fn(i, elements...) if fn wants the row's index, or fn(elements...) otherwise.
+		template <typename Fn, typename... Elems>
+		inline decltype(auto) call_row(Fn& fn, size_t i, Elems&... elems) {
+			if constexpr (std::is_invocable<Fn&, size_t, Elems&...>::value) return fn(i, elems...);
+			else return fn(elems...);
+		}
+
+		template <typename Executor, typename Body>
+		void for_each_chunk(Executor& executor, size_t num_rows, size_t row_bytes, Body&& body) {
+			const size_t rows = chunk_rows(row_bytes);
+			const size_t num_chunks = (num_rows + rows - 1) / rows;
+			executor.run(num_chunks, [&](size_t chunk) {
+				size_t begin = chunk * rows;
+				body(begin, std::min(num_rows, begin + rows));
+			});
+		}
+
+	} // namespace _parallel_detail
+
+	// parallel_for_each_row<K...>(container, fn, executor)
+	// Calls fn on every row of an soa or htable, passing references to the elements of columns K...:
+	// `parallel_for_each_row<0, 2>(my_soa, [](int& a, float& c) { c = a * 0.5f; });`
+	// If fn takes a size_t before the elements, it is also given the row's index.
+	// Rows are split into cache-sized chunks which run on 'executor' (the default pool unless given another).
+	// fn is called on many threads at once, so it must only touch its own row.
+	// Don't change an htable's keys this way, since that would leave them in the wrong place in the hashmap.
+	// Complexity: O(n / threads).
+	template <size_t... Ks, typename... Ts, typename Fn, typename Executor = thread_pool>
+	void parallel_for_each_row(soa<Ts...>& container, Fn&& fn, Executor& executor = default_thread_pool()) {
+		static_assert(sizeof...(Ks) > 0, "Choose at least one column to visit.");
+		using types = std::tuple<Ts...>;
+		auto columns = std::make_tuple(container.template data<Ks>()...);
+		constexpr size_t row_bytes = (sizeof(typename std::tuple_element<Ks, types>::type) + ...);
+		_parallel_detail::for_each_chunk(executor, container.size(), row_bytes, [&](size_t begin, size_t end) {
+			std::apply([&](auto*... column) {
+				for (size_t i = begin; i < end; ++i) _parallel_detail::call_row(fn, i, column[i]...);
+			}, columns);
+		});
+	}
+
+	// parallel_transform<K>(container, fn, executor)
+	// Replaces every element of column K with the result of calling fn on it,
+	// or fn(i, element) if fn takes the row's index as well.
+	// Rows are split into cache-sized chunks which run on 'executor' (the default pool unless given another).
+	// Complexity: O(n / threads).
+	template <size_t K, typename... Ts, typename Fn, typename Executor = thread_pool>
+	void parallel_transform(soa<Ts...>& container, Fn&& fn, Executor& executor = default_thread_pool()) {
+		using T = typename std::tuple_element<K, std::tuple<Ts...>>::type;
+		T* column = container.template data<K>();
+		_parallel_detail::for_each_chunk(executor, container.size(), sizeof(T), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) column[i] = _parallel_detail::call_row(fn, i, column[i]);
+		});
+	}
+
+	// parallel_copy(container, executor)
+	// Returns a deep copy of an soa or htable, made by copying chunks of rows (and of an htable's hashmap) on every core.
+	// Non-trivial columns are copy-constructed, also in parallel.
+	// If an allocation fails, the copy comes back empty.
+	// Complexity: O(n / threads).
+	template <typename Container, typename Executor = thread_pool>
+	Container parallel_copy(const Container& source, Executor& executor = default_thread_pool()) {
+		Container result;
+		result.copy_from(source, executor);
+		return result;
+	}
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SOAPARALLEL_H
@@ -0,0 +1,92 @@
+#include "soa_parallel.hpp"
+#include "htable.hpp"
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+using namespace std;
+
+// An executor which runs everything on the calling thread, in order.
+struct serial_executor {
+	template <typename Fn>
+	void run(size_t num_tasks, Fn&& fn) { for (size_t i = 0; i < num_tasks; ++i) fn(i); }
+};
+
+bool soa_parallel_test() {
+	printf("Testing soa_parallel...\n");
+	bool success = true;
+
+	hvh::soa<int, double, float> columns;
+	for (int i = 0; i < 1000000; ++i) columns.push_back(i, 0.0, (float)i);
+
+	hvh::thread_pool pool(4);
+	hvh::parallel_for_each_row<0, 1>(columns, [](int& a, double& b) { b = a * 2.0; }, pool);
+	hvh::parallel_transform<2>(columns, [](float c) { return c + 1.0f; }, pool);
+	for (size_t i = 0; i < columns.size(); ++i) {
+		if (columns.at<1>(i) != (double)i * 2.0 || columns.at<2>(i) != (float)i + 1.0f) {
+			printf("Row %zi is wrong after parallel_for_each_row and parallel_transform.\n", i);
+			success = false;
+			break;
+		}
+	}
+
+	// Functions which take a row index are given one.
+	atomic<size_t> mismatches(0);
+	hvh::parallel_for_each_row<0>(columns, [&](size_t i, const int& a) { if ((size_t)a != i) ++mismatches; });
+	hvh::parallel_transform<1>(columns, [](size_t i, double) { return (double)i; });
+	if (mismatches != 0 || columns.at<1>(123456) != 123456.0) {
+		printf("Row indices were not passed correctly.\n");
+		success = false;
+	}
+
+	// Any executor with a 'run' method can be used.
+	serial_executor serial;
+	size_t visited = 0;
+	hvh::parallel_for_each_row<2>(columns, [&](float&) { ++visited; }, serial);
+	if (visited != columns.size()) {
+		printf("A custom executor visited %zi rows instead of %zi.\n", visited, columns.size());
+		success = false;
+	}
+
+	// Tasks may start more work on the same pool.
+	atomic<size_t> inner(0);
+	pool.run(8, [&](size_t) { pool.run(100, [&](size_t) { ++inner; }); });
+	if (inner != 800) {
+		printf("Nested runs completed %zi tasks instead of 800.\n", (size_t)inner);
+		success = false;
+	}
+
+	// Copies must copy-construct strings rather than share their memory, whether made in parallel or not.
+	hvh::soa<int, string, double> original;
+	for (int i = 0; i < 100000; ++i) original.push_back(i, "row " + to_string(i) + string(i % 40, '.'), i * 0.25);
+	hvh::soa<int, string, double> copied = hvh::parallel_copy(original, pool);
+	hvh::soa<int, string, double> constructed(original);
+	original.at<1>(500) = "changed";
+	for (size_t i = 0; i < original.size(); ++i) {
+		string expected = "row " + to_string(i) + string(i % 40, '.');
+		if (copied.at<0>(i) != (int)i || copied.at<1>(i) != expected || copied.at<2>(i) != i * 0.25 || constructed.at<1>(i) != expected) {
+			printf("Row %zi of a copied soa does not match the original.\n", i);
+			success = false;
+			break;
+		}
+	}
+
+	hvh::htable<string, int> table;
+	for (int i = 0; i < 100000; ++i) table.insert(to_string(i % 70000), i);
+	hvh::htable<string, int> tablecopy = hvh::parallel_copy(table, pool);
+	hvh::htable<string, int> bigger;
+	bigger.reserve(300000);
+	bigger.copy_from(table, pool);
+	if (tablecopy.size() != table.size() || tablecopy.count("123") != 2 || tablecopy.at<1>(tablecopy.find("69999")) != 69999 ||
+		bigger.size() != table.size() || bigger.count("123") != 2 || bigger.at<1>(bigger.find("5")) != 5) {
+		printf("A copied htable does not contain the expected entries.\n");
+		success = false;
+	}
+	hvh::htable<string, int> empty, emptycopy(empty);
+	emptycopy.insert("one", 1);
+	if (emptycopy.find("one") != 0) {
+		printf("A copy of an empty htable did not work.\n");
+		success = false;
+	}
+
+	return success;
+}
@@ -0,0 +1,322 @@
+/* soa_query.hpp
+ * Relational operations on soa and htable
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Provides hash joins between the rows of an soa (or htable) and the entries
+ * of an htable.  The probing side is read in batches: every key in a batch
+ * has its hashmap slot prefetched before any of them are looked up, so the
+ * cache misses overlap instead of being paid one at a time.  Also provides
+ * group_by, which aggregates one column for each distinct value of another
+ * using an htable.  Large queries can be split across threads using any
+ * executor from soa_parallel.hpp.
+ */
+#ifndef HVH_TOOLS_SOAQUERY_H
+#define HVH_TOOLS_SOAQUERY_H
+
+#include "htable.hpp"
+#include "soa_parallel.hpp"
+
+#include <vector>
+
+namespace hvh {
+
+	// Which rows a join produces.
+	enum class join_kind {
+		// Every pair of a probe row and a build entry with the same key.
+		inner,
+		// Each probe row that has at least one matching build entry, paired with the first match.
+		left_semi,
+		// Each probe row that has no matching build entry, paired with SIZE_MAX.
+		anti
+	};
+
+	// columns<K...>
+	// Names a set of columns to copy into the result of 'hash_join_columns'.
+	template <size_t... Ks>
+	struct columns {};
+
+	// The number of probe rows whose hashmap slots are prefetched together.
+	// Enough to keep several cache misses in flight, few enough that the slots are still cached when we get to them.
+	static constexpr size_t JOIN_BATCH = 16;
+
+	// serial_executor
+	// An executor which runs every task on the calling thread.  Queries use it unless they're given another.
+	struct serial_executor {
+		template <typename Fn>
+		void run(size_t num_tasks, Fn&& fn) { for (size_t i = 0; i < num_tasks; ++i) fn(i); }
+	};
+
+	namespace _query_detail {
+
+		// Serial queries do all their rows in one chunk; anything else gets cache-sized chunks.
+		template <typename Executor>
+		inline size_t rows_per_chunk(size_t row_bytes) {
+			if (std::is_same<typename std::decay<Executor>::type, serial_executor>::value) return SIZE_MAX;
+			return _parallel_detail::chunk_rows(row_bytes);
+		}
+
+		inline size_t count_chunks(size_t num_rows, size_t rows_per_chunk) {
+			return (num_rows == 0) ? 0 : 1 + ((num_rows - 1) / rows_per_chunk);
+		}
+
+		template <size_t K, typename... Ps, typename KeyT, typename... Bs>
+		void probe_range(const soa<Ps...>& probe, const htable<KeyT, Bs...>& build, join_kind kind,
+			size_t begin, size_t end, soa<size_t, size_t>& out)
+		{
+			const KeyT* keys = probe.template data<K>();
+			size_t hashes[JOIN_BATCH];
+			for (size_t batch = begin; batch < end; batch += JOIN_BATCH) {
+				size_t batch_end = std::min(end, batch + JOIN_BATCH);
+				// Hash each key once, bring in every slot, then every entry those slots point at, then do the lookups.
+				for (size_t i = batch; i < batch_end; ++i) hashes[i - batch] = std::hash<KeyT>{}(keys[i]);
+				for (size_t i = batch; i < batch_end; ++i) build.prefetch_hashed(hashes[i - batch]);
+				for (size_t i = batch; i < batch_end; ++i) build.prefetch_entry_hashed(hashes[i - batch]);
+				for (size_t i = batch; i < batch_end; ++i) {
+					size_t hashc = SIZE_MAX;
+					size_t match = build.find_hashed(keys[i], hashes[i - batch], hashc);
+					switch (kind) {
+					case join_kind::inner:
+						for (; match != SIZE_MAX; match = build.find(keys[i], false, hashc)) out.push_back(i, match);
+						break;
+					case join_kind::left_semi:
+						if (match != SIZE_MAX) out.push_back(i, match);
+						break;
+					case join_kind::anti:
+						if (match == SIZE_MAX) out.push_back(i, SIZE_MAX);
+						break;
+					}
+				}
+			}
+		}
+
+		template <size_t K, typename... Ps, typename KeyT, typename... Bs, typename Executor>
+		soa<size_t, size_t> join(const soa<Ps...>& probe, const htable<KeyT, Bs...>& build, join_kind kind, Executor& executor) {
+			static_assert(std::is_same<typename std::tuple_element<K, std::tuple<Ps...>>::type, KeyT>::value,
+				"The probe column must have the same type as the table's keys.");
+			const size_t num_rows = probe.size();
+			const size_t rows_per_chunk = _query_detail::rows_per_chunk<Executor>(sizeof(KeyT));
+			const size_t num_chunks = count_chunks(num_rows, rows_per_chunk);
+			if (num_chunks <= 1) {
+				soa<size_t, size_t> result;
+				probe_range<K>(probe, build, kind, 0, num_rows, result);
+				return result;
+			}
+
+			// Each chunk collects its own matches, then they're stitched together in order.
+			std::vector<soa<size_t, size_t>> parts(num_chunks);
+			executor.run(num_chunks, [&](size_t chunk) {
+				size_t begin = chunk * rows_per_chunk;
+				probe_range<K>(probe, build, kind, begin, std::min(num_rows, begin + rows_per_chunk), parts[chunk]);
+			});
+			std::vector<size_t> offsets(num_chunks + 1, 0);
+			for (size_t chunk = 0; chunk < num_chunks; ++chunk) offsets[chunk + 1] = offsets[chunk] + parts[chunk].size();
+			soa<size_t, size_t> result;
+			if (!result.resize(offsets[num_chunks])) return result;
+			executor.run(num_chunks, [&](size_t chunk) {
+				size_t count = parts[chunk].size();
+				if (count == 0) return;
+				memcpy(result.template data<0>() + offsets[chunk], parts[chunk].template data<0>(), count * sizeof(size_t));
+				memcpy(result.template data<1>() + offsets[chunk], parts[chunk].template data<1>(), count * sizeof(size_t));
+			});
+			return result;
+		}
+
+		template <size_t... Js, size_t... Ks, typename Out, typename Source>
+		inline void copy_row(std::index_sequence<Js...>, columns<Ks...>, Out& out, size_t to, const Source& source, size_t from) {
+			((out.template data<Js>()[to] = source.template data<Ks>()[from]), ...);
+		}
+
+		template <size_t Offset, size_t... Js>
+		std::index_sequence<(Offset + Js)...> shift(std::index_sequence<Js...>) { return {}; }
+
+	} // namespace _query_detail
+
+	// hash_join<K>(probe, build, kind, executor)
+	// Looks up column K of every row of 'probe' in the htable 'build', whose keys must have the same type.
+	// Returns an soa of (probe row, build entry) index pairs, in probe row order; see join_kind for which pairs are produced.
+	// If an executor (like a thread_pool) is given, the probe rows are split into chunks which are joined in parallel.
+	// 'build' must not be changed while the join is running.
+	// Complexity: O(n) in the number of probe rows and matches.
+	template <size_t K, typename... Ps, typename KeyT, typename... Bs, typename Executor = serial_executor>
+	soa<size_t, size_t> hash_join(const soa<Ps...>& probe, const htable<KeyT, Bs...>& build,
+		join_kind kind = join_kind::inner, Executor&& executor = Executor())
+	{
+		return _query_detail::join<K>(probe, build, kind, executor);
+	}
+
+	// hash_join_columns<K>(probe, columns<P...>, build, columns<B...>, kind, executor)
+	// Joins like 'hash_join', but returns a new soa holding columns P... of each probe row followed by columns B... of its build entry:
+	// `auto joined = hash_join_columns<1>(events, columns<0, 2>{}, users, columns<1>{});`
+	// Build columns are left default-constructed in an anti-join, since there's no entry to copy them from.
+	// Complexity: O(n) in the number of probe rows and matches.
+	template <size_t K, size_t... PKs, size_t... BKs, typename... Ps, typename KeyT, typename... Bs, typename Executor = serial_executor>
+	soa<typename std::tuple_element<PKs, std::tuple<Ps...>>::type..., typename std::tuple_element<BKs, std::tuple<KeyT, Bs...>>::type...>
+	hash_join_columns(const soa<Ps...>& probe, columns<PKs...> probe_columns, const htable<KeyT, Bs...>& build, columns<BKs...> build_columns,
+		join_kind kind = join_kind::inner, Executor&& executor = Executor())
+	{
+		soa<size_t, size_t> pairs = _query_detail::join<K>(probe, build, kind, executor);
+
+		soa<typename std::tuple_element<PKs, std::tuple<Ps...>>::type..., typename std::tuple_element<BKs, std::tuple<KeyT, Bs...>>::type...> result;
+		if (!result.resize(pairs.size())) return result;
+		const size_t* probe_rows = pairs.template data<0>();
+		const size_t* build_rows = pairs.template data<1>();
+		const size_t rows_per_chunk = _query_detail::rows_per_chunk<Executor>(sizeof(size_t) * 2);
+		executor.run(_query_detail::count_chunks(pairs.size(), rows_per_chunk), [&](size_t chunk) {
+			size_t begin = chunk * rows_per_chunk;
+			size_t end = begin + std::min(pairs.size() - begin, rows_per_chunk);
+			for (size_t i = begin; i < end; ++i) {
+				_query_detail::copy_row(std::make_index_sequence<sizeof...(PKs)>{}, probe_columns, result, i, probe, probe_rows[i]);
+				if (build_rows[i] != SIZE_MAX) {
+					_query_detail::copy_row(_query_detail::shift<sizeof...(PKs)>(std::make_index_sequence<sizeof...(BKs)>{}),
+						build_columns, result, i, build, build_rows[i]);
+				}
+			}
+		});
+		return result;
+	}
+
+	// Aggregations for 'group_by'.
+	// Each one says what type its result is, how a group starts from its first value ('first'),
+	// how further values are added ('add'), and how two partial results are combined ('merge').
+	// Other aggregations can be written the same way.
+
+	// sum_op: the total of the values in each group.
+	struct sum_op {
+		template <typename T> using result_type = T;
+		template <typename T> static inline T first(const T& value) { return value; }
+		template <typename T> static inline void add(T& total, const T& value) { total += value; }
+		template <typename T> static inline void merge(T& total, const T& other) { total += other; }
+	};
+
+	// count_op: the number of rows in each group.
+	struct count_op {
+		template <typename T> using result_type = size_t;
+		template <typename T> static inline size_t first(const T&) { return 1; }
+		template <typename T> static inline void add(size_t& count, const T&) { ++count; }
+		static inline void merge(size_t& count, size_t other) { count += other; }
+	};
+
+	// min_op: the smallest value in each group.
+	struct min_op {
+		template <typename T> using result_type = T;
+		template <typename T> static inline T first(const T& value) { return value; }
+		template <typename T> static inline void add(T& least, const T& value) { if (value < least) least = value; }
+		template <typename T> static inline void merge(T& least, const T& other) { if (other < least) least = other; }
+	};
+
+	// max_op: the largest value in each group.
+	struct max_op {
+		template <typename T> using result_type = T;
+		template <typename T> static inline T first(const T& value) { return value; }
+		template <typename T> static inline void add(T& most, const T& value) { if (most < value) most = value; }
+		template <typename T> static inline void merge(T& most, const T& other) { if (most < other) most = other; }
+	};
+
+	// Parallel group-bys split the groups into this many partitions by hash, each of which is merged on its own thread.
+	static constexpr size_t GROUP_BY_PARTITIONS = 16;
+
+	namespace _query_detail {
+
+		template <typename KeyT>
+		inline size_t group_partition(const KeyT& key) {
+			// Use the high bits of a remixed hash, which have nothing to do with where the key lands in each htable.
+			return (size_t)(((uint64_t)std::hash<KeyT>{}(key) * 0x9E3779B97F4A7C15ull) >> 60) % GROUP_BY_PARTITIONS;
+		}
+
+		template <typename Op, typename KeyT, typename R, typename V>
+		inline void accumulate(htable<KeyT, R>& groups, const KeyT& key, const V& value) {
+			size_t index = groups.find(key);
+			if (index == SIZE_MAX) groups.insert(key, Op::first(value));
+			else Op::add(groups.template at<1>(index), value);
+		}
+
+		template <typename Op, typename KeyT, typename R>
+		inline void combine(htable<KeyT, R>& groups, const htable<KeyT, R>& partial) {
+			for (size_t i = 0; i < partial.size(); ++i) {
+				size_t index = groups.find(partial.template at<0>(i));
+				if (index == SIZE_MAX) groups.insert(partial.template at<0>(i), partial.template at<1>(i));
+				else Op::merge(groups.template at<1>(index), partial.template at<1>(i));
+			}
+		}
+
+	} // namespace _query_detail
+
+	// group_by_query<K, Ts...>
+	// The result of 'group_by<K>(container)'; call 'aggregate' on it to compute something for each group.
+	template <size_t K, typename... Ts>
+	class group_by_query {
+	public:
+		using key_type = typename std::tuple_element<K, std::tuple<Ts...>>::type;
+
+		explicit group_by_query(const soa<Ts...>& source) : mysource(source) {}
+
+		// aggregate<V>(op, executor)
+		// Returns an htable with one entry for each distinct value in column K,
+		// holding the result of 'op' (sum_op, count_op, min_op, max_op, or one of your own) over column V of that group's rows.
+		// If an executor (like a thread_pool) is given, large inputs are aggregated in parallel:
+		// each task pre-aggregates a range of rows into partitions by hash, then each partition is merged on its own.
+		// Groups come out in no particular order.
+		// Complexity: O(n).
+		template <size_t V, typename Op, typename Executor = serial_executor>
+		htable<key_type, typename Op::template result_type<typename std::tuple_element<V, std::tuple<Ts...>>::type>>
+		aggregate(Op, Executor&& executor = Executor()) const {
+			using value_type = typename std::tuple_element<V, std::tuple<Ts...>>::type;
+			using result_type = typename Op::template result_type<value_type>;
+			using table_type = htable<key_type, result_type>;
+			const key_type* keys = mysource.template data<K>();
+			const value_type* values = mysource.template data<V>();
+			const size_t num_rows = mysource.size();
+
+			const size_t rows_per_chunk = _query_detail::rows_per_chunk<Executor>(sizeof(key_type) + sizeof(value_type));
+			const size_t num_tasks = std::min(_query_detail::count_chunks(num_rows, rows_per_chunk), GROUP_BY_PARTITIONS);
+			if (num_tasks <= 1) {
+				table_type result;
+				for (size_t i = 0; i < num_rows; ++i) _query_detail::accumulate<Op>(result, keys[i], values[i]);
+				return result;
+			}
+
+			// Pre-aggregate each range of rows into one small table per partition.
+			std::vector<table_type> partials(num_tasks * GROUP_BY_PARTITIONS);
+			executor.run(num_tasks, [&](size_t task) {
+				size_t begin = (num_rows * task) / num_tasks, end = (num_rows * (task + 1)) / num_tasks;
+				table_type* mine = &partials[task * GROUP_BY_PARTITIONS];
+				for (size_t i = begin; i < end; ++i) {
+					_query_detail::accumulate<Op>(mine[_query_detail::group_partition(keys[i])], keys[i], values[i]);
+				}
+			});
+
+			// A key only ever appears in one partition, so the partitions can be merged at the same time.
+			std::vector<table_type> merged(GROUP_BY_PARTITIONS);
+			executor.run(GROUP_BY_PARTITIONS, [&](size_t part) {
+				// The partition has at least as many groups as its biggest partial table.
+				size_t largest = 0;
+				for (size_t task = 0; task < num_tasks; ++task) largest = std::max(largest, partials[task * GROUP_BY_PARTITIONS + part].size());
+				merged[part].reserve(largest);
+				for (size_t task = 0; task < num_tasks; ++task) _query_detail::combine<Op>(merged[part], partials[task * GROUP_BY_PARTITIONS + part]);
+			});
+
+			size_t num_groups = 0;
+			for (const table_type& part : merged) num_groups += part.size();
+			table_type result;
+			if (!result.reserve(num_groups)) return result;
+			for (const table_type& part : merged) {
+				for (size_t i = 0; i < part.size(); ++i) result.insert(part.template at<0>(i), part.template at<1>(i));
+			}
+			return result;
+		}
+
+	private:
+		const soa<Ts...>& mysource;
+	};
+
+	// group_by<K>(container)
+	// Groups the rows of an soa (or htable) by the value in column K:
+	// `htable<int, double> totals = group_by<0>(sales).aggregate<2>(sum_op{});`
+	// The container must outlive the query and not change until it's done.
+	template <size_t K, typename... Ts>
+	inline group_by_query<K, Ts...> group_by(const soa<Ts...>& source) { return group_by_query<K, Ts...>(source); }
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SOAQUERY_H
@@ -0,0 +1,149 @@
+#include "soa_query.hpp"
+#include <string>
+#include <vector>
+#include <cstdio>
+using namespace std;
+
+// A key which counts how many times it's been hashed.
+struct join_counted_key {
+	int value;
+	bool operator == (const join_counted_key& other) const { return value == other.value; }
+};
+static size_t join_hashes = 0;
+namespace std {
+	template <> struct hash<join_counted_key> {
+		size_t operator()(const join_counted_key& key) const {
+			++join_hashes;
+			return std::hash<int>{}(key.value);
+		}
+	};
+}
+
+bool soa_query_test() {
+	printf("Testing soa_query...\n");
+	bool success = true;
+
+	// Users 0 through 999, with every tenth user appearing twice.
+	hvh::htable<int, string> users;
+	for (int i = 0; i < 1000; ++i) {
+		users.insert(i, "user" + to_string(i));
+		if (i % 10 == 0) users.insert(i, "alias" + to_string(i));
+	}
+	// Events refer to users 0 through 1499, so a third of them have no user.
+	hvh::soa<double, int, string> events;
+	for (int i = 0; i < 150000; ++i) events.push_back(i * 0.5, (i * 7) % 1500, "event" + to_string(i));
+
+	size_t expected_inner = 0, expected_semi = 0;
+	for (size_t i = 0; i < events.size(); ++i) {
+		size_t matches = users.count(events.at<1>(i));
+		expected_inner += matches;
+		expected_semi += (matches > 0);
+	}
+
+	hvh::thread_pool pool(4);
+	for (int threaded = 0; threaded < 2; ++threaded) {
+		hvh::soa<size_t, size_t> inner = threaded ? hvh::hash_join<1>(events, users, hvh::join_kind::inner, pool) : hvh::hash_join<1>(events, users);
+		hvh::soa<size_t, size_t> semi = threaded ? hvh::hash_join<1>(events, users, hvh::join_kind::left_semi, pool) : hvh::hash_join<1>(events, users, hvh::join_kind::left_semi);
+		hvh::soa<size_t, size_t> anti = threaded ? hvh::hash_join<1>(events, users, hvh::join_kind::anti, pool) : hvh::hash_join<1>(events, users, hvh::join_kind::anti);
+		if (inner.size() != expected_inner || semi.size() != expected_semi || anti.size() != events.size() - expected_semi) {
+			printf("hash_join (%s) produced %zi/%zi/%zi rows, expected %zi/%zi/%zi.\n", threaded ? "threaded" : "serial",
+				inner.size(), semi.size(), anti.size(), expected_inner, expected_semi, events.size() - expected_semi);
+			success = false;
+			continue;
+		}
+		for (size_t i = 0; i < inner.size(); ++i) {
+			if (events.at<1>(inner.at<0>(i)) != users.at<0>(inner.at<1>(i)) || (i > 0 && inner.at<0>(i) < inner.at<0>(i - 1))) {
+				printf("Inner join pair %zi doesn't match, or is out of order.\n", i);
+				success = false;
+				break;
+			}
+		}
+		for (size_t i = 0; i < anti.size(); ++i) {
+			if (users.count(events.at<1>(anti.at<0>(i))) != 0 || anti.at<1>(i) != SIZE_MAX) {
+				printf("Anti join row %zi has a matching user.\n", i);
+				success = false;
+				break;
+			}
+		}
+	}
+
+	// Materialized columns come out in the order they're asked for.
+	auto joined = hvh::hash_join_columns<1>(events, hvh::columns<2, 1>{}, users, hvh::columns<1>{}, hvh::join_kind::inner, pool);
+	if (joined.size() != expected_inner) {
+		printf("hash_join_columns produced %zi rows, expected %zi.\n", joined.size(), expected_inner);
+		success = false;
+	}
+	for (size_t i = 0; i < joined.size(); ++i) {
+		const string& name = joined.at<2>(i);
+		string id = to_string(joined.at<1>(i));
+		if (name != "user" + id && name != "alias" + id) {
+			printf("Joined row %zi pairs user %i with '%s'.\n", i, joined.at<1>(i), name.c_str());
+			success = false;
+			break;
+		}
+	}
+	auto unmatched = hvh::hash_join_columns<1>(events, hvh::columns<0>{}, users, hvh::columns<1>{}, hvh::join_kind::anti);
+	if (unmatched.size() != events.size() - expected_semi || unmatched.at<1>(0) != "") {
+		printf("hash_join_columns anti join should leave build columns empty.\n");
+		success = false;
+	}
+
+	// Joining with an empty table finds nothing.
+	hvh::htable<int, string> nobody;
+	if (hvh::hash_join<1>(events, nobody).size() != 0 || hvh::hash_join<1>(events, nobody, hvh::join_kind::anti).size() != events.size()) {
+		printf("Joining with an empty table gave the wrong answer.\n");
+		success = false;
+	}
+
+	// Group-by must agree between serial and parallel runs, and with a straightforward count.
+	hvh::soa<int, string, int64_t> sales;
+	for (int i = 0; i < 200000; ++i) sales.push_back((i * 31) % 997, "store" + to_string(i % 13), (int64_t)(i % 1000) - 300);
+	vector<int64_t> sums(997, 0), mins(997, INT64_MAX), maxes(997, INT64_MIN);
+	vector<size_t> counts(997, 0);
+	for (size_t i = 0; i < sales.size(); ++i) {
+		int key = sales.at<0>(i);
+		int64_t value = sales.at<2>(i);
+		sums[key] += value;
+		counts[key] += 1;
+		mins[key] = min(mins[key], value);
+		maxes[key] = max(maxes[key], value);
+	}
+	for (int threaded = 0; threaded < 2; ++threaded) {
+		hvh::htable<int, int64_t> totals = threaded ? hvh::group_by<0>(sales).aggregate<2>(hvh::sum_op{}, pool) : hvh::group_by<0>(sales).aggregate<2>(hvh::sum_op{});
+		hvh::htable<int, size_t> tallies = threaded ? hvh::group_by<0>(sales).aggregate<2>(hvh::count_op{}, pool) : hvh::group_by<0>(sales).aggregate<2>(hvh::count_op{});
+		hvh::htable<int, int64_t> least = threaded ? hvh::group_by<0>(sales).aggregate<2>(hvh::min_op{}, pool) : hvh::group_by<0>(sales).aggregate<2>(hvh::min_op{});
+		hvh::htable<int, int64_t> most = threaded ? hvh::group_by<0>(sales).aggregate<2>(hvh::max_op{}, pool) : hvh::group_by<0>(sales).aggregate<2>(hvh::max_op{});
+		if (totals.size() != 997 || tallies.size() != 997 || least.size() != 997 || most.size() != 997) {
+			printf("group_by (%s) should find 997 groups.\n", threaded ? "threaded" : "serial");
+			success = false;
+			continue;
+		}
+		for (int key = 0; key < 997; ++key) {
+			if (totals.at<1>(totals.find(key)) != sums[key] || tallies.at<1>(tallies.find(key)) != counts[key] ||
+				least.at<1>(least.find(key)) != mins[key] || most.at<1>(most.find(key)) != maxes[key]) {
+				printf("group_by (%s) got the wrong aggregates for group %i.\n", threaded ? "threaded" : "serial", key);
+				success = false;
+				break;
+			}
+		}
+	}
+	hvh::htable<string, size_t> stores = hvh::group_by<1>(sales).aggregate<1>(hvh::count_op{}, pool);
+	if (stores.size() != 13 || stores.at<1>(stores.find("store0")) != 200000 / 13 + 1) {
+		printf("group_by on a string column got the wrong counts.\n");
+		success = false;
+	}
+
+	// Each probe key is hashed once, for the prefetches and the lookup alike.
+	hvh::htable<join_counted_key, int> counted;
+	for (int i = 0; i < 100; ++i) counted.insert(join_counted_key{ i }, i);
+	hvh::soa<join_counted_key> counted_probe;
+	for (int i = 0; i < 1000; ++i) counted_probe.push_back(join_counted_key{ i % 200 });
+	join_hashes = 0;
+	hvh::soa<size_t, size_t> counted_pairs = hvh::hash_join<0>(counted_probe, counted);
+	if (counted_pairs.size() != 500 || join_hashes != counted_probe.size()) {
+		printf("Joining %zi probe rows hashed their keys %zi times.\n", counted_probe.size(), join_hashes);
+		success = false;
+	}
+
+	return success;
+}
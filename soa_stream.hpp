@@ -0,0 +1,915 @@
+/* soa_stream.hpp
+ * Streaming serialization for soa and htable
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Writes and reads soa and htable containers to and from a file descriptor
+ * or a std::stream in large sequential chunks.  Unlike 'serialize' and
+ * 'deserialize', this works with variable-length columns (std::string and
+ * std::vector of trivially copyable types), which are stored as an array of
+ * offsets followed by a contiguous heap of bytes.
+ * At no point is the whole container copied into an intermediate buffer,
+ * and the container is never reallocated or rehashed to be written:
+ * when writing to a file descriptor, each column is gathered straight from
+ * the container's own memory with writev/pwritev.
+ */
+#ifndef HVH_TOOLS_SOASTREAM_H
+#define HVH_TOOLS_SOASTREAM_H
+
+#include "htable.hpp"
+#include "soa_compress.hpp"
+
+#include <string>
+#include <istream>
+#include <ostream>
+#include <memory>
+#include <cerrno>
+#include <utility> // For std::index_sequence
+#include <algorithm> // For std::max
+
+#ifdef _MSC_VER
+  #include <io.h>
+  #define _soa_stream_write(fd,data,size) _write(fd,data,(unsigned int)(size))
+  #define _soa_stream_read(fd,data,size) _read(fd,data,(unsigned int)(size))
+#else
+  #include <unistd.h>
+  #include <sys/uio.h>
+  #define _soa_stream_write(fd,data,size) ::write(fd,data,size)
+  #define _soa_stream_read(fd,data,size) ::read(fd,data,size)
+#endif
+
+namespace hvh {
+
+	/**************************************************************************
+	 * Sinks and Sources
+	 * A sink is anything with 'bool write(const void*, size_t)',
+	 * and a source is anything with 'bool read(void*, size_t)'.
+	 * Both return false if the whole request could not be satisfied.
+	 *************************************************************************/
+
+	// stream_span
+	// A run of bytes handed to a sink all at once by a gather write.
+	struct stream_span {
+		const void* data;
+		size_t num_bytes;
+	};
+
+	// The most spans the writer will gather up before handing them to the sink.
+	static constexpr size_t STREAM_MAX_GATHER = 64;
+
+	// fd_sink
+	// Writes to a file descriptor, retrying partial writes.
+	// If 'offset' is given, writing starts at that position in the file (using pwritev),
+	// and the file descriptor's own position is left alone.
+	struct fd_sink {
+		int fd;
+		int64_t offset;
+		fd_sink(int fd, int64_t offset = -1) : fd(fd), offset(offset) {}
+		bool write(const void* data, size_t num_bytes) {
+			stream_span span = { data, num_bytes };
+			return writev(&span, 1);
+		}
+
+		// writev(spans, n)
+		// Writes n spans back-to-back, using as few system calls as possible.
+		bool writev(const stream_span* spans, size_t count) {
+#ifdef _MSC_VER
+			if (offset >= 0 && _lseeki64(fd, offset, SEEK_SET) < 0) return false;
+			for (size_t i = 0; i < count; ++i) {
+				const char* cursor = (const char*)spans[i].data;
+				size_t num_bytes = spans[i].num_bytes;
+				while (num_bytes > 0) {
+					// Some platforms refuse single writes larger than 2GB.
+					size_t request = std::min(num_bytes, (size_t)1 << 30);
+					auto result = _soa_stream_write(fd, cursor, request);
+					if (result < 0) {
+						if (errno == EINTR) continue;
+						return false;
+					}
+					cursor += result;
+					num_bytes -= (size_t)result;
+					if (offset >= 0) offset += result;
+				}
+			}
+			return true;
+#else
+			struct iovec iov[STREAM_MAX_GATHER];
+			while (count > 0) {
+				size_t n = 0;
+				size_t batch = 0;
+				for (; batch < count && n < STREAM_MAX_GATHER; ++batch) {
+					if (spans[batch].num_bytes == 0) continue;
+					iov[n].iov_base = (void*)spans[batch].data;
+					iov[n].iov_len = spans[batch].num_bytes;
+					++n;
+				}
+				spans += batch;
+				count -= batch;
+
+				struct iovec* cursor = iov;
+				while (n > 0) {
+					ssize_t result = (offset >= 0) ? ::pwritev(fd, cursor, (int)n, (off_t)offset) : ::writev(fd, cursor, (int)n);
+					if (result < 0) {
+						if (errno == EINTR) continue;
+						return false;
+					}
+					if (result == 0) return false;
+					if (offset >= 0) offset += result;
+					// Skip past whatever made it out, which may end partway through a span.
+					size_t written = (size_t)result;
+					while (n > 0 && written >= cursor->iov_len) {
+						written -= cursor->iov_len;
+						++cursor;
+						--n;
+					}
+					if (n > 0) {
+						cursor->iov_base = (char*)cursor->iov_base + written;
+						cursor->iov_len -= written;
+					}
+				}
+			}
+			return true;
+#endif
+		}
+	};
+
+	// fd_source
+	// Reads from a file descriptor, retrying partial reads.
+	// Reaching the end of the file before the request is satisfied is an error.
+	// If 'offset' is given, reading starts at that position in the file (using pread),
+	// and the file descriptor's own position is left alone.
+	struct fd_source {
+		int fd;
+		int64_t offset;
+		fd_source(int fd, int64_t offset = -1) : fd(fd), offset(offset) {}
+		bool read(void* data, size_t num_bytes) {
+			char* cursor = (char*)data;
+			while (num_bytes > 0) {
+				size_t request = std::min(num_bytes, (size_t)1 << 30);
+#ifdef _MSC_VER
+				if (offset >= 0 && _lseeki64(fd, offset, SEEK_SET) < 0) return false;
+				auto result = _soa_stream_read(fd, cursor, request);
+#else
+				auto result = (offset >= 0) ? ::pread(fd, cursor, request, (off_t)offset) : _soa_stream_read(fd, cursor, request);
+#endif
+				if (result < 0) {
+					if (errno == EINTR) continue;
+					return false;
+				}
+				if (result == 0) return false;
+				cursor += result;
+				num_bytes -= (size_t)result;
+				if (offset >= 0) offset += result;
+			}
+			return true;
+		}
+	};
+
+	// ostream_sink
+	// Writes to a std::ostream.
+	struct ostream_sink {
+		std::ostream& os;
+		ostream_sink(std::ostream& os) : os(os) {}
+		bool write(const void* data, size_t num_bytes) {
+			os.write((const char*)data, (std::streamsize)num_bytes);
+			return (bool)os;
+		}
+	};
+
+	// istream_source
+	// Reads from a std::istream.
+	struct istream_source {
+		std::istream& is;
+		istream_source(std::istream& is) : is(is) {}
+		bool read(void* data, size_t num_bytes) {
+			is.read((char*)data, (std::streamsize)num_bytes);
+			return (bool)is;
+		}
+	};
+
+	// The size of the staging buffer used to batch up small writes and reads.
+	// Anything at least this big bypasses the buffer and goes straight to the sink or source.
+	static constexpr size_t STREAM_CHUNK_SIZE = 1 << 20;
+
+	// Runs at least this big are handed to a gathering sink in place instead of being copied.
+	static constexpr size_t STREAM_GATHER_THRESHOLD = 1 << 16;
+
+	namespace _stream_detail {
+
+		// Whether or not a sink has 'bool writev(const stream_span*, size_t)'.
+		template <typename Sink, typename = void>
+		struct has_writev : std::false_type {};
+		template <typename Sink>
+		struct has_writev<Sink, decltype((void)std::declval<Sink&>().writev((const stream_span*)nullptr, (size_t)0))> : std::true_type {};
+
+	} // namespace _stream_detail
+
+	// stream_writer
+	// Batches small writes into large sequential chunks before handing them to a sink.
+	// If the sink supports gather writes, large runs are handed over in place alongside the buffered bytes,
+	// so that a whole column goes out in the same system call as the headers around it without being copied.
+	template <typename Sink>
+	class stream_writer {
+	public:
+		stream_writer(Sink& sink) : mysink(sink), mybuffer(new char[STREAM_CHUNK_SIZE]) {}
+
+		// put(data, n)
+		// Appends n bytes to the stream.
+		// Returns false if the sink reports an error.
+		bool put(const void* data, size_t num_bytes) {
+			if (num_bytes == 0) return true;
+			if (myfill + num_bytes <= STREAM_CHUNK_SIZE) {
+				memcpy(mybuffer.get() + myfill, data, num_bytes);
+				myfill += num_bytes;
+				return true;
+			}
+			if (!flush()) return false;
+			if (num_bytes >= STREAM_CHUNK_SIZE) return mysink.write(data, num_bytes);
+			memcpy(mybuffer.get(), data, num_bytes);
+			myfill = num_bytes;
+			return true;
+		}
+
+		// put_ref(data, n)
+		// As 'put', but if the sink supports gather writes, large runs are not copied.
+		// 'data' must stay valid and unchanged until the next 'flush'.
+		bool put_ref(const void* data, size_t num_bytes) {
+			if constexpr (_stream_detail::has_writev<Sink>::value) {
+				if (num_bytes < STREAM_GATHER_THRESHOLD) return put(data, num_bytes);
+				// Room for the buffered bytes before this run, the run itself,
+				// and the buffered bytes after it, which 'flush' queues last.
+				if (mynumspans + 3 > STREAM_MAX_GATHER && !flush()) return false;
+				queue_buffered();
+				myspans[mynumspans++] = stream_span{ data, num_bytes };
+				return true;
+			}
+			else return put(data, num_bytes);
+		}
+
+		template <typename T>
+		inline bool put_value(const T& value) { return put(&value, sizeof(T)); }
+
+		// flush()
+		// Hands everything buffered so far to the sink.
+		bool flush() {
+			if constexpr (_stream_detail::has_writev<Sink>::value) {
+				queue_buffered();
+				if (mynumspans == 0) return true;
+				size_t count = mynumspans;
+				mynumspans = 0;
+				myfill = mymark = 0;
+				return mysink.writev(myspans, count);
+			}
+			else {
+				if (myfill == 0) return true;
+				size_t num_bytes = myfill;
+				myfill = 0;
+				return mysink.write(mybuffer.get(), num_bytes);
+			}
+		}
+
+	private:
+		Sink& mysink;
+		std::unique_ptr<char[]> mybuffer;
+		size_t myfill = 0;
+
+		// Spans waiting to be gathered, and how much of the buffer they already cover.
+		stream_span myspans[STREAM_MAX_GATHER];
+		size_t mynumspans = 0;
+		size_t mymark = 0;
+
+		inline void queue_buffered() {
+			if (myfill == mymark) return;
+			myspans[mynumspans++] = stream_span{ mybuffer.get() + mymark, myfill - mymark };
+			mymark = myfill;
+		}
+	};
+
+	// stream_reader
+	// Pulls large sequential chunks from a source and hands them out in smaller pieces.
+	// The reader never reads past what it has been told to 'expect',
+	// so it is safe to use on sources that can't be rewound, like sockets and pipes.
+	template <typename Source>
+	class stream_reader {
+	public:
+		stream_reader(Source& source) : mysource(source), mybuffer(new char[STREAM_CHUNK_SIZE]) {}
+
+		// expect(n)
+		// Tells the reader that at least n more bytes are known to follow in the source,
+		// allowing it to read them ahead in large chunks.
+		inline void expect(uint64_t num_bytes) { myahead += num_bytes; }
+
+		// get(data, n)
+		// Reads exactly n bytes from the stream.
+		// Returns false if the source runs dry or reports an error.
+		bool get(void* data, size_t num_bytes) {
+			char* cursor = (char*)data;
+			size_t available = myfill - mycursor;
+			if (num_bytes <= available) {
+				memcpy(cursor, mybuffer.get() + mycursor, num_bytes);
+				mycursor += num_bytes;
+				return true;
+			}
+			memcpy(cursor, mybuffer.get() + mycursor, available);
+			cursor += available;
+			num_bytes -= available;
+			mycursor = myfill = 0;
+
+			// Big reads, and reads beyond what we expect, go straight to the source.
+			if (num_bytes >= STREAM_CHUNK_SIZE || num_bytes > myahead) {
+				myahead -= std::min<uint64_t>(myahead, num_bytes);
+				return mysource.read(cursor, num_bytes);
+			}
+			// Otherwise, refill the buffer with as much as we know is there.
+			size_t refill = (size_t)std::min<uint64_t>(myahead, STREAM_CHUNK_SIZE);
+			if (!mysource.read(mybuffer.get(), refill)) return false;
+			myahead -= refill;
+			myfill = refill;
+			memcpy(cursor, mybuffer.get(), num_bytes);
+			mycursor = num_bytes;
+			return true;
+		}
+
+		template <typename T>
+		inline bool get_value(T& value) { return get(&value, sizeof(T)); }
+
+	private:
+		Source& mysource;
+		std::unique_ptr<char[]> mybuffer;
+		size_t myfill = 0;
+		size_t mycursor = 0;
+		uint64_t myahead = 0;
+	};
+
+	/**************************************************************************
+	 * Column Traits
+	 * Describe how each column type is laid out in a stream.
+	 * Fixed columns are written as raw bytes.
+	 * Variable columns are written as (rows + 1) uint64_t offsets,
+	 * followed by a heap containing the bytes of every element back-to-back.
+	 *************************************************************************/
+
+	template <typename T>
+	struct stream_column {
+		static_assert(std::is_trivially_copyable<T>::value,
+			"Only trivially copyable types, std::basic_string, and std::vector can be streamed.");
+		static constexpr bool variable = false;
+		static constexpr size_t unit_size = sizeof(T);
+	};
+
+	template <typename C, typename Traits, typename Alloc>
+	struct stream_column<std::basic_string<C, Traits, Alloc>> {
+		using type = std::basic_string<C, Traits, Alloc>;
+		static constexpr bool variable = true;
+		static constexpr size_t unit_size = sizeof(C);
+		static inline size_t length(const type& elem) { return elem.size(); }
+		static inline const void* bytes(const type& elem) { return elem.data(); }
+		static inline void* bytes(type& elem) { return &elem[0]; }
+		static inline void resize(type& elem, size_t n) { elem.resize(n); }
+	};
+
+	template <typename U, typename Alloc>
+	struct stream_column<std::vector<U, Alloc>> {
+		static_assert(std::is_trivially_copyable<U>::value,
+			"Only vectors of trivially copyable types can be streamed.");
+		using type = std::vector<U, Alloc>;
+		static constexpr bool variable = true;
+		static constexpr size_t unit_size = sizeof(U);
+		static inline size_t length(const type& elem) { return elem.size(); }
+		static inline const void* bytes(const type& elem) { return elem.data(); }
+		static inline void* bytes(type& elem) { return elem.data(); }
+		static inline void resize(type& elem, size_t n) { elem.resize(n); }
+	};
+
+	/**************************************************************************
+	 * Stream Format
+	 *************************************************************************/
+
+	static constexpr char STREAM_MAGIC[8] = { 'H', 'V', 'H', 'S', 'O', 'A', '\0', '\0' };
+	static constexpr uint32_t STREAM_VERSION = 1;
+
+	enum stream_column_kind : uint32_t {
+		STREAM_COLUMN_FIXED = 0,			// Raw bytes.
+		STREAM_COLUMN_VARIABLE = 1,			// Raw offsets, then the heap.
+		STREAM_COLUMN_FIXED_ENCODED = 2,	// Compressed blocks.
+		STREAM_COLUMN_VARIABLE_ENCODED = 3,	// uint64_t size of the offsets, compressed blocks of offsets, then the heap.
+	};
+
+	// stream_options
+	// Controls how 'write_stream' lays out each column.
+	// Options are recorded in the stream, so 'read_stream' doesn't need to be told about them.
+	struct stream_options {
+		// Bit K is set to compress column K (see soa_compress.hpp).
+		// Integer columns are compressed block by block, and variable-length columns have their offsets compressed.
+		// Columns which can't be compressed, like floats, are written normally regardless.
+		uint64_t compressed_columns = 0;
+
+		// compress_all()
+		// Returns options which compress every column that can be compressed.
+		static inline stream_options compress_all() { stream_options result; result.compressed_columns = UINT64_MAX; return result; }
+	};
+
+	struct stream_header {
+		char magic[8];
+		uint32_t version;
+		uint32_t num_columns;
+		uint64_t num_rows;
+		uint64_t reserved;
+	};
+
+	struct stream_column_header {
+		uint32_t kind;
+		uint32_t unit_size;
+		uint64_t payload_bytes;
+	};
+
+	namespace _stream_detail {
+
+		// File descriptors and std::streams have their own overloads of the public interface,
+		// so anything else that's passed in must be a user-supplied sink or source.
+		template <typename T>
+		using enable_if_custom = typename std::enable_if<
+			std::is_class<T>::value && !std::is_base_of<std::ios_base, T>::value, bool>::type;
+
+		// How many offsets to hold in memory at a time when reading or writing a variable column.
+		static constexpr size_t OFFSET_BATCH = COMPRESS_BLOCK_SIZE;
+
+		// Generates the offsets of a variable column a batch at a time: (rows + 1) offsets in all, starting at 0.
+		// 'fn(offsets, n)' is called for each batch, and returns false to stop early.
+		template <typename T, typename Fn>
+		bool for_each_offset_batch(const T* column, size_t rows, Fn fn) {
+			using traits = stream_column<T>;
+			uint64_t batch[OFFSET_BATCH];
+			uint64_t offset = 0;
+			batch[0] = 0;
+			size_t n = 1;
+			for (size_t i = 0; i < rows; ++i) {
+				if (n == OFFSET_BATCH) {
+					if (!fn(batch, n)) return false;
+					n = 0;
+				}
+				offset += traits::length(column[i]) * traits::unit_size;
+				batch[n++] = offset;
+			}
+			return fn(batch, n);
+		}
+
+		// Measures the payload of a run of values written as compressed blocks.
+		template <typename T>
+		uint64_t encoded_size(const T* values, size_t count) {
+			uint64_t result = 0;
+			for (size_t i = 0; i < count; i += COMPRESS_BLOCK_SIZE)
+				result += sizeof(block_header) + plan_block(values + i, std::min(COMPRESS_BLOCK_SIZE, count - i)).num_bytes;
+			return result;
+		}
+
+		// Writes a run of values as compressed blocks, each preceded by its block_header.
+		template <typename T, typename Writer>
+		bool write_encoded(Writer& writer, const T* values, size_t count, char* scratch) {
+			for (size_t i = 0; i < count; i += COMPRESS_BLOCK_SIZE) {
+				size_t n = std::min(COMPRESS_BLOCK_SIZE, count - i);
+				block_header header = plan_block(values + i, n);
+				if (!writer.put_value(header)) return false;
+				if (header.encoding == BLOCK_RAW) {
+					if (!writer.put(values + i, header.num_bytes)) return false;
+				}
+				else {
+					encode_block(values + i, n, header, scratch);
+					if (!writer.put(scratch, header.num_bytes)) return false;
+				}
+			}
+			return true;
+		}
+
+		// Reads a run of values which were written by 'write_encoded'.
+		template <typename T, typename Reader>
+		bool read_encoded(Reader& reader, T* values, size_t count, char* scratch) {
+			block_header header;
+			if (!reader.get_value(header)) return false;
+			if (header.num_bytes > sizeof(T) * count) return false;
+			if (header.encoding == BLOCK_RAW) {
+				if (header.num_bytes != sizeof(T) * count) return false;
+				return reader.get(values, header.num_bytes);
+			}
+			if (!reader.get(scratch, header.num_bytes)) return false;
+			return decode_block(header, scratch, count, values);
+		}
+
+		template <typename T, typename Writer>
+		bool write_column(Writer& writer, const T* column, size_t rows, bool compress) {
+			using traits = stream_column<T>;
+			stream_column_header header = {};
+			header.unit_size = (uint32_t)traits::unit_size;
+			if constexpr (!traits::variable) {
+				if constexpr (is_compressible<T>::value) {
+					if (compress) {
+						header.kind = STREAM_COLUMN_FIXED_ENCODED;
+						header.payload_bytes = encoded_size(column, rows);
+						if (!writer.put_value(header)) return false;
+						std::unique_ptr<char[]> scratch(new char[max_encoded_block_size<T>()]);
+						return write_encoded(writer, column, rows, scratch.get());
+					}
+				}
+				header.kind = STREAM_COLUMN_FIXED;
+				header.payload_bytes = sizeof(T) * rows;
+				if (!writer.put_value(header)) return false;
+				return writer.put_ref(column, sizeof(T) * rows);
+			}
+			else {
+				// A quick pre-pass tells us the size of the heap (and of the compressed offsets),
+				// so the column header can be written up front.
+				uint64_t heap_bytes = 0;
+				for (size_t i = 0; i < rows; ++i)
+					heap_bytes += traits::length(column[i]) * traits::unit_size;
+
+				// Offsets...
+				if (compress) {
+					uint64_t offset_bytes = 0;
+					for_each_offset_batch(column, rows, [&](const uint64_t* batch, size_t n) {
+						offset_bytes += encoded_size(batch, n);
+						return true;
+					});
+					header.kind = STREAM_COLUMN_VARIABLE_ENCODED;
+					header.payload_bytes = sizeof(uint64_t) + offset_bytes + heap_bytes;
+					if (!writer.put_value(header) || !writer.put_value(offset_bytes)) return false;
+					std::unique_ptr<char[]> scratch(new char[max_encoded_block_size<uint64_t>()]);
+					bool result = for_each_offset_batch(column, rows, [&](const uint64_t* batch, size_t n) {
+						return write_encoded(writer, batch, n, scratch.get());
+					});
+					if (!result) return false;
+				}
+				else {
+					header.kind = STREAM_COLUMN_VARIABLE;
+					header.payload_bytes = (sizeof(uint64_t) * (rows + 1)) + heap_bytes;
+					if (!writer.put_value(header)) return false;
+					bool result = for_each_offset_batch(column, rows, [&](const uint64_t* batch, size_t n) {
+						return writer.put(batch, sizeof(uint64_t) * n);
+					});
+					if (!result) return false;
+				}
+				// ...then the heap.
+				for (size_t i = 0; i < rows; ++i) {
+					if (!writer.put_ref(traits::bytes(column[i]), traits::length(column[i]) * traits::unit_size)) return false;
+				}
+				return true;
+			}
+		}
+
+		// Sizes the elements of a variable column according to its offsets.
+		// The elements themselves are the only place the lengths are kept.
+		template <typename T>
+		class offset_applier {
+		public:
+			offset_applier(T* column, uint64_t heap_bytes) : mycolumn(column), myheap(heap_bytes) {}
+
+			bool apply(const uint64_t* batch, size_t n) {
+				using traits = stream_column<T>;
+				for (size_t j = 0; j < n; ++j) {
+					if (myfirst) {
+						if (batch[j] != 0) return false;
+						myfirst = false;
+						continue;
+					}
+					if (batch[j] < myprev || batch[j] > myheap) return false;
+					uint64_t length = batch[j] - myprev;
+					if (length % traits::unit_size != 0) return false;
+					traits::resize(mycolumn[myrow++], (size_t)(length / traits::unit_size));
+					myprev = batch[j];
+				}
+				return true;
+			}
+
+			inline bool finished() const { return myprev == myheap; }
+
+		private:
+			T* mycolumn;
+			uint64_t myheap;
+			uint64_t myprev = 0;
+			size_t myrow = 0;
+			bool myfirst = true;
+		};
+
+		// The most rows a column with this header could hold, judging by the smallest payload each kind of column needs.
+		// Row counts are checked against this before anything is allocated, so a corrupt count can't ask for more.
+		inline uint64_t max_rows_in(const stream_column_header& header) {
+			const uint64_t blocks = header.payload_bytes / sizeof(block_header);
+			switch (header.kind) {
+				case STREAM_COLUMN_FIXED: return header.unit_size ? header.payload_bytes / header.unit_size : 0;
+				case STREAM_COLUMN_VARIABLE: return (header.payload_bytes / sizeof(uint64_t)) - (header.payload_bytes >= sizeof(uint64_t));
+				case STREAM_COLUMN_FIXED_ENCODED: return (blocks > UINT64_MAX / COMPRESS_BLOCK_SIZE) ? UINT64_MAX : blocks * COMPRESS_BLOCK_SIZE;
+				case STREAM_COLUMN_VARIABLE_ENCODED: return (blocks > UINT64_MAX / COMPRESS_BLOCK_SIZE) ? UINT64_MAX : (blocks * COMPRESS_BLOCK_SIZE) - (blocks != 0);
+				default: return 0;
+			}
+		}
+
+		template <typename T, typename Reader>
+		bool read_column_payload(Reader& reader, const stream_column_header& header, T* column, size_t rows) {
+			using traits = stream_column<T>;
+			if (header.unit_size != traits::unit_size) return false;
+			reader.expect(header.payload_bytes);
+			if constexpr (!traits::variable) {
+				if (header.kind == STREAM_COLUMN_FIXED) {
+					if (header.payload_bytes != sizeof(T) * rows) return false;
+					return reader.get(column, sizeof(T) * rows);
+				}
+				if constexpr (is_compressible<T>::value) {
+					if (header.kind == STREAM_COLUMN_FIXED_ENCODED) {
+						std::unique_ptr<char[]> scratch(new char[max_encoded_block_size<T>()]);
+						for (size_t i = 0; i < rows; i += COMPRESS_BLOCK_SIZE) {
+							if (!read_encoded(reader, column + i, std::min(COMPRESS_BLOCK_SIZE, rows - i), scratch.get())) return false;
+						}
+						return true;
+					}
+				}
+				return false;
+			}
+			else {
+				uint64_t heap_bytes;
+				if (header.kind == STREAM_COLUMN_VARIABLE) {
+					if (header.payload_bytes < sizeof(uint64_t) * (rows + 1)) return false;
+					heap_bytes = header.payload_bytes - (sizeof(uint64_t) * (rows + 1));
+					offset_applier<T> applier(column, heap_bytes);
+					uint64_t batch[OFFSET_BATCH];
+					for (size_t i = 0; i < rows + 1; i += OFFSET_BATCH) {
+						size_t n = std::min(OFFSET_BATCH, (rows + 1) - i);
+						if (!reader.get(batch, sizeof(uint64_t) * n)) return false;
+						if (!applier.apply(batch, n)) return false;
+					}
+					if (!applier.finished()) return false;
+				}
+				else if (header.kind == STREAM_COLUMN_VARIABLE_ENCODED) {
+					uint64_t offset_bytes;
+					if (!reader.get_value(offset_bytes)) return false;
+					if (header.payload_bytes < sizeof(uint64_t) + offset_bytes) return false;
+					heap_bytes = header.payload_bytes - sizeof(uint64_t) - offset_bytes;
+					offset_applier<T> applier(column, heap_bytes);
+					std::unique_ptr<char[]> scratch(new char[max_encoded_block_size<uint64_t>()]);
+					uint64_t batch[OFFSET_BATCH];
+					for (size_t i = 0; i < rows + 1; i += OFFSET_BATCH) {
+						size_t n = std::min(OFFSET_BATCH, (rows + 1) - i);
+						if (!read_encoded(reader, batch, n, scratch.get())) return false;
+						if (!applier.apply(batch, n)) return false;
+					}
+					if (!applier.finished()) return false;
+				}
+				else return false;
+
+				// Then pour the heap into the elements.
+				for (size_t i = 0; i < rows; ++i) {
+					size_t length = traits::length(column[i]) * traits::unit_size;
+					if (length > 0 && !reader.get(traits::bytes(column[i]), length)) return false;
+				}
+				return true;
+			}
+		}
+
+		template <typename T, typename Reader>
+		bool read_column(Reader& reader, T* column, size_t rows) {
+			stream_column_header header;
+			if (!reader.get_value(header)) return false;
+			return read_column_payload(reader, header, column, rows);
+		}
+
+		template <typename Writer, typename... Ts, size_t... Ks>
+		bool write_columns(Writer& writer, const soa<Ts...>& container, const stream_options& options, std::index_sequence<Ks...>) {
+			return (write_column(writer, container.template data<Ks>(), container.size(),
+				Ks < 64 && (options.compressed_columns & ((uint64_t)1 << (Ks % 64)))) && ...);
+		}
+
+		template <typename Reader, typename... Ts, size_t... Ks>
+		bool read_columns(Reader& reader, const stream_column_header& first, soa<Ts...>& container, std::index_sequence<Ks...>) {
+			return ((Ks == 0 ? read_column_payload(reader, first, container.template data<Ks>(), container.size())
+				: read_column(reader, container.template data<Ks>(), container.size())) && ...);
+		}
+
+		// Makes room for 'num_rows' rows read from a stream, and sets the size without constructing anything.
+		// The count comes from the stream, so it's checked rather than trusted: it must fit in memory without
+		// the byte count overflowing, and the container must really have been given room for it.
+		template <typename Container, typename... Ts>
+		bool prepare_rows(Container& container, uint64_t num_rows) {
+			// Generous enough to cover an htable's hashmap as well as the rows.
+			const uint64_t bytes_per_row = (sizeof(Ts) + ...) + (4 * sizeof(uint32_t));
+			if (num_rows > container.max_size() || num_rows > SIZE_MAX / bytes_per_row) return false;
+			if (!container.reserve((size_t)num_rows) || container.capacity() < num_rows) return false;
+			size_t num_bytes;
+			return container.deserialize((size_t)num_rows, num_bytes) != nullptr;
+		}
+
+		// Variable-length elements need to be constructed before they can be read into.
+		// Fixed elements are trivially copyable, so their bytes are simply overwritten.
+		template <typename T>
+		void construct_column(T* column, size_t rows) {
+			if constexpr (stream_column<T>::variable) {
+				for (size_t i = 0; i < rows; ++i) new (&column[i]) T();
+			}
+		}
+
+		template <typename... Ts, size_t... Ks>
+		void construct_columns(soa<Ts...>& container, std::index_sequence<Ks...>) {
+			(construct_column(container.template data<Ks>(), container.size()), ...);
+		}
+
+		template <typename Source, typename Container, typename... Ts>
+		bool read_container(Source& source, Container& container, soa<Ts...>& base) {
+			stream_reader<Source> reader(source);
+			stream_header header;
+			if (!reader.get_value(header)) return false;
+			if (memcmp(header.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0) return false;
+			if (header.version != STREAM_VERSION) return false;
+			if (header.num_columns != sizeof...(Ts)) return false;
+
+			container.clear();
+			if (header.num_rows == 0) return true;
+
+			// The first column's header tells us whether the row count is plausible before we allocate for it.
+			stream_column_header first;
+			if (!reader.get_value(first)) return false;
+			if (header.num_rows > max_rows_in(first)) return false;
+			if (!prepare_rows<Container, Ts...>(container, header.num_rows)) {
+				container.clear();
+				return false;
+			}
+			construct_columns(base, std::index_sequence_for<Ts...>{});
+
+			if (!read_columns(reader, first, base, std::index_sequence_for<Ts...>{})) {
+				container.clear();
+				return false;
+			}
+			return true;
+		}
+
+		// Finds where the first 'num_wanted' columns of a stream begin by hopping from one column header to the next,
+		// without reading any of the columns themselves.  'positions' receives the offset of each column's header,
+		// and 'columns' the header itself.
+		inline bool locate_columns(int fd, uint64_t offset, stream_header& header, uint64_t* positions, stream_column_header* columns, size_t num_wanted) {
+			fd_source source(fd, (int64_t)offset);
+			if (!source.read(&header, sizeof(header))) return false;
+			if (memcmp(header.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0) return false;
+			if (header.version != STREAM_VERSION) return false;
+			if (header.num_columns < num_wanted) return false;
+			uint64_t position = offset + sizeof(header);
+			for (size_t c = 0; c < num_wanted; ++c) {
+				stream_column_header column;
+				fd_source columnsource(fd, (int64_t)position);
+				if (!columnsource.read(&column, sizeof(column))) return false;
+				positions[c] = position;
+				columns[c] = column;
+				position += sizeof(column) + column.payload_bytes;
+			}
+			return true;
+		}
+
+		template <typename T>
+		bool read_column_at(int fd, uint64_t position, T* column, size_t rows) {
+			fd_source source(fd, (int64_t)position);
+			stream_reader<fd_source> reader(source);
+			return read_column(reader, column, rows);
+		}
+
+		template <size_t... Ks, typename Container, typename... Ts, size_t... Js>
+		bool read_projection(int fd, uint64_t offset, Container& container, soa<Ts...>& base, std::index_sequence<Js...>) {
+			static_assert(sizeof...(Ks) == sizeof...(Ts), "Each column of the container must be given a column of the stream to read from.");
+			static constexpr size_t columns[] = { Ks... };
+			static constexpr size_t num_wanted = std::max({ Ks... }) + 1;
+			stream_header header;
+			uint64_t positions[num_wanted];
+			stream_column_header headers[num_wanted];
+			if (!locate_columns(fd, offset, header, positions, headers, num_wanted)) return false;
+
+			container.clear();
+			if (header.num_rows == 0) return true;
+			for (size_t column : columns) {
+				if (header.num_rows > max_rows_in(headers[column])) return false;
+			}
+			if (!prepare_rows<Container, Ts...>(container, header.num_rows)) {
+				container.clear();
+				return false;
+			}
+			construct_columns(base, std::index_sequence_for<Ts...>{});
+			if (!(read_column_at(fd, positions[columns[Js]], base.template data<Js>(), base.size()) && ...)) {
+				container.clear();
+				return false;
+			}
+			return true;
+		}
+
+	} // namespace _stream_detail
+
+	/**************************************************************************
+	 * Public Interface
+	 *************************************************************************/
+
+	// write_stream(sink, container, options)
+	// Writes every row of an soa or htable to 'sink'.
+	// Only the rows are written; the htable's hashmap is rebuilt when the stream is read.
+	// Returns false if the sink reports an error.
+	// Complexity: O(n).
+	template <typename Sink, typename... Ts>
+	_stream_detail::enable_if_custom<Sink> write_stream(Sink& sink, const soa<Ts...>& container, const stream_options& options = stream_options()) {
+		stream_writer<Sink> writer(sink);
+		stream_header header = {};
+		memcpy(header.magic, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+		header.version = STREAM_VERSION;
+		header.num_columns = (uint32_t)sizeof...(Ts);
+		header.num_rows = container.size();
+		if (!writer.put_value(header)) return false;
+		if (!_stream_detail::write_columns(writer, container, options, std::index_sequence_for<Ts...>{})) return false;
+		return writer.flush();
+	}
+
+	// write_stream(fd, container, options)
+	// Writes every row of an soa or htable to file descriptor 'fd'.
+	template <typename... Ts>
+	inline bool write_stream(int fd, const soa<Ts...>& container, const stream_options& options = stream_options()) {
+		fd_sink sink(fd);
+		return write_stream(sink, container, options);
+	}
+
+	// write_stream_at(fd, offset, container, options)
+	// Writes every row of an soa or htable to file descriptor 'fd', starting at byte 'offset' in the file.
+	// The file descriptor's own position is left alone.
+	template <typename... Ts>
+	inline bool write_stream_at(int fd, uint64_t offset, const soa<Ts...>& container, const stream_options& options = stream_options()) {
+		fd_sink sink(fd, (int64_t)offset);
+		return write_stream(sink, container, options);
+	}
+
+	// write_stream(os, container, options)
+	// Writes every row of an soa or htable to std::ostream 'os'.
+	template <typename... Ts>
+	inline bool write_stream(std::ostream& os, const soa<Ts...>& container, const stream_options& options = stream_options()) {
+		ostream_sink sink(os);
+		return write_stream(sink, container, options);
+	}
+
+	// read_stream(source, container)
+	// Replaces the contents of an soa with rows read from 'source'.
+	// The column types must match those used when the stream was written.
+	// Returns false if the stream is malformed or the source reports an error,
+	// in which case the container is left empty.
+	// Complexity: O(n).
+	template <typename Source, typename... Ts>
+	_stream_detail::enable_if_custom<Source> read_stream(Source& source, soa<Ts...>& container) {
+		return _stream_detail::read_container(source, container, container);
+	}
+
+	// read_stream(source, table)
+	// Replaces the contents of an htable with rows read from 'source', then rebuilds the hashmap.
+	// Since the hashmap isn't stored, a stream can be loaded regardless of the capacity or hashing it was saved with.
+	// Returns false if the stream is malformed or the source reports an error,
+	// in which case the table is left empty.
+	// Complexity: O(n).
+	template <typename Source, typename KeyT, typename... ItemTs>
+	_stream_detail::enable_if_custom<Source> read_stream(Source& source, htable<KeyT, ItemTs...>& table) {
+		soa<KeyT, ItemTs...>& base = table;
+		if (!_stream_detail::read_container(source, table, base)) return false;
+		table.rehash();
+		return true;
+	}
+
+	// read_stream(fd, container)
+	// Reads an soa or htable from file descriptor 'fd'.
+	template <typename Container>
+	inline bool read_stream(int fd, Container& container) {
+		fd_source source(fd);
+		return read_stream(source, container);
+	}
+
+	// read_stream(is, container)
+	// Reads an soa or htable from std::istream 'is'.
+	template <typename Container>
+	inline bool read_stream(std::istream& is, Container& container) {
+		istream_source source(is);
+		return read_stream(source, container);
+	}
+
+	// read_stream_columns<K...>(fd, container, offset)
+	// Replaces the contents of an soa with columns K... of the stream which starts 'offset' bytes into file descriptor 'fd'.
+	// The container's column types must match the types of those columns, in the order they are listed:
+	// `hvh::read_stream_columns<1, 3>(fd, my_soa)` fills my_soa's first column from column 1 and its second from column 3.
+	// Streams don't record their column types, so only each column's shape (fixed or variable length) and element size
+	// can be checked.  A column of the wrong type with the same size, like an int64_t column read as a double,
+	// loads without complaint from an uncompressed stream, and is only sometimes caught when compressed.
+	// Every column's header records its size, so the other columns are skipped over without being read.
+	// 'fd' must be seekable (a file, not a pipe), and its position is left alone.
+	// Returns false if the stream is malformed or doesn't have those columns, in which case the container is left empty.
+	// Complexity: O(n) in the size of the columns which are read.
+	template <size_t... Ks, typename... Ts>
+	bool read_stream_columns(int fd, soa<Ts...>& container, uint64_t offset = 0) {
+		return _stream_detail::read_projection<Ks...>(fd, offset, container, container, std::index_sequence_for<Ts...>{});
+	}
+
+	// read_stream_columns<K...>(fd, table, offset)
+	// As above, but reads into an htable and then rebuilds its hashmap.
+	// The first column listed becomes the table's key.
+	template <size_t... Ks, typename KeyT, typename... ItemTs>
+	bool read_stream_columns(int fd, htable<KeyT, ItemTs...>& table, uint64_t offset = 0) {
+		soa<KeyT, ItemTs...>& base = table;
+		if (!_stream_detail::read_projection<Ks...>(fd, offset, table, base, std::index_sequence_for<KeyT, ItemTs...>{})) return false;
+		table.rehash();
+		return true;
+	}
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SOASTREAM_H
@@ -0,0 +1,233 @@
+#include "soa_stream.hpp"
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <unistd.h>
+using namespace std;
+
+bool soa_stream_test() {
+	printf("Testing soa_stream...\n");
+	bool success = true;
+
+	hvh::soa<int, string, vector<short>, double> original;
+	for (int i = 0; i < 5000; ++i) {
+		string str = (i % 7 == 0) ? string() : string(i % 100, (char)('a' + (i % 26)));
+		vector<short> shorts(i % 5, (short)-i);
+		original.push_back(i, str, shorts, i * 0.5);
+	}
+
+	stringstream stream;
+	if (!hvh::write_stream(stream, original)) {
+		printf("write_stream to a stringstream failed.\n");
+		success = false;
+	}
+
+	hvh::soa<int, string, vector<short>, double> loaded;
+	loaded.push_back(-1, "this row should be replaced", vector<short>(), -1.0);
+	if (!hvh::read_stream(stream, loaded)) {
+		printf("read_stream from a stringstream failed.\n");
+		success = false;
+	}
+
+	if (loaded.size() != original.size()) {
+		printf("Loaded soa should have %zi rows, instead it has %zi.\n", original.size(), loaded.size());
+		success = false;
+	}
+	else {
+		for (size_t i = 0; i < loaded.size(); ++i) {
+			if (loaded.at<0>(i) != original.at<0>(i) || loaded.at<1>(i) != original.at<1>(i) ||
+				loaded.at<2>(i) != original.at<2>(i) || loaded.at<3>(i) != original.at<3>(i)) {
+				printf("Row %zi of the loaded soa does not match the original.\n", i);
+				success = false;
+				break;
+			}
+		}
+	}
+
+	// The loaded strings must survive being moved around by a reallocation.
+	loaded.reserve(loaded.capacity() * 4);
+	if (loaded.size() == original.size() && loaded.at<1>(4999) != original.at<1>(4999)) {
+		printf("Strings were damaged by reserve after loading.\n");
+		success = false;
+	}
+
+	// A stream with the wrong column types must be rejected.
+	stream.clear();
+	stream.seekg(0);
+	hvh::soa<int, string, vector<int>, double> mismatched;
+	if (hvh::read_stream(stream, mismatched)) {
+		printf("read_stream should reject a stream with mismatched column types.\n");
+		success = false;
+	}
+
+	// A truncated stream must be rejected, leaving the container empty.
+	string truncated = stream.str().substr(0, stream.str().size() / 2);
+	stringstream shortstream(truncated);
+	if (hvh::read_stream(shortstream, loaded) || loaded.size() != 0) {
+		printf("read_stream should reject a truncated stream and leave the container empty.\n");
+		success = false;
+	}
+
+	// A corrupt row count must be rejected before anything is allocated for it, leaving the container empty.
+	for (uint64_t num_rows : { (uint64_t)1 << 40, (uint64_t)original.size() + 1000, UINT64_MAX / 2 }) {
+		string corrupt = stream.str();
+		memcpy(&corrupt[offsetof(hvh::stream_header, num_rows)], &num_rows, sizeof(num_rows));
+		stringstream corruptstream(corrupt);
+		loaded.push_back(-1, "this row should be cleared", vector<short>(), -1.0);
+		if (hvh::read_stream(corruptstream, loaded) || loaded.size() != 0) {
+			printf("read_stream should reject a header claiming %zi rows and leave the container empty.\n", (size_t)num_rows);
+			success = false;
+		}
+	}
+
+	// Compressed columns must come back exactly as they went in, and take up less room.
+	hvh::soa<int64_t, string, double> sorted;
+	for (int64_t i = 0; i < 20000; ++i) {
+		sorted.push_back(5000000000 + i * 10, to_string(i), (double)i);
+	}
+	stringstream plainstream, compressedstream;
+	hvh::write_stream(plainstream, sorted);
+	if (!hvh::write_stream(compressedstream, sorted, hvh::stream_options::compress_all())) {
+		printf("write_stream with compression failed.\n");
+		success = false;
+	}
+	if (compressedstream.str().size() >= plainstream.str().size() / 2) {
+		printf("Compressed stream should be much smaller than %zi bytes, instead it's %zi.\n",
+			plainstream.str().size(), compressedstream.str().size());
+		success = false;
+	}
+	hvh::soa<int64_t, string, double> decompressed;
+	if (!hvh::read_stream(compressedstream, decompressed) || decompressed.size() != sorted.size()) {
+		printf("read_stream failed to read a compressed stream.\n");
+		success = false;
+	}
+	else {
+		for (size_t i = 0; i < sorted.size(); ++i) {
+			if (decompressed.at<0>(i) != sorted.at<0>(i) || decompressed.at<1>(i) != sorted.at<1>(i) ||
+				decompressed.at<2>(i) != sorted.at<2>(i)) {
+				printf("Row %zi of the decompressed soa does not match the original.\n", i);
+				success = false;
+				break;
+			}
+		}
+	}
+
+	// htables are written as rows and get their hashmap rebuilt on load.
+	hvh::htable<string, int> table;
+	table.insert("apple", 1);
+	table.insert("banana", 2);
+	table.insert("banana", 3);
+	table.insert("carrot", 4);
+	stringstream tablestream;
+	hvh::write_stream(tablestream, table);
+	hvh::htable<string, int> loadedtable;
+	if (!hvh::read_stream(tablestream, loadedtable)) {
+		printf("read_stream failed to load an htable.\n");
+		success = false;
+	}
+	if (loadedtable.count("banana") != 2 || loadedtable.find("carrot") == SIZE_MAX ||
+		loadedtable.at<1>(loadedtable.find("apple")) != 1) {
+		printf("Loaded htable does not contain the expected entries.\n");
+		success = false;
+	}
+
+	// Writing to a file descriptor gathers columns in place, and never touches the table's buffer.
+	hvh::htable<uint64_t, double, string> bigtable;
+	for (uint64_t i = 0; i < 100000; ++i) bigtable.insert(i * 3, i * 0.25, string(i % 9, 'x'));
+	size_t capacity_before = bigtable.capacity();
+	const uint64_t* keys_before = bigtable.data<0>();
+	FILE* file = tmpfile();
+	int fd = fileno(file);
+	if (!hvh::write_stream_at(fd, 100, bigtable) || bigtable.capacity() != capacity_before || bigtable.data<0>() != keys_before) {
+		printf("write_stream_at failed or modified the table.\n");
+		success = false;
+	}
+	if (lseek(fd, 0, SEEK_CUR) != 0) {
+		printf("write_stream_at should not move the file position.\n");
+		success = false;
+	}
+	hvh::htable<uint64_t, double, string> loadedbig;
+	lseek(fd, 100, SEEK_SET);
+	if (!hvh::read_stream(fd, loadedbig) || loadedbig.size() != bigtable.size()) {
+		printf("read_stream failed to read a table written with write_stream_at.\n");
+		success = false;
+	}
+	else {
+		for (uint64_t i = 0; i < 100000; i += 7) {
+			size_t index = loadedbig.find(i * 3);
+			if (index == SIZE_MAX || loadedbig.at<1>(index) != i * 0.25 || loadedbig.at<2>(index) != string(i % 9, 'x')) {
+				printf("Row with key %zi was not read back correctly.\n", (size_t)(i * 3));
+				success = false;
+				break;
+			}
+		}
+	}
+	fclose(file);
+
+	// Strings big enough to be gathered in place, between short ones which are buffered,
+	// queue two spans per row, so the gather list fills up and has to be flushed part way through.
+	hvh::soa<string> mixed;
+	for (size_t i = 0; i < 200; ++i) mixed.push_back((i % 2) ? string(3, 'y') : string(hvh::STREAM_GATHER_THRESHOLD + i, (char)('a' + (i % 26))));
+	file = tmpfile();
+	fd = fileno(file);
+	hvh::soa<string> loadedmixed;
+	if (!hvh::write_stream_at(fd, 0, mixed) || !hvh::read_stream(fd, loadedmixed) || loadedmixed.size() != mixed.size()) {
+		printf("Failed to write and read back a mix of large and short strings.\n");
+		success = false;
+	}
+	else {
+		for (size_t i = 0; i < mixed.size(); ++i) {
+			if (loadedmixed.at<0>(i) != mixed.at<0>(i)) {
+				printf("String %zi of the large and short mix was not read back correctly.\n", i);
+				success = false;
+				break;
+			}
+		}
+	}
+	fclose(file);
+
+	// Projection reads only the columns it's asked for, in any order.
+	hvh::soa<int, string, double, vector<short>, int64_t> wide;
+	for (int i = 0; i < 30000; ++i) wide.push_back(i, to_string(i * 3), i * 1.5, vector<short>(i % 4, (short)i), (int64_t)i * 1000);
+	file = tmpfile();
+	fd = fileno(file);
+	hvh::write_stream_at(fd, 64, wide, hvh::stream_options::compress_all());
+	hvh::soa<int64_t, string> projected;
+	if (!hvh::read_stream_columns<4, 1>(fd, projected, 64) || projected.size() != wide.size()) {
+		printf("read_stream_columns failed to read a projection.\n");
+		success = false;
+	}
+	else {
+		for (size_t i = 0; i < wide.size(); ++i) {
+			if (projected.at<0>(i) != wide.at<4>(i) || projected.at<1>(i) != wide.at<1>(i)) {
+				printf("Row %zi of the projection does not match the original.\n", i);
+				success = false;
+				break;
+			}
+		}
+	}
+	hvh::htable<string, double> projectedtable;
+	if (!hvh::read_stream_columns<1, 2>(fd, projectedtable, 64) || projectedtable.size() != wide.size() ||
+		projectedtable.at<1>(projectedtable.find("300")) != 150.0) {
+		printf("read_stream_columns failed to read a projection into an htable.\n");
+		success = false;
+	}
+	hvh::soa<double> missing;
+	hvh::soa<string> mistyped;
+	if (hvh::read_stream_columns<5>(fd, missing, 64) || hvh::read_stream_columns<0>(fd, mistyped, 64) || mistyped.size() != 0) {
+		printf("read_stream_columns should reject missing or mistyped columns.\n");
+		success = false;
+	}
+	uint64_t corrupt_rows = (uint64_t)1 << 40;
+	pwrite(fd, &corrupt_rows, sizeof(corrupt_rows), 64 + offsetof(hvh::stream_header, num_rows));
+	if (hvh::read_stream_columns<4, 1>(fd, projected, 64) || projected.size() != 0) {
+		printf("read_stream_columns should reject a corrupt row count and leave the container empty.\n");
+		success = false;
+	}
+	fclose(file);
+
+	return success;
+}
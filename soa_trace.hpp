@@ -0,0 +1,149 @@
+/* soa_trace.hpp
+ * Chrome trace exporter for soa and htable trace events
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Every soa and htable reports its buffer allocations, reallocations and
+ * frees, and every reserve, shrink_to_fit, and rehash that does any work,
+ * to the trace sink installed with hvh::set_trace_sink (see soa.hpp).
+ * chrome_trace is a sink which collects those events and writes them in the
+ * Chrome trace event format, which chrome://tracing and Perfetto can open,
+ * so that latency spikes can be lined up against the table growth which
+ * caused them.
+ */
+#ifndef HVH_TOOLS_SOATRACE_H
+#define HVH_TOOLS_SOATRACE_H
+
+#include "soa.hpp"
+
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hvh {
+
+	// soa_trace_kind_name(kind)
+	// Returns the name of a kind of trace event, such as "reserve".
+	inline const char* soa_trace_kind_name(soa_trace_kind kind) {
+		switch (kind) {
+			case soa_trace_kind::allocate: return "allocate";
+			case soa_trace_kind::reallocate: return "reallocate";
+			case soa_trace_kind::free: return "free";
+			case soa_trace_kind::reserve: return "reserve";
+			case soa_trace_kind::shrink_to_fit: return "shrink_to_fit";
+			case soa_trace_kind::rehash: return "rehash";
+		}
+		return "unknown";
+	}
+
+	class chrome_trace {
+	public:
+
+		// One recorded event, and which thread reported it (numbered from 0 in the order they were first seen).
+		struct entry {
+			soa_trace_event event;
+			size_t thread;
+		};
+
+		// chrome_trace(max_events)
+		// Creates an empty trace which keeps at most 'max_events' events; any more are counted, then dropped.
+		// Timestamps in the output are measured from when the trace was created.
+		chrome_trace(size_t max_events = 1 << 20)
+			: mymaxevents(max_events),
+			myorigin(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count()) {
+			mysink.record = &record_event;
+			mysink.context = this;
+		}
+		~chrome_trace() { stop(); }
+		chrome_trace(const chrome_trace&) = delete;
+		chrome_trace& operator=(const chrome_trace&) = delete;
+
+		// start()
+		// Installs this trace as the trace sink, so that it receives events from every container.
+		inline void start() { set_trace_sink(&mysink); }
+
+		// stop()
+		// Uninstalls this trace, if it's still the trace sink.
+		inline void stop() { if (get_trace_sink() == &mysink) set_trace_sink(nullptr); }
+
+		// sink()
+		// Returns the sink that feeds this trace, for passing to set_trace_sink or for calling from another sink.
+		inline const soa_trace_sink* sink() const { return &mysink; }
+
+		// events()
+		// Returns a copy of every event recorded so far, in the order they finished.
+		// Complexity: O(n).
+		std::vector<entry> events() const {
+			std::lock_guard<std::mutex> lock(mymutex);
+			return myevents;
+		}
+
+		// dropped()
+		// Returns how many events arrived after the trace was full.
+		inline size_t dropped() const {
+			std::lock_guard<std::mutex> lock(mymutex);
+			return mydropped;
+		}
+
+		// clear()
+		// Forgets every event recorded so far.
+		inline void clear() {
+			std::lock_guard<std::mutex> lock(mymutex);
+			myevents.clear();
+			mydropped = 0;
+		}
+
+		// write(out)
+		// Writes the trace as Chrome trace event JSON.  Every event is a complete ("X") event, with its
+		// bytes, capacities, and container address as arguments.  Returns false if writing fails.
+		// Complexity: O(n).
+		bool write(FILE* out) const {
+			std::lock_guard<std::mutex> lock(mymutex);
+			bool success = fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n") > 0;
+			for (size_t i = 0; i < myevents.size() && success; ++i) {
+				const soa_trace_event& event = myevents[i].event;
+				success = fprintf(out,
+					"  {\"name\": \"%s\", \"cat\": \"soa\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": %zu, "
+					"\"args\": {\"container\": \"%p\", \"bytes\": %zu, \"old_capacity\": %zu, \"new_capacity\": %zu}}%s\n",
+					soa_trace_kind_name(event.kind), (event.start - myorigin) * 1e6, event.seconds * 1e6, myevents[i].thread,
+					event.container, event.bytes, event.old_capacity, event.new_capacity,
+					(i + 1 < myevents.size()) ? "," : "") > 0;
+			}
+			return success && fprintf(out, "]}\n") > 0;
+		}
+
+		// write(path)
+		// Writes the trace to a file, replacing it if it exists.  Returns false if the file can't be written.
+		bool write(const char* path) const {
+			FILE* out = fopen(path, "w");
+			if (!out) return false;
+			bool success = write(out);
+			return (fclose(out) == 0) && success;
+		}
+
+	private:
+
+		static void record_event(void* context, const soa_trace_event& event) {
+			chrome_trace& trace = *(chrome_trace*)context;
+			const std::thread::id me = std::this_thread::get_id();
+			std::lock_guard<std::mutex> lock(trace.mymutex);
+			if (trace.myevents.size() >= trace.mymaxevents) { ++trace.mydropped; return; }
+			size_t thread = 0;
+			while (thread < trace.mythreads.size() && trace.mythreads[thread] != me) ++thread;
+			if (thread == trace.mythreads.size()) trace.mythreads.push_back(me);
+			trace.myevents.push_back(entry{ event, thread });
+		}
+
+		soa_trace_sink mysink;
+		mutable std::mutex mymutex;
+		std::vector<entry> myevents;
+		std::vector<std::thread::id> mythreads;
+		size_t mymaxevents;
+		size_t mydropped = 0;
+		double myorigin;
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_SOATRACE_H
@@ -0,0 +1,120 @@
+#include "soa_trace.hpp"
+#include "htable.hpp"
+#include <string>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+static void count_event(void* context, const hvh::soa_trace_event&) { ++*(size_t*)context; }
+
+bool soa_trace_test() {
+	printf("Testing soa_trace...\n");
+	bool success = true;
+
+	// A custom sink sees every event while it's installed, and nothing afterwards.
+	size_t num_events = 0;
+	hvh::soa_trace_sink counter;
+	counter.record = &count_event;
+	counter.context = &num_events;
+	hvh::set_trace_sink(&counter);
+	{
+		hvh::soa<int, string> rows;
+		for (int i = 0; i < 100; ++i) rows.push_back(i, to_string(i));
+	}
+	hvh::set_trace_sink(nullptr);
+	if (num_events == 0) {
+		printf("A trace sink should receive events from a growing soa.\n");
+		success = false;
+	}
+	const size_t seen = num_events;
+	{
+		hvh::soa<int, string> rows;
+		for (int i = 0; i < 100; ++i) rows.push_back(i, to_string(i));
+	}
+	if (num_events != seen) {
+		printf("An uninstalled trace sink received %zi more events.\n", num_events - seen);
+		success = false;
+	}
+
+	hvh::chrome_trace trace;
+	trace.start();
+	hvh::soa<int, double> rows;
+	for (int i = 0; i < 1000; ++i) rows.push_back(i, i * 0.5);
+	rows.erase_swap(0);
+	rows.shrink_to_fit();
+	hvh::htable<string, int> table;
+	for (int i = 0; i < 1000; ++i) table.insert(to_string(i), i);
+	table.rehash();
+	trace.stop();
+	table.reserve(100000);
+
+	size_t counts[6] = { 0, 0, 0, 0, 0, 0 };
+	for (const auto& entry : trace.events()) {
+		const hvh::soa_trace_event& event = entry.event;
+		++counts[(int)event.kind];
+		if (event.seconds < 0.0 || entry.thread != 0) {
+			printf("A %s event took %f seconds on thread %zi.\n", hvh::soa_trace_kind_name(event.kind), event.seconds, entry.thread);
+			success = false;
+		}
+		if (event.kind == hvh::soa_trace_kind::reserve && event.new_capacity <= event.old_capacity) {
+			printf("A reserve event should grow the capacity, instead it went from %zi to %zi.\n", event.old_capacity, event.new_capacity);
+			success = false;
+		}
+		if (event.kind == hvh::soa_trace_kind::shrink_to_fit && (event.container != &rows || event.new_capacity != 1008 || event.old_capacity != 1024)) {
+			printf("shrink_to_fit should have gone from 1024 to 1008 rows, instead it went from %zi to %zi.\n", event.old_capacity, event.new_capacity);
+			success = false;
+		}
+		if (event.kind == hvh::soa_trace_kind::allocate && event.bytes == 0) {
+			printf("An allocate event should say how many bytes it allocated.\n");
+			success = false;
+		}
+		if (event.container != &rows && event.container != &table) {
+			printf("A %s event came from an unexpected container.\n", hvh::soa_trace_kind_name(event.kind));
+			success = false;
+		}
+	}
+	if (counts[(int)hvh::soa_trace_kind::reserve] < 2 || counts[(int)hvh::soa_trace_kind::allocate] < 2
+	 || counts[(int)hvh::soa_trace_kind::free] < 1 || counts[(int)hvh::soa_trace_kind::shrink_to_fit] != 1
+	 || counts[(int)hvh::soa_trace_kind::rehash] < 2) {
+		printf("Expected reserve, allocate, free, shrink_to_fit and rehash events, got %zi, %zi, %zi, %zi and %zi.\n",
+			counts[(int)hvh::soa_trace_kind::reserve], counts[(int)hvh::soa_trace_kind::allocate], counts[(int)hvh::soa_trace_kind::free],
+			counts[(int)hvh::soa_trace_kind::shrink_to_fit], counts[(int)hvh::soa_trace_kind::rehash]);
+		success = false;
+	}
+
+	// The JSON should have one complete event per recorded event.
+	FILE* file = tmpfile();
+	if (!file || !trace.write(file)) {
+		printf("Couldn't write the Chrome trace.\n");
+		return false;
+	}
+	rewind(file);
+	string json;
+	char buffer[4096];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) json.append(buffer, got);
+	fclose(file);
+	size_t num_complete = 0;
+	for (size_t at = json.find("\"ph\": \"X\""); at != string::npos; at = json.find("\"ph\": \"X\"", at + 1)) ++num_complete;
+	const char* header = "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+	if (json.compare(0, strlen(header), header) != 0 || num_complete != trace.events().size()
+	 || json.find("\"name\": \"rehash\"") == string::npos || json.find("\"old_capacity\": 1024, \"new_capacity\": 1008") == string::npos) {
+		printf("The Chrome trace JSON doesn't match the recorded events.\n");
+		success = false;
+	}
+
+	// A full trace counts what it drops.
+	hvh::chrome_trace small(2);
+	small.start();
+	{
+		hvh::soa<int> more;
+		for (int i = 0; i < 1000; ++i) more.push_back(i);
+	}
+	small.stop();
+	if (small.events().size() != 2 || small.dropped() == 0) {
+		printf("A trace limited to 2 events kept %zi and dropped %zi.\n", small.events().size(), small.dropped());
+		success = false;
+	}
+
+	return success;
+}
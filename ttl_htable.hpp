@@ -0,0 +1,283 @@
+/* ttl_htable.hpp
+ * An htable whose entries expire
+ * by Haydn V. Harach
+ * Created October 2026
+ *
+ * Every entry has a deadline, stored as an extra column of the table, and is
+ * erased by 'expire_until' once that deadline has passed.  Rather than
+ * scanning the whole table for stale entries, entries are indexed by
+ * deadline in a hierarchical timer wheel: six levels of 64 slots, where each
+ * slot of level L covers 64^L ticks.  An entry goes in the lowest level that
+ * reaches its deadline, and moves down a level each time the wheel comes
+ * round to its slot, until it's in level 0 and expires on exactly its tick.
+ * Ticks are whatever unit the caller likes (milliseconds, say).
+ *
+ * Erasing moves the table's last entry into the erased entry's place, so
+ * each entry also stores where it is in the wheel, and the wheel is fixed up
+ * whenever an entry moves.
+ */
+#ifndef HVH_TOOLS_TTLHTABLE_H
+#define HVH_TOOLS_TTLHTABLE_H
+
+#include "htable.hpp"
+
+#include <utility>
+#include <vector>
+
+namespace hvh {
+
+	template <typename KeyT, typename... ItemTs>
+	class ttl_htable {
+	public:
+
+		// ttl_htable(now)
+		// Creates an empty table, whose clock starts at 'now'.
+		ttl_htable(uint64_t now = 0) : mynow(now), mybuckets(NUM_BUCKETS) {}
+
+		// now()
+		// Returns the latest time passed to 'expire_until' (or the constructor).
+		inline uint64_t now() const { return mynow; }
+
+		// size()
+		// Returns the number of entries in the table.
+		inline size_t size() const { return mytable.size(); }
+
+		// reserve(n)
+		// Ensures that the table can hold n entries without reallocating.
+		// Returns false if a memory allocation error occurs, true otherwise.
+		inline bool reserve(size_t n) { return mytable.reserve(n); }
+
+		// insert(key, deadline, items...)
+		// Inserts a new entry which expires once 'expire_until' reaches 'deadline'.
+		// Like htable, several entries may share a key.  A deadline which has already passed
+		// expires on the next call to 'expire_until'.
+		// Returns false if a memory allocation failure occurs, true otherwise.
+		// Complexity: O(1) amortized.
+		template <typename... Ts>
+		bool insert(const KeyT& key, uint64_t deadline, Ts&&... items) {
+			if (!mytable.insert(key, deadline, (uint32_t)0, (uint32_t)0, std::forward<Ts>(items)...)) return false;
+			place((uint32_t)(mytable.size() - 1));
+			return true;
+		}
+
+		// find(key)
+		// Returns the index of the first entry with the indicated key, or SIZE_MAX if there isn't one.
+		// Indices are only good until the next call which erases or inserts entries.
+		// Complexity: O(1) amortized.
+		inline size_t find(const KeyT& key) const { return mytable.find(key); }
+
+		// key(index), deadline(index)
+		// Returns the key or the deadline of the entry at 'index'.
+		inline const KeyT& key(size_t index) const { return mytable.template at<0>(index); }
+		inline uint64_t deadline(size_t index) const { return mytable.template at<1>(index); }
+
+		// item<K>(index)
+		// Returns the Kth item of the entry at 'index'.
+		template <size_t K>
+		inline auto& item(size_t index) { return mytable.template at<K + 4>(index); }
+		template <size_t K>
+		inline const auto& item(size_t index) const { return mytable.template at<K + 4>(index); }
+
+		// set_deadline(index, deadline)
+		// Changes when the entry at 'index' expires, for instance to keep a session alive.
+		// Complexity: O(1).
+		void set_deadline(size_t index, uint64_t deadline) {
+			if (index >= mytable.size()) return;
+			unplace((uint32_t)index);
+			mytable.template at<1>(index) = deadline;
+			place((uint32_t)index);
+		}
+
+		// erase_at(index)
+		// Erases the entry at 'index'.  The last entry in the table is moved into its place.
+		// Returns the number of entries erased (0 or 1).
+		// Complexity: O(1) amortized.
+		inline size_t erase_at(size_t index) {
+			if (index >= mytable.size()) return 0;
+			erase_row((uint32_t)index);
+			return 1;
+		}
+
+		// erase(key)
+		// Erases the first entry with the indicated key.  Returns the number of entries erased (0 or 1).
+		// Complexity: O(1) amortized.
+		inline size_t erase(const KeyT& key) {
+			size_t index = mytable.find(key);
+			return (index == SIZE_MAX) ? 0 : erase_at(index);
+		}
+
+		// expire_until(now, fn)
+		// Advances the clock to 'now', and erases every entry whose deadline is at or before it.
+		// fn(table, index) is called for each entry just before it's erased, where 'table' is this ttl_htable.
+		// Returns the number of entries erased.
+		// Complexity: O(k) in the number of entries erased, plus O(1) per 64 ticks passed, but never more than O(n).
+		template <typename Fn>
+		size_t expire_until(uint64_t now, Fn&& fn) {
+			size_t num_expired = expire_bucket(DUE_BUCKET, fn);
+			if (now <= mynow) return num_expired;
+
+			// Walking the wheel costs a little for every 64 ticks; if that's more than looking at every entry, do that instead.
+			if (((now - mynow) >> WHEEL_BITS) > mytable.size() + WHEEL_SLOTS) return num_expired + rebuild(now, fn);
+
+			while (mynow < now) {
+				// Expire the level 0 slots for the rest of this rotation, as far as 'now'.
+				const uint64_t rotation_end = mynow | (WHEEL_SLOTS - 1);
+				const uint64_t upto = (now < rotation_end) ? now : rotation_end;
+				uint64_t due = myoccupied[0] & slots_between(mynow & (WHEEL_SLOTS - 1), upto & (WHEEL_SLOTS - 1));
+				while (due) {
+					const size_t slot = lowest_bit(due);
+					due &= due - 1;
+					num_expired += expire_bucket(slot, fn);
+				}
+				mynow = upto;
+				if (mynow == now) break;
+
+				// Moving into the next rotation.  Every higher slot which begins at this tick is brought down,
+				// highest first so that entries can keep falling through the levels below it.
+				// The new tick's own entries land in level 0 slot 0, or are due already, and expire straight away.
+				mynow += 1;
+				size_t top = 1;
+				while (top < WHEEL_LEVELS && ((mynow >> (WHEEL_BITS * top)) & (WHEEL_SLOTS - 1)) == 0) ++top;
+				if (top == WHEEL_LEVELS) {
+					cascade(OVERFLOW_BUCKET);
+					--top;
+				}
+				for (size_t level = top; level >= 1; --level)
+					cascade((level * WHEEL_SLOTS) + ((mynow >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)));
+				num_expired += expire_bucket(0, fn);
+				num_expired += expire_bucket(DUE_BUCKET, fn);
+			}
+			return num_expired;
+		}
+
+		// expire_until(now)
+		// As above, without a callback.
+		inline size_t expire_until(uint64_t now) { return expire_until(now, [](const ttl_htable&, size_t) {}); }
+
+		// table()
+		// Returns the underlying htable.  Column 0 is the key, column 1 the deadline,
+		// columns 2 and 3 are where the entry is in the timer wheel, and the items follow.
+		inline const htable<KeyT, uint64_t, uint32_t, uint32_t, ItemTs...>& table() const { return mytable; }
+
+	private:
+		static const size_t WHEEL_BITS = 6;
+		static const size_t WHEEL_SLOTS = 1 << WHEEL_BITS;
+		static const size_t WHEEL_LEVELS = 6;
+		// Deadlines too far away for the wheel wait here until the top level comes round.
+		static const size_t OVERFLOW_BUCKET = WHEEL_SLOTS * WHEEL_LEVELS;
+		// Deadlines which had already passed when they were set.
+		static const size_t DUE_BUCKET = OVERFLOW_BUCKET + 1;
+		static const size_t NUM_BUCKETS = DUE_BUCKET + 1;
+
+		static inline size_t lowest_bit(uint64_t bits) {
+		#if defined(__GNUC__) || defined(__clang__)
+			return (size_t)__builtin_ctzll(bits);
+		#else
+			size_t result = 0;
+			while (!(bits & 1)) { bits >>= 1; ++result; }
+			return result;
+		#endif
+		}
+
+		// A mask of the slots after 'from', up to and including 'to'.
+		static inline uint64_t slots_between(uint64_t from, uint64_t to) {
+			if (to <= from) return 0;
+			const uint64_t upto_to = (to == WHEEL_SLOTS - 1) ? ~0ull : ((1ull << (to + 1)) - 1);
+			return upto_to & ~((1ull << (from + 1)) - 1);
+		}
+
+		// Which bucket an entry with this deadline belongs in, given the current time.
+		inline size_t bucket_for(uint64_t deadline) const {
+			if (deadline <= mynow) return DUE_BUCKET;
+			const uint64_t delta = deadline - mynow;
+			for (size_t level = 0; level < WHEEL_LEVELS; ++level) {
+				const uint64_t shift = WHEEL_BITS * level;
+				if ((delta >> shift) < WHEEL_SLOTS) return (level * WHEEL_SLOTS) + ((deadline >> shift) & (WHEEL_SLOTS - 1));
+			}
+			return OVERFLOW_BUCKET;
+		}
+
+		// Adds a row to the bucket its deadline belongs in.
+		inline void place(uint32_t row) {
+			const size_t bucket = bucket_for(mytable.template at<1>(row));
+			mytable.template at<2>(row) = (uint32_t)bucket;
+			mytable.template at<3>(row) = (uint32_t)mybuckets[bucket].size();
+			mybuckets[bucket].push_back(row);
+			if (bucket < OVERFLOW_BUCKET) myoccupied[bucket / WHEEL_SLOTS] |= 1ull << (bucket % WHEEL_SLOTS);
+		}
+
+		// Removes a row from its bucket, moving the bucket's last row into its place.
+		inline void unplace(uint32_t row) {
+			const size_t bucket = mytable.template at<2>(row);
+			const uint32_t pos = mytable.template at<3>(row);
+			std::vector<uint32_t>& rows = mybuckets[bucket];
+			const uint32_t last = rows.back();
+			rows[pos] = last;
+			mytable.template at<3>(last) = pos;
+			rows.pop_back();
+			if (rows.empty() && bucket < OVERFLOW_BUCKET) myoccupied[bucket / WHEEL_SLOTS] &= ~(1ull << (bucket % WHEEL_SLOTS));
+		}
+
+		// Erases a row from the wheel and the table, and points the wheel at the row that moved into its place.
+		void erase_row(uint32_t row) {
+			unplace(row);
+			mytable.erase_at(row);
+			if (row < mytable.size()) mybuckets[mytable.template at<2>(row)][mytable.template at<3>(row)] = row;
+			// Erasing leaves deleted slots in the hashmap; rebuild it now and then so they can't pile up.
+			if (++myerasures >= mytable.capacity()) {
+				mytable.rehash();
+				myerasures = 0;
+			}
+		}
+
+		// Erases every row in a bucket.  Rows that move while we're at it only ever move to lower indices
+		// of this bucket or to other buckets, so walking from the end visits each one once.
+		template <typename Fn>
+		size_t expire_bucket(size_t bucket, Fn& fn) {
+			std::vector<uint32_t>& rows = mybuckets[bucket];
+			size_t num_expired = 0;
+			while (!rows.empty()) {
+				const uint32_t row = rows.back();
+				fn((const ttl_htable&)*this, (size_t)row);
+				erase_row(row);
+				++num_expired;
+			}
+			return num_expired;
+		}
+
+		// Takes every row out of a bucket and places it again, which moves it down to a lower level.
+		void cascade(size_t bucket) {
+			if (mybuckets[bucket].empty()) return;
+			std::vector<uint32_t> rows;
+			rows.swap(mybuckets[bucket]);
+			if (bucket < OVERFLOW_BUCKET) myoccupied[bucket / WHEEL_SLOTS] &= ~(1ull << (bucket % WHEEL_SLOTS));
+			for (uint32_t row : rows) place(row);
+		}
+
+		// Jumps the clock straight to 'now': expires everything due by looking at every entry, then re-places the rest.
+		template <typename Fn>
+		size_t rebuild(uint64_t now, Fn& fn) {
+			size_t num_expired = 0;
+			for (size_t row = mytable.size(); row-- > 0;) {
+				if (row >= mytable.size() || mytable.template at<1>(row) > now) continue;
+				fn((const ttl_htable&)*this, row);
+				erase_row((uint32_t)row);
+				++num_expired;
+			}
+			mynow = now;
+			for (auto& rows : mybuckets) rows.clear();
+			for (uint64_t& bits : myoccupied) bits = 0;
+			for (size_t row = 0; row < mytable.size(); ++row) place((uint32_t)row);
+			return num_expired;
+		}
+
+		htable<KeyT, uint64_t, uint32_t, uint32_t, ItemTs...> mytable;
+		uint64_t mynow;
+		std::vector<std::vector<uint32_t>> mybuckets;
+		uint64_t myoccupied[WHEEL_LEVELS] = {};
+		size_t myerasures = 0;
+	};
+
+} // namespace hvh
+
+#endif // HVH_TOOLS_TTLHTABLE_H
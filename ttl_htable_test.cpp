@@ -0,0 +1,108 @@
+#include "ttl_htable.hpp"
+#include <string>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+using namespace std;
+
+// Expires up to 'now', and checks that exactly the entries due by then were expired, and that everything left is intact.
+static bool expire_and_check(hvh::ttl_htable<uint64_t, string>& table, unordered_map<uint64_t, uint64_t>& deadlines, uint64_t now) {
+	vector<uint64_t> expired;
+	size_t count = table.expire_until(now, [&](const hvh::ttl_htable<uint64_t, string>& t, size_t index) {
+		if (t.item<0>(index) != to_string(t.key(index))) printf("Entry %zi is about to expire with the wrong item.\n", (size_t)t.key(index));
+		expired.push_back(t.key(index));
+	});
+	vector<uint64_t> expected;
+	for (const auto& entry : deadlines) if (entry.second <= now) expected.push_back(entry.first);
+	sort(expired.begin(), expired.end());
+	sort(expected.begin(), expected.end());
+	if (count != expired.size() || expired != expected) {
+		printf("Expiring until %zi erased %zi entries, but %zi were due.\n", (size_t)now, expired.size(), expected.size());
+		return false;
+	}
+	for (uint64_t key : expired) deadlines.erase(key);
+	if (table.size() != deadlines.size()) {
+		printf("The table has %zi entries, expected %zi.\n", table.size(), deadlines.size());
+		return false;
+	}
+	for (size_t i = 0; i < table.size(); ++i) {
+		auto it = deadlines.find(table.key(i));
+		if (it == deadlines.end() || it->second != table.deadline(i) || table.find(table.key(i)) != i || table.item<0>(i) != to_string(table.key(i))) {
+			printf("Entry %zi (key %zi) is wrong after expiring until %zi.\n", i, (size_t)table.key(i), (size_t)now);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ttl_htable_test() {
+	printf("Testing ttl_htable...\n");
+	bool success = true;
+
+	hvh::ttl_htable<uint64_t, string> sessions(1000);
+	sessions.insert(1, 1010, string("1"));
+	sessions.insert(2, 1500, string("2"));
+	sessions.insert(3, 999, string("3"));
+	if (sessions.expire_until(1000) != 1 || sessions.find(3) != SIZE_MAX || sessions.size() != 2) {
+		printf("An entry inserted after its deadline should expire on the next call.\n");
+		success = false;
+	}
+	if (sessions.expire_until(1009) != 0 || sessions.expire_until(1010) != 1 || sessions.find(1) != SIZE_MAX) {
+		printf("An entry should expire on exactly its deadline.\n");
+		success = false;
+	}
+	// Keeping a session alive moves its deadline.
+	sessions.set_deadline(sessions.find(2), 5000);
+	if (sessions.expire_until(4999) != 0 || sessions.find(2) == SIZE_MAX || sessions.expire_until(5000) != 1) {
+		printf("set_deadline should postpone expiry.\n");
+		success = false;
+	}
+
+	// Random deadlines, near and far, with random steps of the clock, compared against a plain map.
+	// The clock starts just before the top level of the wheel wraps, so that far deadlines go through the overflow bucket.
+	mt19937_64 random(73);
+	const uint64_t start = (1ull << 36) - 20000;
+	hvh::ttl_htable<uint64_t, string> table(start);
+	unordered_map<uint64_t, uint64_t> deadlines;
+	uint64_t now = start, next_key = 0;
+	for (int round = 0; round < 300 && success; ++round) {
+		for (int i = 0; i < 40; ++i) {
+			uint64_t deadline;
+			switch (random() % 5) {
+				case 0: deadline = now + random() % 64; break;
+				case 1: deadline = now + random() % 5000; break;
+				case 2: deadline = now + random() % 300000; break;
+				case 3: deadline = (1ull << 37) + random() % 100000; break;
+				default: deadline = now - random() % 10; break;
+			}
+			table.insert(next_key, deadline, to_string(next_key));
+			deadlines[next_key++] = deadline;
+		}
+		// Move some deadlines and erase some entries by hand, so rows move around outside of expiry too.
+		for (int i = 0; i < 5 && table.size(); ++i) {
+			size_t index = random() % table.size();
+			uint64_t deadline = now + random() % 3000;
+			deadlines[table.key(index)] = deadline;
+			table.set_deadline(index, deadline);
+		}
+		if (table.size() && random() % 2) {
+			size_t index = random() % table.size();
+			deadlines.erase(table.key(index));
+			table.erase_at(index);
+		}
+		now += (round % 50 == 49) ? 100000 + random() % 5000000 : random() % 1500;
+		success &= expire_and_check(table, deadlines, now);
+	}
+
+	// Far enough to cross into the overflow deadlines, then past all of them.
+	success = success && expire_and_check(table, deadlines, (1ull << 37) + 50000);
+	success = success && expire_and_check(table, deadlines, (1ull << 37) + 200000);
+	if (success && table.size() != 0) {
+		printf("Every entry should have expired, but %zi are left.\n", table.size());
+		success = false;
+	}
+
+	return success;
+}